@@ -11,14 +11,24 @@
  *
  ********************************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE         //  For copy_file_range
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#endif
 
 #include "DB.h"
 
@@ -99,6 +109,242 @@ char *Strdup(char *name, char *mesg)
   return (s);
 }
 
+  //  Large vectors:  each is preceded by a header of HUGE_HEAD bytes recording how it was
+  //    obtained, so that Huge_Free and Huge_Realloc can undo it.
+
+#define HUGE_HEAD  64          //  Keeps the vector 64-byte aligned
+#define HUGE_MIN   0x400000    //  Vectors smaller than this are always malloc'd
+#define THP_SIZE   0x200000    //  Size of a transparent huge page
+
+#define HUGE_MALLOC    0       //  Kinds of vector:  malloc'd
+#define HUGE_THP       1       //    mapped and advised to use transparent huge pages
+#define HUGE_MAPPED    2       //    mapped but the advice was refused
+#define HUGE_EXPLICIT  3       //    mapped with explicit (hugetlbfs) pages
+
+typedef struct
+  { char  *base;    //  Start of the malloc'd block or mapping
+    int64  span;    //  Its size in bytes
+    int64  size;    //  Size of the vector proper
+    int    kind;
+  } Huge_Head;
+
+static int   Huge_Mode = HUGE_PAGES_THP;
+static int64 Huge_Count[4], Huge_Bytes[4];
+static int   Huge_Report;     //  Measure Huge_Backed (costs a scan of smaps per free)
+static int64 Huge_Backed;     //  Bytes of HUGE_THP vectors found in huge pages when freed
+static int64 Huge_Failed;     //  # of vectors for which explicit pages could not be had
+
+static pthread_mutex_t Huge_Lock = PTHREAD_MUTEX_INITIALIZER;
+
+int Set_Huge_Pages(int mode)
+{ if (mode != HUGE_PAGES_THP && mode != HUGE_PAGES_OFF && mode != 2 && mode != 1024)
+    return (1);
+  Huge_Mode = mode;
+  return (0);
+}
+
+void Report_Huge_Pages(int on)
+{ Huge_Report = on; }
+
+#ifdef __linux__
+
+  //  Bytes of [beg,beg+len) that are backed by transparent huge pages according to smaps.
+  //    smaps only gives a count per VMA, and the kernel may have merged the mapping with
+  //    an adjacent one that is also advised MADV_HUGEPAGE, so for each VMA overlapping
+  //    the range its count is taken up to the size of the overlap.  The result is thus
+  //    an upper bound when a merged neighbour holds huge pages of its own.
+
+static int64 thp_backed(char *beg, int64 len)
+{ FILE  *f;
+  char   line[256];
+  uint64 lo, hi, kb;
+  uint64 b, e;
+  int64  sum, over;
+
+  f = fopen("/proc/self/smaps","r");
+  if (f == NULL)
+    return (0);
+  b    = (uint64) beg;
+  e    = b + len;
+  sum  = 0;
+  over = 0;
+  while (fgets(line,256,f) != NULL)
+    if (sscanf(line,"%llx-%llx ",&lo,&hi) == 2)
+      { if (lo < b)
+          lo = b;
+        if (hi > e)
+          hi = e;
+        if (lo < hi)
+          over = hi-lo;
+        else
+          over = 0;
+      }
+    else if (over > 0 && sscanf(line,"AnonHugePages: %llu kB",&kb) == 1)
+      { if (kb*1024 < (uint64) over)
+          sum += kb*1024;
+        else
+          sum += over;
+      }
+  fclose(f);
+  return (sum);
+}
+
+#endif
+
+void *Huge_Malloc(int64 size, char *mesg)
+{ Huge_Head *head;
+  char      *base;
+  int64      span;
+  int        kind;
+
+  span = size + HUGE_HEAD;
+  base = NULL;
+  kind = HUGE_MALLOC;
+
+#ifdef __linux__
+  if (Huge_Mode != HUGE_PAGES_OFF && span >= HUGE_MIN)
+    {
+#ifdef MAP_HUGETLB
+      if (Huge_Mode > 0)
+        { int64 page;
+          int   shift;
+
+          page = Huge_Mode * 0x100000ll;
+          for (shift = 0; (1ll << shift) < page; shift++)
+            ;
+          span = ((size + HUGE_HEAD + page-1) / page) * page;
+          base = mmap(NULL,span,PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(shift << MAP_HUGE_SHIFT),-1,0);
+          if (base == MAP_FAILED)
+            { base = NULL;
+              pthread_mutex_lock(&Huge_Lock);
+              Huge_Failed += 1;
+              pthread_mutex_unlock(&Huge_Lock);
+            }
+          else
+            kind = HUGE_EXPLICIT;
+        }
+#endif
+      if (base == NULL)      //  Map THP_SIZE more than needed and trim to a THP_SIZE boundary
+        { char *map;
+          int64 pre;
+
+          span = ((size + HUGE_HEAD + THP_SIZE-1) / THP_SIZE) * THP_SIZE;
+          map  = mmap(NULL,span+THP_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+          if (map != MAP_FAILED)
+            { pre  = (THP_SIZE - ((uint64) map) % THP_SIZE) % THP_SIZE;
+              base = map + pre;
+              if (pre > 0)
+                munmap(map,pre);
+              munmap(base+span,THP_SIZE-pre);
+              if (madvise(base,span,MADV_HUGEPAGE) == 0)
+                kind = HUGE_THP;
+              else
+                kind = HUGE_MAPPED;
+            }
+        }
+    }
+#endif
+
+  if (base == NULL)
+    { span = size + HUGE_HEAD;
+      base = (char *) Malloc(span,mesg);
+      if (base == NULL)
+        return (NULL);
+      kind = HUGE_MALLOC;
+    }
+
+  head = (Huge_Head *) base;
+  head->base = base;
+  head->span = span;
+  head->size = size;
+  head->kind = kind;
+
+  pthread_mutex_lock(&Huge_Lock);
+  Huge_Count[kind] += 1;
+  Huge_Bytes[kind] += size;
+  pthread_mutex_unlock(&Huge_Lock);
+
+  return ((void *) (base + HUGE_HEAD));
+}
+
+void Huge_Free(void *vec)
+{ Huge_Head *head;
+
+  if (vec == NULL)
+    return;
+  head = (Huge_Head *) (((char *) vec) - HUGE_HEAD);
+  if (head->kind == HUGE_MALLOC)
+    free(head->base);
+#ifdef __linux__
+  else
+    { if (head->kind == HUGE_THP && Huge_Report)
+        { int64 backed = thp_backed(head->base,head->span);
+
+          pthread_mutex_lock(&Huge_Lock);
+          Huge_Backed += backed;
+          pthread_mutex_unlock(&Huge_Lock);
+        }
+      munmap(head->base,head->span);
+    }
+#endif
+}
+
+void *Huge_Realloc(void *vec, int64 size, char *mesg)
+{ Huge_Head *head;
+  void      *new;
+
+  if (vec == NULL)
+    return (Huge_Malloc(size,mesg));
+
+  head = (Huge_Head *) (((char *) vec) - HUGE_HEAD);
+  if (head->kind == HUGE_MALLOC && (Huge_Mode == HUGE_PAGES_OFF || size + HUGE_HEAD < HUGE_MIN))
+    { char *base = (char *) Realloc(head->base,size+HUGE_HEAD,mesg);
+
+      if (base == NULL)
+        return (NULL);
+      head = (Huge_Head *) base;
+      pthread_mutex_lock(&Huge_Lock);
+      Huge_Bytes[HUGE_MALLOC] += size - head->size;
+      pthread_mutex_unlock(&Huge_Lock);
+      head->base = base;
+      head->span = size + HUGE_HEAD;
+      head->size = size;
+      return ((void *) (base + HUGE_HEAD));
+    }
+
+  new = Huge_Malloc(size,mesg);
+  if (new == NULL)
+    return (NULL);
+  if (size < head->size)
+    memcpy(new,vec,size);
+  else
+    memcpy(new,vec,head->size);
+  Huge_Free(vec);
+  return (new);
+}
+
+void Print_Huge_Pages(FILE *out)
+{ static char *what[4] = { "malloc'd", "transparent", "mapped, advice refused", "explicit" };
+  int k;
+
+  pthread_mutex_lock(&Huge_Lock);
+  fprintf(out,"\n  Large vectors:\n");
+  for (k = 3; k >= 0; k--)
+    if (Huge_Count[k] > 0)
+      { fprintf(out,"    %-22s %6lld %9.2fGb",what[k],Huge_Count[k],Huge_Bytes[k]/1073741824.);
+        if (k == HUGE_EXPLICIT)
+          fprintf(out,"  (%dMB pages)",Huge_Mode);
+        if (k == HUGE_THP && Huge_Report)
+          fprintf(out,"  (%.2fGb in huge pages when freed)",Huge_Backed/1073741824.);
+        fprintf(out,"\n");
+      }
+  if (Huge_Failed > 0)
+    fprintf(out,"    %lld could not get explicit %dMB pages (are any reserved?)\n",
+                Huge_Failed,Huge_Mode);
+  pthread_mutex_unlock(&Huge_Lock);
+}
+
 FILE *Fopen(char *name, char *mode)
 { FILE *f;
 
@@ -157,6 +403,51 @@ char *Root(char *name, char *suffix)
   return (path);
 }
 
+int64 Copy_Bytes(int in, int64 off, int out, int64 len, char *buf, int64 bsize)
+{ int64 n, kern;
+
+  kern = 0;
+#ifdef __linux__
+  { off_t pos = off;
+    int   ok  = 1;
+
+    while (len > 0)
+      { n = copy_file_range(in,&pos,out,NULL,len,0);
+        if (n <= 0)
+          { ok = (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                            errno == EBADF || errno == EOPNOTSUPP));
+            break;
+          }
+        len  -= n;
+        kern += n;
+      }
+    while (len > 0 && ok)       //  Say out is a pipe
+      { n = sendfile(out,in,&pos,len);
+        if (n <= 0)
+          break;
+        len  -= n;
+        kern += n;
+      }
+    off = pos;
+  }
+#endif
+
+  while (len > 0)
+    { n = (len < bsize ? len : bsize);
+      if (pread(in,buf,n,off) != n)
+        { EPRINTF(EPLACE,"%s: System error, read failed!\n",Prog_Name);
+          EXIT(-1);
+        }
+      if (write(out,buf,n) != n)
+        { EPRINTF(EPLACE,"%s: System error, write failed!\n",Prog_Name);
+          EXIT(-1);
+        }
+      off += n;
+      len -= n;
+    }
+  return (kern);
+}
+
 char *Catenate(char *path, char *sep, char *root, char *suffix)
 { static char *cat = NULL;
   static int   max = -1;
@@ -1189,7 +1480,7 @@ void Print_Read(char *s, int width)
 
 void Close_DB(DAZZ_DB *db)
 { if (db->loaded)
-    free(((char *) (db->bases)) - 1);
+    Huge_Free(((char *) (db->bases)) - 1);
   else if (db->bases != NULL)
     fclose((FILE *) db->bases);
   if (db->reads != NULL)
@@ -1399,7 +1690,7 @@ int Load_All_Reads(DAZZ_DB *db, int ascii)
   if (db->loaded)
     return (0);
 
-  seq = (char *) Malloc(db->totlen+nreads+4,"Allocating All Sequence Reads");
+  seq = (char *) Huge_Malloc(db->totlen+nreads+4,"Allocating All Sequence Reads");
   if (seq == NULL)
     EXIT(1);
 
@@ -1441,6 +1732,327 @@ int Load_All_Reads(DAZZ_DB *db, int ascii)
 }
 
 
+/*******************************************************************************************
+ *
+ *  READ CACHE: OPEN, LOAD, PREFETCH, & CLOSE
+ *
+ ********************************************************************************************/
+
+#define CACHE_GAP    0x10000    //  Prefetch reads whose .bps data is within this many bytes in
+#define CACHE_STAGE  0x400000   //    a single read of at most this many bytes
+
+typedef struct
+  { int   read;       //  Id of the read in this entry
+    int   len;        //  Its length
+    int   prev, next; //  LRU list (most recently used first), or free list (next only)
+    char *seq;        //  Its uncompressed bases (Uncompress_Read may write up to 3 past len)
+  } Cache_Entry;
+
+typedef struct
+  { DAZZ_DB        *db;
+    FILE           *bases;   //  Own file pointer so the db's may be used concurrently
+    int64           msize;   //  Memory budget for sequence
+    int64           mused;   //  Memory currently holding sequence
+    int            *slot;    //  slot[i] = entry holding read i, or -1
+    Cache_Entry    *ent;
+    int             emax;
+    int             efree;   //  Head of free entry list
+    int             head;    //  LRU list
+    int             tail;
+    char           *stage;   //  Staging buffer for coalesced prefetch reads
+    pthread_mutex_t lock;
+  } _DAZZ_CACHE;
+
+static void cache_unlink(_DAZZ_CACHE *c, int e)
+{ Cache_Entry *x = c->ent+e;
+
+  if (x->prev >= 0)
+    c->ent[x->prev].next = x->next;
+  else
+    c->head = x->next;
+  if (x->next >= 0)
+    c->ent[x->next].prev = x->prev;
+  else
+    c->tail = x->prev;
+}
+
+static void cache_front(_DAZZ_CACHE *c, int e)
+{ Cache_Entry *x = c->ent+e;
+
+  x->prev = -1;
+  x->next = c->head;
+  if (c->head >= 0)
+    c->ent[c->head].prev = e;
+  else
+    c->tail = e;
+  c->head = e;
+}
+
+  //  Get an entry with room for a read of length len, evicting the least recently used
+  //    entries until the budget is met, and put it at the front of the LRU list.
+
+static int cache_entry(_DAZZ_CACHE *c, int i, int len)
+{ Cache_Entry *x;
+  int          e, n;
+
+  while (c->mused + len > c->msize && c->tail >= 0)
+    { e = c->tail;
+      x = c->ent+e;
+      cache_unlink(c,e);
+      c->slot[x->read] = -1;
+      c->mused -= x->len;
+      free(x->seq-1);
+      x->next  = c->efree;
+      c->efree = e;
+    }
+
+  if (c->efree < 0)
+    { n = 1.2*c->emax + 100;
+      x = (Cache_Entry *) Realloc(c->ent,sizeof(Cache_Entry)*n,"Enlarging read cache");
+      if (x == NULL)
+        return (-1);
+      c->ent = x;
+      for (e = n-1; e >= c->emax; e--)
+        { x[e].next = c->efree;
+          c->efree  = e;
+        }
+      c->emax = n;
+    }
+
+  e = c->efree;
+  x = c->ent+e;
+  x->seq = (char *) Malloc(len+5,"Allocating cached read");
+  if (x->seq == NULL)
+    return (-1);
+  x->seq  += 1;
+  x->read  = i;
+  x->len   = len;
+  c->efree = x->next;
+  c->mused += len;
+  c->slot[i] = e;
+  cache_front(c,e);
+  return (e);
+}
+
+// Set up a cache of up to 'memory' bytes of uncompressed reads of 'db' that are fetched
+//   through a file pointer of the cache's own.  The cache may be shared by threads.  A NULL
+//   pointer is returned if an error occured and INTERACTIVE is defined.
+
+DAZZ_CACHE *Open_Read_Cache(DAZZ_DB *db, int64 memory)
+{ _DAZZ_CACHE *c;
+  int          i;
+
+  c = (_DAZZ_CACHE *) Malloc(sizeof(_DAZZ_CACHE),"Allocating read cache");
+  if (c == NULL)
+    EXIT(NULL);
+  c->db    = db;
+  c->msize = memory;
+  c->mused = 0;
+  c->ent   = NULL;
+  c->emax  = 0;
+  c->efree = -1;
+  c->head  = -1;
+  c->tail  = -1;
+  c->slot  = NULL;
+  c->stage = NULL;
+  c->bases = NULL;
+  pthread_mutex_init(&(c->lock),NULL);
+
+  if (db->loaded)
+    return ((DAZZ_CACHE *) c);
+
+  c->slot = (int *) Malloc(sizeof(int)*db->nreads,"Allocating read cache");
+  if (c->slot == NULL)
+    goto error;
+  for (i = 0; i < db->nreads; i++)
+    c->slot[i] = -1;
+
+  c->stage = (char *) Malloc(CACHE_STAGE,"Allocating read cache");
+  if (c->stage == NULL)
+    goto error;
+
+  c->bases = Fopen(MyCatenate(db->path,"","",".bps"),"r");
+  if (c->bases == NULL)
+    goto error;
+
+  return ((DAZZ_CACHE *) c);
+
+error:
+  free(c->stage);
+  free(c->slot);
+  free(c);
+  EXIT(NULL);
+}
+
+// Exactly the same as Load_Subread, save that the read is taken from, or brought into, the
+//   cache 'cache'.
+
+char *Load_Cached_Subread(DAZZ_CACHE *cache, int i, int beg, int end, char *read, int ascii)
+{ _DAZZ_CACHE *c  = (_DAZZ_CACHE *) cache;
+  DAZZ_DB     *db = c->db;
+  Cache_Entry *x;
+  int          e, len, clen;
+
+  if (db->loaded)
+    return (Load_Subread(db,i,beg,end,read,ascii));
+
+  if (i < 0 || i >= db->nreads)
+    { EPRINTF(EPLACE,"%s: Index out of bounds (Load_Cached_Subread)\n",Prog_Name);
+      EXIT(NULL);
+    }
+
+  pthread_mutex_lock(&(c->lock));
+
+  e = c->slot[i];
+  if (e >= 0)
+    { cache_unlink(c,e);
+      cache_front(c,e);
+    }
+  else
+    { len = db->reads[i].rlen;
+      e   = cache_entry(c,i,len);
+      if (e < 0)
+        { pthread_mutex_unlock(&(c->lock));
+          EXIT(NULL);
+        }
+      x = c->ent+e;
+      if (ftello(c->bases) != db->reads[i].boff)
+        fseeko(c->bases,db->reads[i].boff,SEEK_SET);
+      clen = COMPRESSED_LEN(len);
+      if (clen > 0)
+        { if (fread(x->seq,clen,1,c->bases) != 1)
+            { EPRINTF(EPLACE,"%s: Failed read of .bps file (Load_Cached_Subread)\n",Prog_Name);
+              pthread_mutex_unlock(&(c->lock));
+              EXIT(NULL);
+            }
+        }
+      Uncompress_Read(len,x->seq);
+    }
+
+  len = end-beg;
+  memcpy(read,c->ent[e].seq+beg,len);
+
+  pthread_mutex_unlock(&(c->lock));
+
+  read[len] = 4;
+  if (ascii == 1)
+    { Lower_Read(read);
+      read[-1] = '\0';
+    }
+  else if (ascii == 2)
+    { Upper_Read(read);
+      read[-1] = '\0';
+    }
+  else
+    read[-1] = 4;
+
+  return (read);
+}
+
+static int READ_ORDER(const void *l, const void *r)
+{ int x = *((int *) l);
+  int y = *((int *) r);
+  return (x-y);
+}
+
+// Bring the n reads in 'reads' into the cache, sorting 'reads' in the process.  Reads not
+//   already cached are fetched in .bps order, those close together in a single read, and
+//   no more than half the cache is filled by a call.  Return with a zero, except when an
+//   error occurs and INTERACTIVE is defined in which case return with 1.
+
+int Prefetch_Reads(DAZZ_CACHE *cache, int n, int *reads)
+{ _DAZZ_CACHE *c  = (_DAZZ_CACHE *) cache;
+  DAZZ_DB     *db = c->db;
+  DAZZ_READ   *r  = db->reads;
+  int64        beg, end, fill;
+  int          a, b, k, e, i;
+
+  if (db->loaded || n <= 0)
+    return (0);
+
+  qsort(reads,n,sizeof(int),READ_ORDER);
+
+  pthread_mutex_lock(&(c->lock));
+
+  fill = 0;
+  for (a = 0; a < n; a = b)
+
+    //  Find the next read not in the cache, and the group of reads after it (in
+    //    [a,b)) that can be fetched with it
+
+    { i = reads[a];
+      if (i < 0 || i >= db->nreads || c->slot[i] >= 0)
+        { b = a+1;
+          continue;
+        }
+      if (fill + r[i].rlen > c->msize/2)
+        break;
+
+      beg = r[i].boff;
+      end = beg + COMPRESSED_LEN(r[i].rlen);
+      for (b = a+1; b < n; b++)
+        { i = reads[b];
+          if (i < 0 || i >= db->nreads)
+            break;
+          if (c->slot[i] >= 0 || i == reads[b-1])
+            continue;
+          if (r[i].boff - end > CACHE_GAP)
+            break;
+          if ((r[i].boff + COMPRESSED_LEN(r[i].rlen)) - beg > CACHE_STAGE)
+            break;
+          end = r[i].boff + COMPRESSED_LEN(r[i].rlen);
+        }
+
+      if (end - beg > CACHE_STAGE)   //  A single read bigger than the stage
+        { b = a+1;
+          continue;
+        }
+
+      if (ftello(c->bases) != beg)
+        fseeko(c->bases,beg,SEEK_SET);
+      if (end > beg && fread(c->stage,end-beg,1,c->bases) != 1)
+        { EPRINTF(EPLACE,"%s: Failed read of .bps file (Prefetch_Reads)\n",Prog_Name);
+          pthread_mutex_unlock(&(c->lock));
+          EXIT(1);
+        }
+
+      for (k = a; k < b; k++)
+        { i = reads[k];
+          if (c->slot[i] >= 0 || r[i].boff + COMPRESSED_LEN(r[i].rlen) > end)
+            continue;
+          e = cache_entry(c,i,r[i].rlen);
+          if (e < 0)
+            { pthread_mutex_unlock(&(c->lock));
+              EXIT(1);
+            }
+          memcpy(c->ent[e].seq,c->stage+(r[i].boff-beg),COMPRESSED_LEN(r[i].rlen));
+          Uncompress_Read(r[i].rlen,c->ent[e].seq);
+          fill += r[i].rlen;
+        }
+    }
+
+  pthread_mutex_unlock(&(c->lock));
+  return (0);
+}
+
+// Free all the memory and close the file pointer of cache 'cache'.
+
+void Close_Read_Cache(DAZZ_CACHE *cache)
+{ _DAZZ_CACHE *c = (_DAZZ_CACHE *) cache;
+  int          e;
+
+  for (e = c->head; e >= 0; e = c->ent[e].next)
+    free(c->ent[e].seq-1);
+  free(c->ent);
+  free(c->slot);
+  free(c->stage);
+  if (c->bases != NULL)
+    fclose(c->bases);
+  pthread_mutex_destroy(&(c->lock));
+  free(c);
+}
+
+
 /*******************************************************************************************
  *
  *  ARROW OPEN, LOAD, LOAD_ALL, & CLOSE
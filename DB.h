@@ -236,10 +236,38 @@ void *Malloc(int64 size, char *mesg);                    //  Guarded versions of
 void *Realloc(void *object, int64 size, char *mesg);     //  and strdup, that output "mesg" to
 char *Strdup(char *string, char *mesg);                  //  stderr if out of memory
 
+// Huge_Malloc, Huge_Realloc, and Huge_Free are for vectors large enough that TLB misses matter.
+//   On Linux such a vector (of HUGE_MIN bytes or more) is mapped on its own and backed, if
+//   Set_Huge_Pages has so configured, by explicit hugetlbfs pages of 2MB or 1GB (which must be
+//   reserved by the administrator), and otherwise is advised to use transparent huge pages.
+//   If a mapping cannot be had the vector is malloc'd.  A vector from Huge_Malloc must only be
+//   freed or resized with Huge_Free or Huge_Realloc.  Print_Huge_Pages reports how many
+//   vectors and bytes were obtained each way and, if Report_Huge_Pages(1) was called before
+//   they were freed, how much of the transparent ones was found in huge pages (measuring
+//   this scans /proc/self/smaps on each free).  Set_Huge_Pages returns 1 if mode is not
+//   one of the values below, 2 (MB), or 1024 (MB).
+
+#define HUGE_PAGES_THP  -1    //  Transparent huge pages (the default)
+#define HUGE_PAGES_OFF   0    //  No huge pages, always malloc
+
+int   Set_Huge_Pages(int mode);
+void  Report_Huge_Pages(int on);
+void *Huge_Malloc(int64 size, char *mesg);
+void *Huge_Realloc(void *vec, int64 size, char *mesg);
+void  Huge_Free(void *vec);
+void  Print_Huge_Pages(FILE *out);
+
 FILE *Fopen(char *path, char *mode);     // Open file path for "mode"
 char *PathTo(char *path);                // Return path portion of file name "path"
 char *Root(char *path, char *suffix);    // Return the root name, excluding suffix, of "path"
 
+// Copy_Bytes copies the len bytes at offset off of file in to the current position of file
+//   out, within the kernel where possible (copy_file_range, or sendfile if out is say a pipe)
+//   and otherwise through the bsize bytes at buf.  It returns the # of bytes copied within
+//   the kernel, or -1 on an error if INTERACTIVE is defined.
+
+int64 Copy_Bytes(int in, int64 off, int out, int64 len, char *buf, int64 bsize);
+
 // Catenate returns concatenation of path.sep.root.suffix in a *temporary* buffer
 // Numbered_Suffix returns concatenation of left.<num>.right in a *temporary* buffer
 
@@ -553,6 +581,22 @@ char *Load_Subread(DAZZ_DB *db, int i, int beg, int end, char *read, int ascii);
 
 int Load_All_Reads(DAZZ_DB *db, int ascii);
 
+  // A bounded memory cache of uncompressed reads, most recently used reads being kept,
+  //   that may be shared by threads.  Open_Read_Cache sets up a cache of 'memory' bytes
+  //   for 'db' with its own file pointer to the .bps file.  Load_Cached_Subread is exactly
+  //   like Load_Subread save that the read comes from the cache, and is brought into it
+  //   if not already present.  Prefetch_Reads brings the n reads in 'reads' (which is
+  //   sorted in the process) into the cache fetching them in .bps file order.  If the
+  //   reads of db are loaded, the cache simply passes requests through to Load_Subread.
+  //   Errors are handled as for Load_Subread.
+
+typedef void DAZZ_CACHE;
+
+DAZZ_CACHE *Open_Read_Cache(DAZZ_DB *db, int64 memory);
+char       *Load_Cached_Subread(DAZZ_CACHE *cache, int i, int beg, int end, char *read, int ascii);
+int         Prefetch_Reads(DAZZ_CACHE *cache, int n, int *reads);
+void        Close_Read_Cache(DAZZ_CACHE *cache);
+
 
 /*******************************************************************************************
  *
@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <dirent.h>
 
 #include "DB.h"
@@ -24,8 +25,8 @@
 #undef  SLURM  //  define if want a directly executable SLURM script
 
 static char *Usage[] =
-  { "[-vad] [-l<int(1500)>] [-s<int(100)] [-w<int(6)>] [-t<int>] [-M<int>]",
-    "       [-P<dir(/tmp)>] [-B<int(4)>] [-T<int(4)>] [-f<name>]",
+  { "[-vadiCRD] [-l<int(1500)>] [-s<int(100)] [-w<int(6)>] [-t<int>] [-M<int>]",
+    "       [-P<dir(/tmp)>] [-B<int(4)>] [-T<int(4)>] [-f<name>] [-x<int>]",
     "     ( [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-e<double(.75)>] [-H<int>]",
     "       [-k<int(20)>] [-%<int(50)>] [-h<int(70)>] [-e<double(.85)>] <ref:db|dam> )",
     "       [-m<track>]+ <reads:db|dam> [<first:int>[-<last:int>]]"
@@ -35,6 +36,7 @@ static char *Usage[] =
 
 static int    BUNIT;
 static int    VON, CON, DON;
+static int    COST, REPS;
 static int    WINT, TINT, HGAP, HINT, KINT, SINT, PINT, LINT, MINT;
 static int    NTHREADS;
 static double EREL;
@@ -42,6 +44,312 @@ static int    MMAX, MTOP;
 static char **MASK;
 static char  *ONAME;
 static char  *PDIR;
+static int    EXEC;
+static int    DAG;
+static int    INCR;
+
+  //  Script destination, and if executing (-x) the journal and daligner's predicted memory
+
+static FILE  *SCRIPT;
+static char  *JOURNAL;
+static double DAL_MEM;
+
+#define DAL_BYTES   32    //  Bytes per base of the subject and target blocks used by daligner
+#define MERGE_MEM   4.    //  GB used by LAmerge
+#define OTHER_MEM   1.    //  GB used by any other LA command
+
+  //  Cost model for bundling block comparisons into daligner jobs:  the cost of comparing
+  //    blocks a and b is taken to be w[a]*w[b] where the weight of a block is its # of bases
+  //    (in Mbp) after trimming, times with -R the square root of its repetitiveness.  The
+  //    comparison of a block against itself costs DIAG_COST times as much, as daligner then
+  //    sorts the k-mers of the block once and finds each pair of reads once (its -J timings
+  //    give a diagonal job about half the time of an off-diagonal one of the same size).  The
+  //    latter is estimated from a sample of about REP_SAMPLE bases of the block as the ratio
+  //    of the # of pairs of identical REP_KMER-mers to the # expected in random sequence.
+  //    A read of length len is sampled once the bases passed over since the previous sample
+  //    reach len * totlen/REP_SAMPLE, so that the sample is spread evenly over the block.
+
+#define DIAG_COST   .5
+#define REP_SAMPLE  1000000
+#define REP_KMER    11
+#define REP_TABLE   (1 << (2*REP_KMER))
+
+static double repetitiveness(DAZZ_DB *db, uint32 *count)
+{ char  *read;
+  int64  n;
+  double ratio, acc, pairs, expect;
+  uint32 x;
+  int    i, j, len;
+
+  read = New_Read_Buffer(db);
+  if (read == NULL)
+    exit (1);
+
+  ratio = (1.*db->totlen) / REP_SAMPLE;
+  if (ratio < 1.)
+    ratio = 1.;
+  memset(count,0,sizeof(uint32)*REP_TABLE);
+  n   = 0;
+  acc = 0.;
+  for (i = 0; i < db->nreads; i++)
+    { len  = db->reads[i].rlen;
+      acc += len;
+      if (acc < len*ratio)
+        continue;
+      acc -= len*ratio;
+      Load_Read(db,i,read,0);
+      x = 0;
+      for (j = 0; j < len; j++)
+        { x = ((x << 2) | read[j]) & (REP_TABLE-1);
+          if (j >= REP_KMER-1)
+            { count[x] += 1;
+              n += 1;
+            }
+        }
+    }
+  free(read-1);
+
+  pairs = 0.;
+  for (x = 0; x < REP_TABLE; x++)
+    pairs += ((double) count[x]) * (count[x]-1.);
+  expect = (n*(n-1.))/REP_TABLE;
+  if (pairs <= 0. || expect <= 0.)
+    return (1.);
+  return (pairs/expect);
+}
+
+  //  Return the weights w[1..nblocks] of the blocks of DB pwd/root, including repetitiveness
+  //    only if reps is set (i.e. just the sizes of the blocks otherwise)
+
+static double *block_weights(char *pwd, char *root, int nblocks, int reps)
+{ DAZZ_DB _db, *db = &_db;
+  double *w;
+  uint32 *count;
+  int     b, status;
+
+  w = (double *) Malloc(sizeof(double)*(nblocks+1),"Allocating block weights");
+  if (w == NULL)
+    exit (1);
+  if (reps)
+    { count = (uint32 *) Malloc(sizeof(uint32)*REP_TABLE,"Allocating k-mer counts");
+      if (count == NULL)
+        exit (1);
+    }
+  else
+    count = NULL;
+
+  w[0] = 0.;
+  for (b = 1; b <= nblocks; b++)
+    { if (nblocks == 1)
+        status = Open_DB(Catenate(pwd,"/",root,""),db);
+      else
+        status = Open_DB(Catenate(pwd,"/",root,Numbered_Suffix(".",b,"")),db);
+      if (status < 0)
+        exit (1);
+      Trim_DB(db);
+      w[b] = db->totlen / 1.e6;
+      if (reps)
+        w[b] *= sqrt(repetitiveness(db,count));
+      Close_DB(db);
+    }
+
+  free(count);
+  return (w);
+}
+
+  //  The cost of comparing a subject of weight ws against target k, where target diag (if
+  //    not 0) is the subject itself
+
+static double pair_cost(double ws, double *wt, int k, int diag)
+{ if (k == diag)
+    return (DIAG_COST*ws*wt[k]);
+  return (ws*wt[k]);
+}
+
+  //  Divide the targets [1,n] of a subject of weight ws into contiguous ranges [cut[j-1],cut[j])
+  //    for j in [1,m], returning m.  Without weights wt there are bits ranges of about the same
+  //    # of blocks, otherwise there are enough ranges that each costs about avg, and each cut
+  //    is placed as close as possible to its quantile of the total cost.  Target diag (if not
+  //    0) is the subject itself.
+
+static int row_cuts(double ws, double *wt, int n, int diag, int bits, double avg, int *cut)
+{ double tot, cum, q;
+  int    j, k, m;
+
+  cut[0] = 1;
+  if (wt == NULL)
+    { for (j = 1; j <= bits; j++)
+        cut[j] = (n*j)/bits + 1;
+      return (bits);
+    }
+
+  tot = 0.;
+  for (k = 1; k <= n; k++)
+    tot += pair_cost(ws,wt,k,diag);
+  m = (int) (tot/avg + .5);
+  if (m < 1)
+    m = 1;
+  if (m > n)
+    m = n;
+
+  k   = 1;     //  cum is the cost of targets [1,k)
+  cum = 0.;
+  for (j = 1; j < m; j++)
+    { q    = (tot*j)/m;
+      cum += pair_cost(ws,wt,k++,diag);
+      while (k <= n-(m-j) && cum + pair_cost(ws,wt,k,diag) - q < q - cum)
+        cum += pair_cost(ws,wt,k++,diag);
+      cut[j] = k;
+    }
+  cut[m] = n+1;
+  return (m);
+}
+
+  //  The cost of comparing a subject of weight ws against targets [low,hgh), where target
+  //    diag (if not 0) is the subject itself
+
+static double job_cost(double ws, double *wt, int low, int hgh, int diag)
+{ double c;
+  int    k;
+
+  c = 0.;
+  for (k = low; k < hgh; k++)
+    c += pair_cost(ws,wt,k,diag);
+  return (c);
+}
+
+  //  When writing a DAG (-D or -x), print the targets of the daligner jobs that produce the
+  //    .las files of block j.  Job b of row i compares block i against blocks
+  //    [rcut[i][b-1],rcut[i][b]) and produces files for block i and each of these blocks.
+
+static void print_deps(FILE *out, int j, int fblock, int lblock, int **rcut, int *rbits)
+{ int i, b;
+
+  for (i = (j < fblock ? fblock : j); i <= lblock; i++)
+    if (i == j)
+      { for (b = 1; b <= rbits[i]; b++)
+          fprintf(out," align.%d.%d",i,b);
+      }
+    else
+      { for (b = 1; b <= rbits[i]; b++)
+          if (rcut[i][b-1] <= j && j < rcut[i][b])
+            { fprintf(out," align.%d.%d",i,b);
+              break;
+            }
+      }
+}
+
+  //  When writing a DAG, declare its targets phony as none of them is a file:  all and those
+  //    in extra, the daligner jobs of rows [fblock,lblock], the checks of blocks [low,lblock],
+  //    and if merge is set the merges and removals of these blocks
+
+static void print_phony(FILE *out, char *extra, int fblock, int lblock, int low, int merge,
+                        int *rbits)
+{ int i, b;
+
+  fprintf(out,".PHONY: all%s",extra);
+  for (i = fblock; i <= lblock; i++)
+    for (b = 1; b <= rbits[i]; b++)
+      fprintf(out," align.%d.%d",i,b);
+  for (i = low; i <= lblock; i++)
+    fprintf(out," check.%d",i);
+  if (merge)
+    for (i = low; i <= lblock; i++)
+      fprintf(out," merge.%d rm.%d",i,i);
+  fprintf(out,"\n");
+}
+
+  //  The merged .las files of an overlap script depend on the parameters of its daligner and
+  //    LAmerge jobs and on the partition of the DB into blocks.  With -i the last merge job of
+  //    a script records these in <DB>.provenance, and they are read back by the next -i run to
+  //    find the blocks that have been added since and to check nothing else has changed.
+
+static char *provenance_params()
+{ static char params[1000];
+  char *p;
+  int   k;
+
+  p = params;
+  p += sprintf(p,"-k%d -%%%d -w%d -h%d -t%d -H%d -e%g -l%d -s%d -M%d",
+                 KINT,PINT,WINT,HINT,TINT,HGAP,EREL,LINT,SINT,MINT);
+  if (CON)
+    p += sprintf(p," -a");
+  for (k = 0; k < MTOP && p-params < 900; k++)
+    p += sprintf(p," -m%.50s",MASK[k]);
+  return (params);
+}
+
+  //  Print the command that records the provenance of the merged .las files of blocks 1..lblock
+
+static void print_provenance(FILE *out, char *pwd, char *root, int usepath, DAZZ_STUB *stub,
+                             int lblock)
+{ int i;
+
+  fprintf(out,"printf '%%s\\n' 'params = %s'",provenance_params());
+  fprintf(out," 'partition = %lld %d %d'",stub->bsize,stub->cutoff,stub->all);
+  fprintf(out," 'blocks = %d",lblock);
+  for (i = 0; i <= lblock; i++)
+    fprintf(out," %d",stub->ublocks[i]);
+  fprintf(out,"' >");
+  if (usepath)
+    fprintf(out," %s/",pwd);
+  else
+    fprintf(out," ");
+  fprintf(out,"%s.provenance",root);
+}
+
+  //  Read the provenance at path and return the # of blocks whose merged .las files it covers,
+  //    exiting with an error if the parameters or the partition of these blocks have changed.
+  //    If there is no provenance then this is the first -i run and 0 is returned.
+
+static int read_provenance(char *path, DAZZ_STUB *stub)
+{ FILE *file;
+  char  params[1001];
+  int64 bsize;
+  int   cutoff, all;
+  int   i, n, b;
+
+  file = fopen(path,"r");
+  if (file == NULL)
+    return (0);
+  if (fscanf(file,"params = %1000[^\n]\n",params) != 1)
+    goto junk;
+  if (fscanf(file,"partition = %lld %d %d\n",&bsize,&cutoff,&all) != 3)
+    goto junk;
+  if (fscanf(file,"blocks = %d",&n) != 1)
+    goto junk;
+
+  if (strcmp(params,provenance_params()) != 0)
+    { fprintf(stderr,"%s: Parameters differ from those of the previous run in %s:\n",
+                     Prog_Name,path);
+      fprintf(stderr,"      %s\n",params);
+      exit (1);
+    }
+  if (bsize != stub->bsize || cutoff != stub->cutoff || all != stub->all)
+    { fprintf(stderr,"%s: DB has been re-split since the previous run in %s\n",Prog_Name,path);
+      exit (1);
+    }
+  if (n > stub->nblocks)
+    { fprintf(stderr,"%s: DB has fewer blocks than the previous run in %s\n",Prog_Name,path);
+      exit (1);
+    }
+  for (i = 0; i <= n; i++)
+    { if (fscanf(file," %d",&b) != 1)
+        goto junk;
+      if (b != stub->ublocks[i])
+        { fprintf(stderr,"%s: Block %d has changed since the previous run in %s\n",
+                         Prog_Name,i > 0 ? i : 1,path);
+          exit (1);
+        }
+    }
+
+  fclose(file);
+  return (n);
+
+junk:
+  fprintf(stderr,"%s: Record %s of the previous run is junk\n",Prog_Name,path);
+  exit (1);
+}
 
 #ifdef LSF
 
@@ -53,6 +361,7 @@ static char  *PDIR;
           "bsub -q short -n 12 -o MERGE.DAL.out -e MERGE.DAL.err -R span[hosts=1] -J merge#%d"
 #define HPC_CHECK \
           "bsub -q short -n 12 -o CHECK.DAL.out -e CHECK.DAL.err -R span[hosts=1] -J check#%d"
+#define HPC_WAIT  " -K"    //  In a DAG a submission must wait for its job to finish
 
 #endif
 
@@ -66,6 +375,7 @@ static char  *PDIR;
           "srun -p batch -n 1 -c 12 -t 00:05:00 -o MERGE.DAL.out -e MERGE.DAL.err -J merge#%d"
 #define HPC_CHECK \
           "srun -p batch -n 1 -c 12 -t 00:05:00 -o CHECK.DAL.out -e CHECK.DAL.err -J check#%d"
+#define HPC_WAIT  ""       //  srun already waits for its job to finish
 
 #endif
 
@@ -74,6 +384,7 @@ void daligner_script(int argc, char *argv[])
   int   usepath;
   int   useblock;
   int   fblock, lblock;
+  int   resume;
 #ifdef HPC
   int   jobid;
 #endif
@@ -81,6 +392,7 @@ void daligner_script(int argc, char *argv[])
   FILE *out;
   char  name[100];
   char *pwd, *root;
+  DAZZ_STUB *stub;
 
   //  Make sure DB exists and is partitioned, get number of blocks in partition
 
@@ -120,11 +432,39 @@ void daligner_script(int argc, char *argv[])
     fclose(dbvis);
   }
 
+  //  If partitioned, get the block boundaries for the provenance of the merged .las files
+
+  stub = NULL;
+  if (useblock)
+    { if (access(Catenate(pwd,"/",root,".dam"),F_OK) == 0)
+        stub = Read_DB_Stub(Catenate(pwd,"/",root,".dam"),DB_STUB_BLOCKS);
+      else
+        stub = Read_DB_Stub(Catenate(pwd,"/",root,".db"),DB_STUB_BLOCKS);
+      if (stub == NULL)
+        exit (1);
+    }
+
+  //  If executing, the journal is <DB>.journal and a run is being resumed if it exists
+
+  resume = 0;
+  if (EXEC)
+    { JOURNAL = Strdup(Catenate(pwd,"/",root,".journal"),"Allocating journal name");
+      if (JOURNAL == NULL)
+        exit (1);
+      resume = (access(JOURNAL,F_OK) == 0);
+    }
+
   //  Set range fblock-lblock checking that DB.<fblock-1>.las exists & DB.<fblock>.las does not
+  //    (unless resuming an execution, when they may already be merged or not yet restored).
+  //    If incremental (-i), the range is the blocks added since the previous run.
 
   { char *eptr, *fptr;
     FILE *file;
 
+    if (argc == 3 && INCR)
+      { fprintf(stderr,"%s: Cannot give a block range with -i\n",Prog_Name);
+        exit (1);
+      }
     if (argc == 3)
       { fblock = strtol(argv[2],&eptr,10);
         if (*eptr != '\0' && *eptr != '-')
@@ -148,12 +488,25 @@ void daligner_script(int argc, char *argv[])
             exit (1);
           }
       }
+    else if (INCR)
+      { if ( ! useblock)
+          { fprintf(stderr,"%s: DB %s is not partitioned into blocks\n",Prog_Name,root);
+            exit (1);
+          }
+        fblock = read_provenance(Catenate(pwd,"/",root,".provenance"),stub) + 1;
+        lblock = nblocks;
+        if (fblock > lblock)
+          { fprintf(stderr,"%s: All %d blocks of %s have already been compared\n",
+                           Prog_Name,nblocks,root);
+            exit (0);
+          }
+      }
     else
       { fblock = 1;
         lblock = nblocks;
       }
 
-    if (fblock > 1)
+    if (fblock > 1 && ! resume)
       { file = fopen(Catenate(pwd,"/",root,Numbered_Suffix(".",fblock-1,".las")),"r");
         if (file == NULL)
           { if (usepath)
@@ -171,7 +524,9 @@ void daligner_script(int argc, char *argv[])
       file = fopen(Catenate(pwd,"/",root,Numbered_Suffix(".",fblock,".las")),"r");
     else
       file = fopen(Catenate(pwd,"/",root,".las"),"r");
-    if (file != NULL)
+    if (file != NULL && resume)
+      fclose(file);
+    else if (file != NULL)
       { if (usepath)
           if (useblock)
             fprintf(stderr,"%s: File %s/%s.%d.las should not yet exist!\n",
@@ -187,11 +542,93 @@ void daligner_script(int argc, char *argv[])
       }
 
     DON = (DON && (lblock > 1));
-    out = stdout;
+    out = SCRIPT;
   }
 
-  { int njobs;
-    int i, j, k;
+  //  If executing, predict daligner's memory from the largest block (unless -M is smaller)
+
+  if (EXEC)
+    { double *size, max;
+      int     i;
+
+      size = block_weights(pwd,root,nblocks,0);
+      max  = 0.;
+      for (i = 1; i <= nblocks; i++)
+        if (size[i] > max)
+          max = size[i];
+      DAL_MEM = (DAL_BYTES * 2*max) / 1.e3;
+      if (MINT > 0 && MINT < DAL_MEM)
+        DAL_MEM = MINT;
+      free(size);
+    }
+
+  { int     njobs;
+    int     i, j, k;
+    double *weight, avg;
+    int   **rcut, *rbits;
+
+    //  Get the block weights if bundling by cost, and the average cost of a job when
+    //    there are as many jobs as there would be with -B blocks per job
+
+    rbits = (int *) Malloc(sizeof(int)*(lblock+1),"Allocating job cuts");
+    rcut  = (int **) Malloc(sizeof(int *)*(lblock+1),"Allocating job cuts");
+    if (rbits == NULL || rcut == NULL)
+      exit (1);
+    for (i = fblock; i <= lblock; i++)
+      { rcut[i] = (int *) Malloc(sizeof(int)*(i+2),"Allocating job cuts");
+        if (rcut[i] == NULL)
+          exit (1);
+      }
+
+    weight = NULL;
+    avg    = 0.;
+    if (COST && useblock)
+      { weight = block_weights(pwd,root,nblocks,REPS);
+        njobs  = 0;
+        for (i = fblock; i <= lblock; i++)
+          { avg   += job_cost(weight[i],weight,1,i+1,i);
+            njobs += (i-1)/BUNIT+1;
+          }
+        avg /= njobs;
+      }
+
+    //  Cut each row of block comparisons into the jobs that perform them
+
+    njobs = 0;
+    for (i = fblock; i <= lblock; i++)
+      { rbits[i] = row_cuts(weight?weight[i]:0.,weight,i,i,(i-1)/BUNIT+1,avg,rcut[i]);
+        njobs   += rbits[i];
+      }
+
+    //  If a DAG, the default target is the checks and merges of every block, and the block
+    //    .las files are removed only by the target clean
+
+    if (DAG)
+      { fprintf(out,"# Daligner DAG, each job runs as soon as the jobs it depends on are done\n");
+        fprintf(out,"all:");
+        for (i = 1; i <= lblock; i++)
+          fprintf(out," check.%d",i);
+        if (lblock > 1)
+          { for (i = 1; i <= lblock; i++)
+              fprintf(out," merge.%d",i);
+            if (INCR)
+              fprintf(out," provenance");
+          }
+        fprintf(out,"\n");
+        if (lblock > 1)
+          { fprintf(out,"clean:");
+            for (i = 1; i <= lblock; i++)
+              fprintf(out," rm.%d",i);
+            fprintf(out,"\n");
+            if (DON)
+              print_phony(out,INCR?" clean mkdir provenance":" clean mkdir",
+                          fblock,lblock,1,1,rbits);
+            else
+              print_phony(out,INCR?" clean provenance":" clean",fblock,lblock,1,1,rbits);
+          }
+        else
+          print_phony(out,"",fblock,lblock,1,0,rbits);
+      }
 
     //  Create all work subdirectories if DON
 
@@ -202,8 +639,15 @@ void daligner_script(int argc, char *argv[])
           }
 
         fprintf(out,"# Create work subdirectories\n");
-        for (i = 1; i <= lblock; i++)
-          fprintf(out,"mkdir -p work%d\n",i);
+        if (DAG)
+          { fprintf(out,"mkdir:\n\tmkdir -p");
+            for (i = 1; i <= lblock; i++)
+              fprintf(out," work%d",i);
+            fprintf(out,"\n");
+          }
+        else
+          for (i = 1; i <= lblock; i++)
+            fprintf(out,"mkdir -p work%d\n",i);
 
         if (ONAME != NULL)
           fclose(out);
@@ -216,25 +660,24 @@ void daligner_script(int argc, char *argv[])
         out = fopen(name,"w");
       }
 
-    njobs = 0;
-    for (i = fblock; i <= lblock; i++)
-      njobs += (i-1)/BUNIT+1;
-
     fprintf(out,"# Daligner jobs (%d)\n",njobs);
 
 #ifdef HPC
     jobid = 1;
 #endif
     for (i = fblock; i <= lblock; i++)
-      { int bits;
-        int low, hgh;
+      { int low, hgh;
 
-        bits = (i-1)/BUNIT+1;
-        low  = 1;
-        for (j = 1; j <= bits; j++)
-          {
+        for (j = 1; j <= rbits[i]; j++)
+          { low = rcut[i][j-1];
+            hgh = rcut[i][j];
+
+            if (DAG)
+              fprintf(out,"align.%d.%d:%s\n\t",i,j,(DON && lblock > 1)?" mkdir":"");
 #ifdef LSF
             fprintf(out,HPC_ALIGN,NTHREADS,jobid++);
+            if (DAG)
+              fputs(HPC_WAIT,out);
             fprintf(out," \"");
 #endif
 #ifdef SLURM
@@ -285,7 +728,6 @@ void daligner_script(int argc, char *argv[])
                 fprintf(out," %s/%s",pwd,root);
               else
                 fprintf(out," %s",root);
-            hgh = (i*j)/bits + 1;
 
             if (useblock)
               if (usepath)
@@ -326,8 +768,9 @@ void daligner_script(int argc, char *argv[])
 #ifdef HPC
             fprintf(out,"\"");
 #endif
+            if (weight != NULL)
+              fprintf(out,"   # cost %.1f",job_cost(weight[i],weight,low,hgh,i));
             fprintf(out,"\n");
-            low = hgh;
           }
       }
 
@@ -345,9 +788,15 @@ void daligner_script(int argc, char *argv[])
     jobid = 1;
 #endif
     for (i = 1; i <= lblock; i++)
-      {
+      { if (DAG)
+          { fprintf(out,"check.%d:",i);
+            print_deps(out,i,fblock,lblock,rcut,rbits);
+            fprintf(out,"\n\t");
+          }
 #ifdef HPC
         fprintf(out,HPC_CHECK,jobid++);
+        if (DAG)
+          fputs(HPC_WAIT,out);
         fprintf(out," \"");
 #endif
         fprintf(out,"LAcheck -v%sS",CON?"a":"");
@@ -404,11 +853,26 @@ void daligner_script(int argc, char *argv[])
         jobid = 1;
 #endif
         for (j = 1; j < fblock; j++)
-          {
+          { if (DAG)
+              { fprintf(out,"merge.%d:",j);
+                print_deps(out,j,fblock,lblock,rcut,rbits);
+                fprintf(out,"\n\t");
+              }
 #ifdef HPC
             fprintf(out,HPC_MERGE,jobid++);
+            if (DAG)
+              fputs(HPC_WAIT,out);
             fprintf(out," \"");
 #endif
+
+            //  The original is set aside as _R.j.las and removed only once the merge is
+            //    checked, so if it is already there a previous merge was interrupted and
+            //    R.j.las is partial:  merge from the set aside original again
+
+            if (DON)
+              fprintf(out,"test -e work%d/_%s.%d.las || ",j,root,j);
+            else
+              fprintf(out,"test -e _%s.%d.las || ",root,j);
             if (DON)
               { if (usepath)
                   fprintf(out,"mv %s/%s.%d.las work%d/_%s.%d.las && ",
@@ -456,9 +920,15 @@ void daligner_script(int argc, char *argv[])
         //  New block merges
 
         for (j = fblock; j <= lblock; j++) 
-          {
+          { if (DAG)
+              { fprintf(out,"merge.%d:",j);
+                print_deps(out,j,fblock,lblock,rcut,rbits);
+                fprintf(out,"\n\t");
+              }
 #ifdef HPC
             fprintf(out,HPC_MERGE,jobid++);
+            if (DAG)
+              fputs(HPC_WAIT,out);
             fprintf(out," \"");
 #endif
             fprintf(out,"LAmerge");
@@ -484,6 +954,20 @@ void daligner_script(int argc, char *argv[])
             fprintf(out,"\n");
           }
 
+        //  If incremental, record the provenance of the merged .las files once they are all done
+
+        if (INCR)
+          { fprintf(out,"# Record parameters and blocks of the merged .las files\n");
+            if (DAG)
+              { fprintf(out,"provenance:");
+                for (j = 1; j <= lblock; j++)
+                  fprintf(out," merge.%d",j);
+                fprintf(out,"\n\t");
+              }
+            print_provenance(out,pwd,root,usepath,stub,lblock);
+            fprintf(out,"\n");
+          }
+
         //  Cleanup (optional)
 
         if (ONAME != NULL)
@@ -494,7 +978,9 @@ void daligner_script(int argc, char *argv[])
         fprintf(out,"# Remove block .las files (optional)\n");
 
         for (i = 1; i <= lblock; i++)
-          { if (DON)
+          { if (DAG)
+              fprintf(out,"rm.%d: check.%d merge.%d\n\t",i,i,i);
+            if (DON)
               fprintf(out,"cd work%d; ",i);
             fprintf(out,"rm %s.%d.%s.*.las",root,i,root);
             if (DON)
@@ -505,8 +991,16 @@ void daligner_script(int argc, char *argv[])
         if (ONAME != NULL)
           fclose(out);
       }
+
+    for (i = lblock; i >= fblock; i--)
+      free(rcut[i]);
+    free(rcut);
+    free(rbits);
+    free(weight);
   }
 
+  if (stub != NULL)
+    Free_DB_Stub(stub);
   free(root);
   free(pwd);
 }
@@ -548,6 +1042,7 @@ void mapper_script(int argc, char *argv[])
   int   useblock1, useblock2;
   int   usepath1, usepath2;
   int   fblock, lblock;
+  int   resume;
 #ifdef HPC
   int   jobid;
 #endif
@@ -677,7 +1172,18 @@ void mapper_script(int argc, char *argv[])
     if (src2 == NULL)
       exit (1);
 
-    if (fblock > 1)
+    //  If executing, the journal is <reads>.<ref>.journal and a run is being resumed if it exists
+
+    resume = 0;
+    if (EXEC)
+      { JOURNAL = Malloc(strlen(src2)+strlen(root1)+10,"Allocating journal name");
+        if (JOURNAL == NULL)
+          exit (1);
+        sprintf(JOURNAL,"%s.%s.journal",src2,root1);
+        resume = (access(JOURNAL,F_OK) == 0);
+      }
+
+    if (fblock > 1 && ! resume)
       { file = fopen(Catenate(src2,".",root1,Numbered_Suffix(".",fblock-1,".las")),"r");
         if (file == NULL)
           { fprintf(stderr,"%s: File %s.%d.%s.las should already be present!\n",
@@ -687,7 +1193,9 @@ void mapper_script(int argc, char *argv[])
         else
           fclose(file);
       }
-    if (useblock2)
+    if (resume)
+      ;
+    else if (useblock2)
       { file = fopen(Catenate(src2,".",root1,Numbered_Suffix(".",fblock,".las")),"r");
         if (file != NULL)
           { fprintf(stderr,"%s: File %s.%d.%s.las should not yet exist!\n",
@@ -707,11 +1215,82 @@ void mapper_script(int argc, char *argv[])
     free(src2);
 
     DON = (DON && (nblocks1 > 1));
-    out = stdout;
+    out = SCRIPT;
   }
 
-  { int njobs;
-    int i, j, k;
+  //  If executing, predict daligner's memory from the largest blocks (unless -M is smaller)
+
+  if (EXEC)
+    { double *size, max1, max2;
+      int     i;
+
+      size = block_weights(pwd1,root1,nblocks1,0);
+      max1 = 0.;
+      for (i = 1; i <= nblocks1; i++)
+        if (size[i] > max1)
+          max1 = size[i];
+      free(size);
+      size = block_weights(pwd2,root2,nblocks2,0);
+      max2 = 0.;
+      for (i = 1; i <= nblocks2; i++)
+        if (size[i] > max2)
+          max2 = size[i];
+      free(size);
+      DAL_MEM = (DAL_BYTES * (max1+max2)) / 1.e3;
+      if (MINT > 0 && MINT < DAL_MEM)
+        DAL_MEM = MINT;
+    }
+
+  { int     njobs;
+    int     i, j, k;
+    double *weight1, *weight2, avg;
+    int   **rcut, *rbits;
+
+    //  Get the block weights if bundling by cost, and the average cost of a job when
+    //    there are as many jobs as there would be with -B blocks per job
+
+    rbits = (int *) Malloc(sizeof(int)*(lblock+1),"Allocating job cuts");
+    rcut  = (int **) Malloc(sizeof(int *)*(lblock+1),"Allocating job cuts");
+    if (rbits == NULL || rcut == NULL)
+      exit (1);
+    for (i = fblock; i <= lblock; i++)
+      { rcut[i] = (int *) Malloc(sizeof(int)*(nblocks1+2),"Allocating job cuts");
+        if (rcut[i] == NULL)
+          exit (1);
+      }
+
+    weight1 = weight2 = NULL;
+    avg     = 0.;
+    if (COST && useblock1 && useblock2)
+      { weight1 = block_weights(pwd1,root1,nblocks1,REPS);
+        weight2 = block_weights(pwd2,root2,nblocks2,REPS);
+        for (i = fblock; i <= lblock; i++)
+          avg += job_cost(weight2[i],weight1,1,nblocks1+1,0);
+        avg /= (lblock-fblock+1) * ((nblocks1-1)/BUNIT+1);
+      }
+
+    //  Cut each row of block comparisons into the jobs that perform them
+
+    njobs = 0;
+    for (i = fblock; i <= lblock; i++)
+      { rbits[i] = row_cuts(weight2?weight2[i]:0.,weight1,nblocks1,0,(nblocks1-1)/BUNIT+1,avg,
+                            rcut[i]);
+        njobs   += rbits[i];
+      }
+
+    //  If a DAG, the default target is the checks, merges, and removals of every block
+
+    if (DAG)
+      { fprintf(out,"# Comparison DAG, each job runs as soon as the jobs it depends on are done\n");
+        fprintf(out,"all:");
+        for (i = fblock; i <= lblock; i++)
+          fprintf(out," check.%d",i);
+        if (nblocks1 > 1)
+          for (i = fblock; i <= lblock; i++)
+            fprintf(out," merge.%d rm.%d",i,i);
+        fprintf(out,"\n");
+        print_phony(out,(DON && nblocks1 > 1)?" mkdir":"",fblock,lblock,fblock,nblocks1 > 1,rbits);
+      }
 
     //  Create all work subdirectories if DON
 
@@ -722,8 +1301,15 @@ void mapper_script(int argc, char *argv[])
           }
 
         fprintf(out,"# Create work subdirectories\n");
-        for (i = fblock; i <= lblock; i++)
-          fprintf(out,"mkdir -p work%d\n",i);
+        if (DAG)
+          { fprintf(out,"mkdir:\n\tmkdir -p");
+            for (i = fblock; i <= lblock; i++)
+              fprintf(out," work%d",i);
+            fprintf(out,"\n");
+          }
+        else
+          for (i = fblock; i <= lblock; i++)
+            fprintf(out,"mkdir -p work%d\n",i);
 
         if (ONAME != NULL)
           fclose(out);
@@ -736,23 +1322,24 @@ void mapper_script(int argc, char *argv[])
         out = fopen(name,"w");
       }
 
-    njobs = nblocks1 * ( (lblock-fblock)/BUNIT + 1);
-
     fprintf(out,"# Daligner jobs (%d)\n",njobs);
 
 #ifdef HPC
     jobid = 1;
 #endif
     for (i = fblock; i <= lblock; i++)
-      { int bits;
-        int low, hgh;
+      { int low, hgh;
+
+        for (j = 1; j <= rbits[i]; j++)
+          { low = rcut[i][j-1];
+            hgh = rcut[i][j];
 
-        bits = (nblocks1-1)/BUNIT+1;
-        low  = 1;
-        for (j = 1; j <= bits; j++)
-          {
+            if (DAG)
+              fprintf(out,"align.%d.%d:%s\n\t",i,j,(DON && nblocks1 > 1)?" mkdir":"");
 #ifdef LSF
             fprintf(out,HPC_MALIGN,NTHREADS,jobid++);
+            if (DAG)
+              fputs(HPC_WAIT,out);
 #endif
 #ifdef SLURM
             if (MINT >= 0)
@@ -802,7 +1389,6 @@ void mapper_script(int argc, char *argv[])
             if (useblock2)
               fprintf(out,".%d",i);
 
-	    hgh = 1 + (nblocks1*j)/bits;
             for (k = low; k < hgh; k++)
               { fprintf(out," ");
                 if (usepath1)
@@ -833,8 +1419,9 @@ void mapper_script(int argc, char *argv[])
 #ifdef HPC
             fprintf(out,"\"");
 #endif
+            if (weight1 != NULL)
+              fprintf(out,"   # cost %.1f",job_cost(weight2[i],weight1,low,hgh,0));
             fprintf(out,"\n");
-            low = hgh;
           }
       }
 
@@ -853,9 +1440,15 @@ void mapper_script(int argc, char *argv[])
     jobid = 1;
 #endif
     for (j = fblock; j <= lblock; j++)
-      {
+      { if (DAG)
+          { fprintf(out,"check.%d:",j);
+            print_deps(out,j,j,j,rcut,rbits);
+            fprintf(out,"\n\t");
+          }
 #ifdef HPC
         fprintf(out,HPC_MCHECK,jobid++);
+        if (DAG)
+          fputs(HPC_WAIT,out);
         fprintf(out," \"");
 #endif
         fprintf(out,"LAcheck -v%sS",CON?"a":"");
@@ -907,9 +1500,15 @@ void mapper_script(int argc, char *argv[])
         jobid = 1;
 #endif
         for (j = fblock; j <= lblock; j++) 
-          {
+          { if (DAG)
+              { fprintf(out,"merge.%d:",j);
+                print_deps(out,j,j,j,rcut,rbits);
+                fprintf(out,"\n\t");
+              }
 #ifdef HPC
             fprintf(out,HPC_MMERGE,jobid++);
+            if (DAG)
+              fputs(HPC_WAIT,out);
             fprintf(out," \"");
 #endif
             fprintf(out,"LAmerge ");
@@ -949,7 +1548,9 @@ void mapper_script(int argc, char *argv[])
         fprintf(out,"# Remove temporary .las files\n");
 
         for (j = fblock; j <= lblock; j++) 
-          { if (DON)
+          { if (DAG)
+              fprintf(out,"rm.%d: check.%d merge.%d\n\t",j,j,j);
+            if (DON)
               fprintf(out,"cd work%d; ",j);
             fprintf(out,"rm %s",root2);
             if (useblock2)
@@ -963,14 +1564,391 @@ void mapper_script(int argc, char *argv[])
         if (ONAME != NULL)
           fclose(out);
       }
+
+    for (i = lblock; i >= fblock; i--)
+      free(rcut[i]);
+    free(rcut);
+    free(rbits);
+    free(weight2);
+    free(weight1);
   }
 
   free(root2);
   free(pwd2);
   free(root1);
   free(pwd1);
+}
 
-  exit (0);
+/*********************************************************************************************\
+ *
+ *  Execute the DAG produced by one of the routines above on the local machine (-x).  A job
+ *    is started as soon as every job it depends on is done, subject to the limit on jobs
+ *    and to its cores and predicted memory fitting in what the machine has.  Only the jobs
+ *    the first target depends on are run, so the optional removal of the block .las files
+ *    of an overlap script (target clean) is not.  Each command that completes is appended
+ *    to a journal, and commands already in the journal are skipped, so that an interrupted
+ *    run resumes where it left off.  The journal starts with a hash of the script, so it is
+ *    only used by a run of the same script, and it is removed once a run succeeds.
+ *
+ *********************************************************************************************/
+
+#define UNNEEDED  0   //  Job states
+#define WAITING   1
+#define RUNNING   2
+#define FINISHED  3
+
+typedef struct
+  { char  *name;     //  Target name
+    char  *cmd;      //  Shell command (NULL if none)
+    char  *list;     //  Names of the targets it depends on (separated by blanks)
+    int    ndep;     //  # of targets it depends on
+    int   *dep;      //  Their indices
+    int    wait;     //  dep[0..wait-1] are known to be finished
+    int    state;    //  One of the states above
+    int    cores;    //  # of cores it uses
+    double mem;      //  Predicted memory use in GB
+    pid_t  pid;      //  Process running it (if > 0)
+  } Job;
+
+static int STRCMP(const void *x, const void *y)
+{ return (strcmp(*((char **) x),*((char **) y))); }
+
+static int NAMECMP(const void *x, const void *y)
+{ return (strcmp((*((Job **) x))->name,(*((Job **) y))->name)); }
+
+  //  FNV-1a hash of the script text
+
+static uint64 script_hash(char *text)
+{ uint64 h;
+
+  h = 0xcbf29ce484222325llu;
+  for ( ; *text != '\0'; text++)
+    h = (h ^ (uint8) *text) * 0x100000001b3llu;
+  return (h);
+}
+
+  //  Read the journal lines after its header into a sorted array, setting *nlines.  If the
+  //    journal exists but its header is not that of a script with the given hash then it is
+  //    of another run and is not to be used.
+
+static char **read_journal(char *journal, uint64 hash, int *nlines)
+{ FILE  *file;
+  char **line;
+  int    n, nmax, len;
+  char   buffer[10001];
+  char   header[100];
+
+  n     = 0;
+  nmax  = 1000;
+  line  = (char **) Malloc(sizeof(char *)*nmax,"Allocating journal");
+  if (line == NULL)
+    exit (1);
+  file = fopen(journal,"r");
+  if (file != NULL && fgets(buffer,10000,file) != NULL)
+    { sprintf(header,"# HPC.daligner script %016llx\n",hash);
+      if (strcmp(buffer,header) != 0)
+        { fprintf(stderr,"%s: Journal %s is from a different command or parameters,",
+                         Prog_Name,journal);
+          fprintf(stderr," remove it to start afresh\n");
+          exit (1);
+        }
+      while (fgets(buffer,10000,file) != NULL)
+        { len = strlen(buffer);
+          if (len > 0 && buffer[len-1] == '\n')
+            buffer[len-1] = '\0';
+          if (n >= nmax)
+            { nmax = 1.2*n + 1000;
+              line = (char **) Realloc(line,sizeof(char *)*nmax,"Allocating journal");
+              if (line == NULL)
+                exit (1);
+            }
+          line[n] = Strdup(buffer,"Allocating journal");
+          if (line[n++] == NULL)
+            exit (1);
+        }
+    }
+  if (file != NULL)
+    fclose(file);
+  qsort(line,n,sizeof(char *),STRCMP);
+  *nlines = n;
+  return (line);
+}
+
+  //  Return the cores and memory (in GB) needed to run cmd
+
+static void job_needs(Job *job)
+{ char *cmd = job->cmd;
+
+  while (isspace(*cmd))
+    cmd += 1;
+  if (strncmp(cmd,"daligner",8) == 0)
+    { job->cores = NTHREADS;
+      job->mem   = DAL_MEM;
+    }
+  else if (strstr(cmd,"LAmerge") != NULL)
+    { job->cores = 1;
+      job->mem   = MERGE_MEM;
+    }
+  else if (strstr(cmd,"LA") != NULL)
+    { job->cores = 1;
+      job->mem   = OTHER_MEM;
+    }
+  else
+    { job->cores = 1;
+      job->mem   = 0.;
+    }
+}
+
+  //  Parse the targets, "name: deps" lines each followed by a tab-indented command, of the
+  //    DAG in text (modifying it) and resolve their dependencies, setting *njobs
+
+static Job *parse_dag(char *text, int *njobs)
+{ Job   *job, **sort, key, *keyp;
+  int    njob, jmax;
+  char  *s, *e, *c;
+  int    i, k;
+
+  njob = 0;
+  jmax = 100;
+  job  = (Job *) Malloc(sizeof(Job)*jmax,"Allocating job list");
+  if (job == NULL)
+    exit (1);
+
+  for (s = text; *s != '\0'; s = e)
+    { e = index(s,'\n');
+      if (e != NULL)
+        *e++ = '\0';
+      else
+        e = s + strlen(s);
+      if (*s == '\t')
+        { if (njob > 0)
+            job[njob-1].cmd = s+1;
+          continue;
+        }
+      if (*s == '#' || *s == '.' || (c = index(s,':')) == NULL)   //  Skip special targets
+        continue;
+      *c = '\0';
+
+      if (njob >= jmax)
+        { jmax = 1.2*njob + 100;
+          job  = (Job *) Realloc(job,sizeof(Job)*jmax,"Allocating job list");
+          if (job == NULL)
+            exit (1);
+        }
+      job[njob].name  = s;
+      job[njob].cmd   = NULL;
+      job[njob].list  = c+1;
+      job[njob].ndep  = 0;
+      job[njob].dep   = NULL;
+      job[njob].wait  = 0;
+      job[njob].state = UNNEEDED;
+      job[njob].pid   = 0;
+      njob += 1;
+    }
+
+  sort = (Job **) Malloc(sizeof(Job *)*(njob+1),"Allocating job list");
+  if (sort == NULL)
+    exit (1);
+  for (i = 0; i < njob; i++)
+    sort[i] = job+i;
+  qsort(sort,njob,sizeof(Job *),NAMECMP);
+
+  keyp = &key;
+  for (i = 0; i < njob; i++)
+    { k = 0;
+      for (s = job[i].list; *s != '\0'; s++)
+        if (! isspace(*s) && (s == job[i].list || isspace(s[-1])))
+          k += 1;
+      job[i].dep = (int *) Malloc(sizeof(int)*(k+1),"Allocating job list");
+      if (job[i].dep == NULL)
+        exit (1);
+
+      for (s = job[i].list; *s != '\0'; s = e)
+        { while (isspace(*s))
+            s += 1;
+          if (*s == '\0')
+            break;
+          for (e = s; *e != '\0' && ! isspace(*e); e++)
+            ;
+          if (*e != '\0')
+            *e++ = '\0';
+          key.name = s;
+          c = (char *) bsearch(&keyp,sort,njob,sizeof(Job *),NAMECMP);
+          if (c == NULL)
+            { fprintf(stderr,"%s: Target %s of %s is not defined\n",Prog_Name,s,job[i].name);
+              exit (1);
+            }
+          job[i].dep[job[i].ndep++] = *((Job **) c) - job;
+        }
+      if (job[i].cmd != NULL)
+        job_needs(job+i);
+      else
+        { job[i].cores = 0;
+          job[i].mem   = 0.;
+        }
+    }
+
+  free(sort);
+
+  *njobs = njob;
+  return (job);
+}
+
+static void execute_script(char *text, char *journal)
+{ char  **done;
+  int     ndone;
+  FILE   *jfile;
+  Job    *job;
+  int     njob;
+  int    *stack;
+  int     ncores;
+  double  physmem;
+  int     failed, nrun, ucores;
+  double  umem;
+  uint64  hash;
+  int     i, k, top;
+
+  ncores  = sysconf(_SC_NPROCESSORS_ONLN);
+  physmem = ((double) sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) / 1.e9;
+  if (ncores < 1)
+    ncores = 1;
+
+  hash = script_hash(text);
+  job  = parse_dag(text,&njob);
+  if (njob == 0)
+    return;
+
+  //  The jobs needed are those the first target depends on, less those already in the journal
+
+  stack = (int *) Malloc(sizeof(int)*njob,"Allocating job list");
+  if (stack == NULL)
+    exit (1);
+  job[0].state = WAITING;
+  stack[0] = 0;
+  top = 1;
+  while (top > 0)
+    { i = stack[--top];
+      for (k = 0; k < job[i].ndep; k++)
+        if (job[job[i].dep[k]].state == UNNEEDED)
+          { job[job[i].dep[k]].state = WAITING;
+            stack[top++] = job[i].dep[k];
+          }
+    }
+  free(stack);
+
+  done  = read_journal(journal,hash,&ndone);
+  for (i = 0; i < njob; i++)
+    if (job[i].state == WAITING && job[i].cmd != NULL
+                                && bsearch(&(job[i].cmd),done,ndone,sizeof(char *),STRCMP) != NULL)
+      job[i].state = FINISHED;
+
+  jfile = Fopen(journal,"a");
+  if (jfile == NULL)
+    exit (1);
+  fseeko(jfile,0,SEEK_END);
+  if (ftello(jfile) == 0)
+    { fprintf(jfile,"# HPC.daligner script %016llx\n",hash);
+      fflush(jfile);
+    }
+
+  //  Repeatedly start every job whose dependencies are finished as long as it fits (a job is
+  //    always started if nothing is running), and then wait for a job to finish.  Jobs are
+  //    considered last to first so that checks and merges go ahead of the daligner jobs, and
+  //    the daligner jobs of the last rows, that alone produce the files of the last blocks,
+  //    go first.
+
+  failed = 0;
+  nrun   = 0;
+  ucores = 0;
+  umem   = 0.;
+  while (1)
+    { for (i = njob-1; i >= 0 && ! failed; i--)
+        { if (job[i].state != WAITING)
+            continue;
+          while (job[i].wait < job[i].ndep && job[job[i].dep[job[i].wait]].state == FINISHED)
+            job[i].wait += 1;
+          if (job[i].wait < job[i].ndep)
+            continue;
+          if (job[i].cmd == NULL)
+            { job[i].state = FINISHED;
+              i = njob;
+              continue;
+            }
+          if (nrun > 0 && (nrun >= EXEC || ucores + job[i].cores > ncores
+                                        || umem + job[i].mem > physmem))
+            continue;
+
+          if (VON)
+            { printf("%s\n",job[i].cmd);
+              fflush(stdout);
+            }
+          job[i].pid = fork();
+          if (job[i].pid < 0)
+            { fprintf(stderr,"%s: Cannot fork a job\n",Prog_Name);
+              failed = 1;
+              break;
+            }
+          if (job[i].pid == 0)
+            { execl("/bin/sh","sh","-c",job[i].cmd,(char *) NULL);
+              _exit (127);
+            }
+          job[i].state = RUNNING;
+          nrun   += 1;
+          ucores += job[i].cores;
+          umem   += job[i].mem;
+        }
+
+      if (nrun == 0)
+        break;
+
+      { pid_t pid;
+        int   status;
+
+        pid = wait(&status);
+        if (pid < 0)
+          { fprintf(stderr,"%s: Lost track of running jobs\n",Prog_Name);
+            exit (1);
+          }
+        for (k = 0; k < njob; k++)
+          if (job[k].state == RUNNING && job[k].pid == pid)
+            break;
+        if (k >= njob)
+          continue;
+        job[k].pid = 0;
+        nrun   -= 1;
+        ucores -= job[k].cores;
+        umem   -= job[k].mem;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+          { job[k].state = FINISHED;
+            fprintf(jfile,"%s\n",job[k].cmd);
+            fflush(jfile);
+          }
+        else
+          { job[k].state = WAITING;
+            fprintf(stderr,"%s: Command failed:\n      %s\n",Prog_Name,job[k].cmd);
+            failed = 1;
+          }
+      }
+    }
+
+  if ( ! failed && job[0].state != FINISHED)
+    { fprintf(stderr,"%s: Jobs of the DAG depend on each other in a cycle\n",Prog_Name);
+      failed = 1;
+    }
+
+  fclose(jfile);
+  for (i = 0; i < ndone; i++)
+    free(done[i]);
+  free(done);
+  for (i = 0; i < njob; i++)
+    free(job[i].dep);
+  free(job);
+
+  if (failed)
+    { fprintf(stderr,"%s: Stopped, rerun the same command to resume\n",Prog_Name);
+      exit (1);
+    }
+  unlink(journal);
 }
 
 int main(int argc, char *argv[])
@@ -1003,6 +1981,7 @@ int main(int argc, char *argv[])
   if (MASK == NULL)
     exit (1);
   ONAME = NULL;
+  EXEC  = 0;
 
   NTHREADS = 4;
 
@@ -1011,7 +1990,7 @@ int main(int argc, char *argv[])
     if (argv[i][0] == '-')
       switch (argv[i][1])
       { default:
-          ARG_FLAGS("vadAI");
+          ARG_FLAGS("vadiAICRD");
           break;
         case 'e':
           ARG_REAL(EREL)
@@ -1069,6 +2048,9 @@ int main(int argc, char *argv[])
         case 'T':
           ARG_POSITIVE(NTHREADS,"Number of threads")
           break;
+        case 'x':
+          ARG_POSITIVE(EXEC,"Number of concurrent jobs")
+          break;
         case '%':
           ARG_POSITIVE(PINT,"Modimer percentage")
           break;
@@ -1080,6 +2062,10 @@ int main(int argc, char *argv[])
   VON = flags['v'];
   CON = flags['a'];
   DON = flags['d'];
+  REPS = flags['R'];
+  COST = flags['C'] || REPS;
+  DAG  = flags['D'] || EXEC;
+  INCR = flags['i'];
 
   if (argc < 2 || argc > 4)
     { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -1111,7 +2097,22 @@ int main(int argc, char *argv[])
       fprintf(stderr,"      -a: Instruct LAsort & LAmerge to sort only on (a,ab).\n");
       fprintf(stderr,"      -d: Put .las files for each target block in a sub-directory\n");
       fprintf(stderr,"      -B: # of block compares per daligner job\n");
+      fprintf(stderr,"      -C: Bundle compares into jobs of about equal predicted cost,");
+      fprintf(stderr," as many as -B gives\n");
+      fprintf(stderr,"      -R: Also sample k-mers to predict the cost of repetitive blocks\n");
       fprintf(stderr,"      -f: Place script bundles in separate files with prefix <name>\n");
+      fprintf(stderr,"      -D: Write a Makefile giving the jobs and their dependencies\n");
+      fprintf(stderr,"      -i: Compare only the blocks added since the previous -i run\n");
+      fprintf(stderr,"      -x: Execute the script locally, running up to -x jobs at a time\n");
+      exit (1);
+    }
+
+  if (EXEC && ONAME != NULL)
+    { fprintf(stderr,"%s: Cannot both execute (-x) and write script files (-f)\n",Prog_Name);
+      exit (1);
+    }
+  if (DAG && ONAME != NULL)
+    { fprintf(stderr,"%s: Cannot both write a Makefile (-D) and script files (-f)\n",Prog_Name);
       exit (1);
     }
 
@@ -1128,7 +2129,11 @@ int main(int argc, char *argv[])
     }
 
   if (mapper)
-    { if (HGAP > 0)
+    { if (INCR)
+        { fprintf(stderr,"%s: The -i option applies only to an overlap script\n",Prog_Name);
+          exit (1);
+        }
+      if (HGAP > 0)
         { fprintf(stderr,"%s: Cannot use -H option in a comparison script\n",Prog_Name);
           exit (1);
         }
@@ -1150,10 +2155,36 @@ int main(int argc, char *argv[])
         PINT = 28;
     }
 
-  if (mapper)
-    mapper_script(argc,argv);
+  //  Write the script or DAG to the standard output, or if executing, write the DAG to memory
+  //    and then run it
+
+  if (EXEC)
+    { char  *text;
+      size_t tlen;
+
+      SCRIPT = open_memstream(&text,&tlen);
+      if (SCRIPT == NULL)
+        { fprintf(stderr,"%s: Cannot allocate script buffer\n",Prog_Name);
+          exit (1);
+        }
+      if (mapper)
+        mapper_script(argc,argv);
+      else
+        daligner_script(argc,argv);
+      fclose(SCRIPT);
+
+      execute_script(text,JOURNAL);
+
+      free(text);
+      free(JOURNAL);
+    }
   else
-    daligner_script(argc,argv);
+    { SCRIPT = stdout;
+      if (mapper)
+        mapper_script(argc,argv);
+      else
+        daligner_script(argc,argv);
+    }
 
   exit (0);
 }
@@ -17,13 +17,16 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
 #include "ONElib.h"
 
+#define IBUFFER  64    //  How many megabytes for each of the two input buffers
+
 static char *Usage =
-    "[-cto] <src1:db|dam> [<src2:db|dam>] <align:las> [<reads:FILE> | <reads:range> ...]";
+    "[-cto] [-T<int(1)>] <src1:db|dam> [<src2:db|dam>] <align:las> [<reads:FILE> | <reads:range> ...]";
 
 static char *One_Schema =
   "P 3 dal                  This is a 1-code las file from daligner\n"
@@ -40,19 +43,39 @@ static char *One_Schema =
   "D T 1 8 INT_LIST              Trace segment length\n"
   "D Q 1 8 INT_LIST              Trace segment diffs\n";
 
-static Overlap   *ovls;
-static uint16    *trace;
-static int64     *list;
-static char      *string;
-static OneFile   *file1;
 static DAZZ_READ *read1, *read2;
+static int       *pts;
+static int64      omax, tmax;
+static int        tbytes;
 
 static int     OVERLAP;
 static int     DOCOORDS;
 static int     DOTRACE;
 
-static void output_pile(Overlap *optr)
-{ int i, k;
+  //  The records are converted by threads, each for a range of whole piles that it writes
+  //    to its own file of the ONElib group of the output, whose files are concatenated in
+  //    order when it is closed.
+
+typedef struct
+  { FILE      *input;
+    int64      beg, end;   //  Byte range of the records of the thread
+    int64      novl;       //    and the number of them
+    int        in;         //  State of the read selection at the first record
+    int        npt;
+    int        idx;
+    OneFile   *file1;      //  File of the output group to write to
+    Overlap   *ovls;       //  Pile and line buffers
+    uint16    *trace;
+    int64     *list;
+    char      *string;
+  } Convert_Arg;
+
+static void output_pile(Convert_Arg *data, Overlap *optr)
+{ OneFile *file1  = data->file1;
+  Overlap *ovls   = data->ovls;
+  int64   *list   = data->list;
+  char    *string = data->string;
+  int i, k;
   Overlap *o;
 
   i = 0;
@@ -135,27 +158,153 @@ static int ORDER(const void *l, const void *r)
   return (x-y);
 }
 
+//  Fetch the next record from reader into *ovl and return the reader's copy (whose trace
+//    immediately follows it), exiting if the file is short.
+
+static Overlap *next_record(Las_Reader *reader, Overlap *ovl)
+{ Overlap *w;
+
+  w = Next_Las_Record(reader);
+  if (w == NULL)
+    { fprintf(stderr,"%s: .las file has fewer records than its header says\n",Prog_Name);
+      exit (1);
+    }
+  *ovl = *w;
+  return (w);
+}
+
+static void *convert_thread(void *arg)
+{ Convert_Arg *data = (Convert_Arg *) arg;
+  int64        j;
+  Overlap     *ovls, *optr, *w;
+  uint16      *trace, *tptr;
+  int          in, npt, idx, ar, last;
+  Las_Reader  *reader;
+
+  reader = Open_Las_Reader(data->input,data->beg,data->end,IBUFFER*1000000ll,tbytes);
+  if (reader == NULL)
+    exit (1);
+
+  ovls  = data->ovls;
+  trace = data->trace;
+
+  //  For each record do
+
+  in  = data->in;
+  npt = data->npt;
+  idx = data->idx;
+
+  optr = ovls;
+  tptr = trace; 
+  last = -1;
+  for (j = 0; j < data->novl; j++)
+
+     //  Read it in
+
+    { w  = next_record(reader,optr);
+      ar = optr->aread+1;
+
+      if (in)
+
+        { if (ar == last)
+            { optr->path.trace = (void *) tptr;
+              memcpy(tptr,(void *) (w+1),optr->path.tlen*tbytes);
+              if (tbytes == 1)
+                Decompress_TraceTo16(optr);
+              tptr += sizeof(uint16)*optr->path.tlen;
+              optr += 1;
+            }
+
+          else
+            { if (optr > ovls)
+                output_pile(data,optr);
+
+              while (ar > npt)
+                { npt = pts[idx++];
+                  if (ar < npt)
+                    { in = 0;
+                      break;
+                    }
+                  npt = pts[idx++];
+                }
+
+              if (in)
+                { ovls[0] = *optr++;
+                  tptr    = trace;
+                  optr    = ovls;
+                  last    = ar;
+
+                  optr->path.trace = (void *) tptr;
+                  memcpy(tptr,(void *) (w+1),optr->path.tlen*tbytes);
+                  if (tbytes == 1)
+                    Decompress_TraceTo16(optr);
+                  tptr += sizeof(uint16)*optr->path.tlen;
+                  optr += 1;
+                }
+              else
+                { optr = ovls;
+                  tptr = trace;
+                }
+            }
+        }
+
+      else
+        { while (ar >= npt)
+            { npt = pts[idx++];
+              if (ar <= npt)
+                { in = 1;
+                  break;
+                }
+              npt = pts[idx++];
+            }
+
+          if (in)
+            { last = ar;
+
+              optr->path.trace = (void *) tptr;
+              memcpy(tptr,(void *) (w+1),optr->path.tlen*tbytes);
+              if (tbytes == 1)
+                Decompress_TraceTo16(optr);
+              tptr += sizeof(uint16)*optr->path.tlen;
+              optr += 1;
+            }
+        }
+    }
+
+  if (in && optr > ovls)
+    output_pile(data,optr);
+
+  Close_Las_Reader(reader);
+  return (NULL);
+}
+
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1, *db1 = &_db1; 
   DAZZ_DB   _db2, *db2 = &_db2; 
   OneSchema *schema;
+  OneFile   *file1;
   char      *command;
 
   FILE   *input;
-  int64   novl, omax, tmax;
-  int     tspace, tbytes;
-  int     reps, *pts;
+  int64   novl, fsize;
+  int     tspace;
+  int     reps;
   int     input_pts;
 
   int     ISTWO;
+  int     NTHREADS;
+  Convert_Arg *parm;
 
   //  Process options and capture command line for provenance
 
   { int    i, j, k;
     int    flags[128];
+    char  *eptr;
 
     ARG_INIT("LA2ONE")
 
+    NTHREADS = 1;
+
     { int   n, t;
       char *c;
 
@@ -183,6 +332,9 @@ int main(int argc, char *argv[])
         { default:
             ARG_FLAGS("cto")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
         }
       else
         argv[j++] = argv[i];
@@ -206,6 +358,8 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -t: Output also traces (T and Q lines)\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -o: Output proper overlaps only\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -T: Use -T threads.\n");
 
         exit (1);
       }
@@ -398,21 +552,40 @@ int main(int argc, char *argv[])
     else
       tbytes = sizeof(uint16);
 
+    { struct stat info;
+
+      if (fstat(fileno(input),&info) != 0)
+        SYSTEM_READ_ERROR
+      fsize = info.st_size;
+    }
+
+    //  The byte ranges of a blocked file do not give its record sizes, so it is not divided
+
+    if (Las_Is_Blocked(input))
+      NTHREADS = 1;
+
     free(pwd);
     free(root);
   }
 
   schema = oneSchemaCreateFromText(One_Schema);
-  file1  = oneFileOpenWriteNew("-",schema,"dal",true,1);
+  file1  = oneFileOpenWriteNew("-",schema,"dal",true,NTHREADS);
   oneAddProvenance(file1,Prog_Name,"1.0","%s >?.dal",command);
 
-  //  Scan to determine max trace length and max pile size
+  parm = (Convert_Arg *) Malloc(sizeof(Convert_Arg)*NTHREADS,"Allocating thread records");
+  if (parm == NULL)
+    exit (1);
+
+  //  Scan to determine max trace length and max pile size, and to divide the records into
+  //    NTHREADS ranges of whole piles with about the same number of records, noting the
+  //    offset of the first record of each and the state of the read selection there
 
   { int     in, npt, idx;
-    int     j, ar, al;
-    int     tlen;
-    int64   odeg;
+    int     j, ar, al, pr;
+    int     tlen, k;
+    int64   odeg, off, rbeg;
     Overlap _ovl, *ovl = &_ovl;
+    Las_Reader *reader;
 
     in  = 0;
     npt = pts[0];
@@ -423,14 +596,32 @@ int main(int argc, char *argv[])
     omax = tmax = 0;
     odeg = 0;
 
-    al = 0;
+    reader = Open_Las_Reader(input,-1,-1,IBUFFER*1000000ll,tbytes);
+    if (reader == NULL)
+      exit (1);
+
+    k   = 0;
+    pr  = -1;
+    off = sizeof(int64) + sizeof(int);
+    al  = 0;
     for (j = 0; j < novl; j++)
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
+      { next_record(reader,ovl);
         tlen = ovl->path.tlen;
-        fseeko(input,tlen*tbytes,SEEK_CUR);
+
+        rbeg = off;
+        off += (sizeof(Overlap)-sizeof(void *)) + tlen*tbytes;
+        if (k < NTHREADS && j >= (novl*k)/NTHREADS && ovl->aread != pr)
+          { parm[k].beg  = rbeg;
+            parm[k].novl = j;
+            parm[k].in   = in;
+            parm[k].npt  = npt;
+            parm[k].idx  = idx;
+            k += 1;
+          }
+        pr = ovl->aread;
 
         //  Determine if it should be displayed
 
@@ -479,28 +670,24 @@ int main(int argc, char *argv[])
       }
     if (odeg > omax)
       omax = odeg;
+
+    Close_Las_Reader(reader);
+
+    if (k == 0)
+      { parm[0].beg  = sizeof(int64) + sizeof(int);
+        parm[0].novl = 0;
+        parm[0].in   = 0;
+        parm[0].npt  = pts[0];
+        parm[0].idx  = 1;
+        k = 1;
+      }
+    NTHREADS = k;
   }
 
-  //  Read the file and display selected records
+  //  Read the file and display selected records, each thread converting a range of it
   
-  { int        j;
-    Overlap   *optr;
-    uint16    *tptr;
-    int        in, npt, idx, ar, last;
-
-    rewind(input);
-    fread(&novl,sizeof(int64),1,input);
-    fread(&tspace,sizeof(int),1,input);
-
-    ovls   = Malloc(sizeof(Overlap)*omax,"Allocating alignment array");
-    trace  = Malloc(sizeof(uint16)*omax*tmax,"Allocating trace buffer");
-    string = Malloc(sizeof(int64)*omax,"Allocating 1-string");
-    if (tmax > 2*omax)
-      list = Malloc(sizeof(int64)*tmax,"Allocating 1-list");
-    else
-      list = Malloc(sizeof(int64)*omax*2,"Allocating 1-list");
-    if (ovls == NULL || trace == NULL || string == NULL || list == NULL)
-      exit (1);
+  { int        i;
+    pthread_t  threads[NTHREADS];
 
     read1 = db1->reads;
     read2 = db2->reads;
@@ -510,98 +697,46 @@ int main(int argc, char *argv[])
         oneWriteLine(file1,'X',0,NULL);
       }
 
-    //  For each record do
-
-    in  = 0;
-    npt = pts[0];
-    idx = 1;
-
-    optr = ovls;
-    tptr = trace; 
-    last = -1;
-    for (j = 0; j < novl; j++)
-
-       //  Read it in
-
-      { Read_Overlap(input,optr);
-        ar = optr->aread+1;
+    for (i = 0; i < NTHREADS; i++)
+      { Convert_Arg *data = parm+i;
 
-        if (in)
-
-          { if (ar == last)
-              { optr->path.trace = (void *) tptr;
-                Read_Trace(input,optr,tbytes);
-                if (tbytes == 1)
-                  Decompress_TraceTo16(optr);
-                tptr += sizeof(uint16)*optr->path.tlen;
-                optr += 1;
-              }
-
-            else
-              { output_pile(optr);
-
-                while (ar > npt)
-                  { npt = pts[idx++];
-                    if (ar < npt)
-                      { in = 0;
-                        break;
-                      }
-                    npt = pts[idx++];
-                  }
-
-                if (in)
-                  { ovls[0] = *optr++;
-                    tptr    = trace;
-                    optr    = ovls;
-                    last    = ar;
-
-                    optr->path.trace = (void *) tptr;
-                    Read_Trace(input,optr,tbytes);
-                    if (tbytes == 1)
-                      Decompress_TraceTo16(optr);
-                    tptr += sizeof(uint16)*optr->path.tlen;
-                    optr += 1;
-                  }
-                else
-                  { fseeko(input,optr->path.tlen*tbytes,SEEK_CUR);
-                    optr = ovls;
-                    tptr = trace;
-                  }
-              }
+        data->input = input;
+        if (i+1 < NTHREADS)
+          { data->end  = parm[i+1].beg;
+            data->novl = parm[i+1].novl - data->novl;
           }
-
         else
-          { while (ar >= npt)
-              { npt = pts[idx++];
-                if (ar <= npt)
-                  { in = 1;
-                    break;
-                  }
-                npt = pts[idx++];
-              }
-
-            if (in)
-              { last = ar;
-
-                optr->path.trace = (void *) tptr;
-                Read_Trace(input,optr,tbytes);
-                if (tbytes == 1)
-                  Decompress_TraceTo16(optr);
-                tptr += sizeof(uint16)*optr->path.tlen;
-                optr += 1;
-              }
-            else
-              fseeko(input,optr->path.tlen*tbytes,SEEK_CUR);
+          { data->end  = fsize;
+            data->novl = novl - data->novl;
           }
+        data->file1  = file1 + i;
+        data->ovls   = Malloc(sizeof(Overlap)*omax,"Allocating alignment array");
+        data->trace  = Malloc(sizeof(uint16)*omax*tmax,"Allocating trace buffer");
+        data->string = Malloc(sizeof(int64)*omax,"Allocating 1-string");
+        if (tmax > 2*omax)
+          data->list = Malloc(sizeof(int64)*tmax,"Allocating 1-list");
+        else
+          data->list = Malloc(sizeof(int64)*omax*2,"Allocating 1-list");
+        if (data->ovls == NULL || data->trace == NULL || data->string == NULL
+                               || data->list == NULL)
+          exit (1);
       }
 
-    if (in)
-      output_pile(optr);
+    for (i = 1; i < NTHREADS; i++)
+      pthread_create(threads+i,NULL,convert_thread,parm+i);
+    convert_thread(parm);
+    for (i = 1; i < NTHREADS; i++)
+      pthread_join(threads[i],NULL);
 
-    free(string);
-    free(list);
-    free(trace);
-    free(ovls);
+    fclose(input);
+
+    for (i = 0; i < NTHREADS; i++)
+      { free(parm[i].string);
+        free(parm[i].list);
+        free(parm[i].trace);
+        free(parm[i].ovls);
+      }
+    free(parm);
   }
 
   oneFileClose(file1);
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -19,18 +20,41 @@
 #include "DB.h"
 #include "align.h"
 
-static char *Usage = "[-v] <source:las> ... > <target>.las";
+static char *Usage = "[-vz] <source:las> ... > <target>.las";
 
 #define MEMORY   1000         //  How many megabytes for output buffer
+#define IBUFFER    64         //  How many megabytes for each of the two input buffers
+
+  //  Bytes and seconds spent in copying whole files in the kernel and through oblock
+
+static int64  Kernel_Bytes, Buffer_Bytes;
+static double Kernel_Time,  Buffer_Time;
+
+static double wall_time()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (t.tv_sec + t.tv_nsec*1e-9);
+}
+
+static void report_rate(char *what, int64 bytes, double secs)
+{ fprintf(stderr,"  %s ",what);
+  Print_Number(bytes/1000000,0,stderr);
+  fprintf(stderr," MB in %.2fs",secs);
+  if (secs > 0.)
+    fprintf(stderr," (%.1f MB/s)",(bytes/1e6)/secs);
+  fprintf(stderr,"\n");
+}
 
 int main(int argc, char *argv[])
-{ char     *iblock, *oblock;
+{ char     *oblock;
   FILE     *input;
   int64     novl, bsize, ovlsize, ptrsize;
   int       tspace, tbytes;
   int       c;
 
   int       VERBOSE;
+  int       BLOCKED;
 
   //  Process options
 
@@ -42,12 +66,13 @@ int main(int argc, char *argv[])
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("v") }
+        { ARG_FLAGS("vz") }
       else
         argv[j++] = argv[i];
     argc = j;
 
     VERBOSE = flags['v'];
+    BLOCKED = flags['z'];
 
     if (argc <= 1)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
@@ -55,6 +80,9 @@ int main(int argc, char *argv[])
         fprintf(stderr,"    <source>'s may contain a template that is %c-sign optionally\n",
                         BLOCK_SYMBOL);
         fprintf(stderr,"      followed by an integer or integer range\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Report the files concatenated and the copy throughput.\n");
+        fprintf(stderr,"      -z: Write the result in the blocked (compressed) .las format.\n");
         exit (1);
       }
   }
@@ -63,10 +91,8 @@ int main(int argc, char *argv[])
   ovlsize = sizeof(Overlap) - ptrsize;
   bsize   = MEMORY * 1000000ll;
   oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
+  if (oblock == NULL)
     exit (1);
-  iblock += ptrsize;
 
   novl   = 0;
   tspace = -1;
@@ -112,19 +138,33 @@ int main(int argc, char *argv[])
   { Block_Looper *parse;
     int      c, j;
     Overlap *w;
-    int64    tsize, povl;
+    int64    span, povl, kern;
     int      mspace;
-    char    *iptr, *itop;
     char    *optr, *otop;
+    Las_Writer *writer;
 
     optr = oblock;
     otop = oblock + bsize;
 
+    if (BLOCKED)
+      { writer = Open_Las_Writer(stdout,tspace);
+        if (writer == NULL)
+          exit (1);
+      }
+    else
+      writer = NULL;
+
+    Kernel_Bytes = Buffer_Bytes = 0;
+    Kernel_Time  = Buffer_Time  = 0.;
+
     for (c = 1; c < argc; c++)
       { parse = Parse_Block_LAS_Arg(argv[c]);
 
         while ((input = Next_Block_Arg(parse)) != NULL)
-          { if (fread(&povl,sizeof(int64),1,input) != 1)
+          { Las_Reader *reader;
+            double      start;
+
+            if (fread(&povl,sizeof(int64),1,input) != 1)
               SYSTEM_READ_ERROR
             if (fread(&mspace,sizeof(int),1,input) != 1)
               SYSTEM_READ_ERROR
@@ -135,47 +175,79 @@ int main(int argc, char *argv[])
                 fflush(stderr);
               }
 
-            iptr = iblock;
-            itop = iblock + fread(iblock,1,bsize,input);
+            //  As the tspace of all files is the same, the records of a file in the raw
+            //    format are copied as is unless the output is blocked.  A file whose body
+            //    is too short to hold the povl records its header claims, or that has a body
+            //    while claiming none, is instead read record by record so that it is reported
+            //    as truncated or only its records are copied.  (Trailing bytes after povl
+            //    records cannot be detected without reading the records and are copied.)
 
-            for (j = 0; j < povl; j++)
-              { if (iptr + ovlsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                  }
+            if (writer == NULL && ! Las_Is_Blocked(input))
+              { struct stat info;
 
-                w = (Overlap *) (iptr - ptrsize);
-                tsize = w->path.tlen*tbytes;
+                if (fstat(fileno(input),&info) != 0)
+                  SYSTEM_READ_ERROR
+                span = info.st_size - (sizeof(int64)+sizeof(int));
+                if (span < povl*ovlsize || (povl == 0 && span != 0))
+                  goto by_record;
 
-                if (optr + ovlsize + tsize > otop)
+                if (optr > oblock)
                   { if (fwrite(oblock,1,optr-oblock,stdout) != (size_t) (optr-oblock))
-                      SYSTEM_READ_ERROR
+                      SYSTEM_WRITE_ERROR
                     optr = oblock;
                   }
+                fflush(stdout);
+
+                start = wall_time();
+                kern  = Copy_Bytes(fileno(input),sizeof(int64)+sizeof(int),fileno(stdout),
+                                   span,oblock,bsize);
+                if (kern == span)
+                  { Kernel_Bytes += span;
+                    Kernel_Time  += wall_time() - start;
+                  }
+                else
+                  { Buffer_Bytes += span;
+                    Buffer_Time  += wall_time() - start;
+                  }
+                fclose(input);
+                continue;
+              }
 
-                memmove(optr,iptr,ovlsize);
-                optr += ovlsize;
-                iptr += ovlsize;
-
-                if (iptr + tsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
+          by_record:
+            start  = wall_time();
+            reader = Open_Las_Reader(input,-1,-1,IBUFFER*1000000ll,tbytes);
+            if (reader == NULL)
+              exit (1);
+
+            for (j = 0; j < povl; j++)
+              { w = Next_Las_Record(reader);
+                if (w == NULL)
+                  { fprintf(stderr,"%s: %s has fewer records than its header says\n",
+                                   Prog_Name,Block_Arg_Root(parse));
+                    exit (1);
+                  }
+                span = ovlsize + w->path.tlen*tbytes;
+                Buffer_Bytes += span;
+                if (writer != NULL)
+                  { w->path.trace = (void *) (w+1);
+                    if (Write_Las_Record(writer,w))
+                      exit (1);
+                    continue;
+                  }
+
+                if (optr + span > otop)
+                  { if (fwrite(oblock,1,optr-oblock,stdout) != (size_t) (optr-oblock))
+                      SYSTEM_WRITE_ERROR
+                    optr = oblock;
                   }
 
-                memmove(optr,iptr,tsize);
-                optr += tsize;
-                iptr += tsize;
+                memmove(optr,((char *) w) + ptrsize,span);
+                optr += span;
               }
 
+            Close_Las_Reader(reader);
             fclose(input);
+            Buffer_Time += wall_time() - start;
           }
 
         Free_Block_Arg(parse);
@@ -183,17 +255,24 @@ int main(int argc, char *argv[])
 
     if (optr > oblock)
       { if (fwrite(oblock,1,optr-oblock,stdout) != (size_t) (optr-oblock))
-          SYSTEM_READ_ERROR
+          SYSTEM_WRITE_ERROR
+      }
+    if (writer != NULL)
+      { if (Close_Las_Writer(writer))
+          exit (1);
       }
   }
 
   if (VERBOSE)
     { fprintf(stderr,"  Totalling %lld la\'s\n",novl);
+      if (Kernel_Bytes > 0)
+        report_rate("Copied in kernel",Kernel_Bytes,Kernel_Time);
+      if (Buffer_Bytes > 0)
+        report_rate("Copied by buffer",Buffer_Bytes,Buffer_Time);
       fflush(stderr);
     }
 
   free(oblock);
-  free(iblock-ptrsize);
 
   exit (0);
 }
@@ -14,30 +14,365 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
 
-static char *Usage = "[-vaS] <src1:db|dam> [ <src2:db|dam> ] <align:las> ...";
+static char *Usage = "[-vaS] [-T<int(1)>] <src1:db|dam> [ <src2:db|dam> ] <align:las> ...";
+
+#define IBUFFER    64       //  How many megabytes for each of the two input buffers
+#define MIN_RANGE  0x10000  //  Minimum size of a range checked by a thread
+
+static int        VERBOSE;
+static int        MAP_ORDER;
+static int        SORTED;
+
+static DAZZ_READ *READS1, *READS2;   //  Reads and # of reads of the A- and B-DBs
+static int        NREADS1, NREADS2;
+
+static int        TSPACE;       //  Trace spacing, size of a trace element, and whether the
+static int        TBYTES;       //    LAs are chained, of the file being checked
+static int        HAS_CHAINS;
+
+  //  The basic checks of an LA ovl (whose trace is in place) of file disp.  Return 0 if it
+  //    passes, 1 if it fails with the error message in msg, or 2 if it fails the trace
+  //    point check (which reports its own message).
+
+static int check_basic(Overlap *ovl, char *disp, char *msg)
+{ if (ovl->aread < 0 || ovl->bread < 0)
+    { sprintf(msg,"  %s: Read indices < 0\n",disp);
+      return (1);
+    }
+  if (ovl->aread >= NREADS1 || ovl->bread >= NREADS2)
+    { sprintf(msg,"  %s: Read indices out of range\n",disp);
+      return (1);
+    }
+
+  if (ovl->path.abpos >= ovl->path.aepos || ovl->path.aepos > READS1[ovl->aread].rlen ||
+      ovl->path.bbpos >= ovl->path.bepos || ovl->path.bepos > READS2[ovl->bread].rlen ||
+      ovl->path.abpos < 0                || ovl->path.bbpos < 0                        )
+    { sprintf(msg,"  %s: Non-sense alignment intervals\n",disp);
+      return (1);
+    }
+
+  if (ovl->path.diffs < 0 || ovl->path.diffs > READS1[ovl->aread].rlen ||
+                             ovl->path.diffs > READS2[ovl->bread].rlen)
+    { sprintf(msg,"  %s: Non-sense number of differences\n",disp);
+      return (1);
+    }
+
+  if (Check_Trace_Points(ovl,TSPACE,0,disp))
+    return (2);
+
+  if (HAS_CHAINS)
+    { if (CHAIN_START(ovl->flags) && CHAIN_NEXT(ovl->flags))
+        { sprintf(msg,"  %s: LA has both start & next flag set\n",disp);
+          return (1);
+        }
+      if (BEST_CHAIN(ovl->flags) && CHAIN_NEXT(ovl->flags))
+        { sprintf(msg,"  %s: LA has both best & next flag set\n",disp);
+          return (1);
+        }
+    }
+  else
+    { if ((ovl->flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0)
+        { sprintf(msg,"  %s: LAs should not have chain flags\n",disp);
+          return (1);
+        }
+    }
+
+  return (0);
+}
+
+  //  Duplicate check, and sort check if -S set, of ovl given the LA before it, last, and the
+  //    start of the last chain, prev.  Return 1 with the error message in msg if it fails.
+
+static int check_order(Overlap *ovl, Overlap *last, Overlap *prev, char *disp, char *msg)
+{ int equal;
+
+  equal = 0;
+  if (SORTED)
+    { if (CHAIN_NEXT(ovl->flags))
+        { if (ovl->aread == last->aread && ovl->bread != last->bread &&
+              COMP(ovl->flags) != COMP(last->flags) &&
+              ovl->path.abpos >= last->path.abpos &&
+              ovl->path.bbpos >= last->path.bbpos)
+            goto dupcheck;
+          sprintf(msg,"  %s: Chain is not valid (%d vs %d)\n",disp,ovl->aread+1,ovl->bread+1);
+          return (1);
+        }
+      else if (!HAS_CHAINS)
+        { if (ovl->aread > last->aread) goto inorder;
+          if (ovl->aread == last->aread)
+            { if (MAP_ORDER)
+                { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                  if (ovl->path.abpos == prev->path.abpos)
+                    goto dupcheck;
+                }
+              else
+                { if (ovl->bread > last->bread) goto inorder;
+                  if (ovl->bread == last->bread)
+                    { if (COMP(ovl->flags) > COMP(last->flags)) goto inorder;
+                      if (COMP(ovl->flags) == COMP(last->flags))
+                        { if (ovl->path.abpos > last->path.abpos) goto inorder;
+                          if (ovl->path.abpos == last->path.abpos)
+                            { equal = 1;
+                              goto inorder;
+                            }
+                        }
+                    }
+                }
+            }
+          sprintf(msg,"  %s: LAs are not sorted (%d vs %d)\n",disp,ovl->aread+1,ovl->bread+1);
+          return (1);
+        }
+      else //  First element of a chain
+        { if (ovl->aread > prev->aread) goto inorder;
+          if (ovl->aread == prev->aread)
+            { if (MAP_ORDER)
+                { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                  if (ovl->path.abpos == prev->path.abpos)
+                    goto dupcheck;
+                }
+              else
+                { if (ovl->bread > prev->bread) goto inorder;
+                  if (ovl->bread == prev->bread)
+                    { if (COMP(ovl->flags) > COMP(prev->flags)) goto inorder;
+                      if (COMP(ovl->flags) == COMP(prev->flags))
+                        { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                          if (ovl->path.abpos == prev->path.abpos)
+                            { equal = 1;
+                              goto dupcheck;
+                            }
+                        }
+                    }
+                }
+            }
+          sprintf(msg,"  %s: Chains are not sorted (%d vs %d)\n",disp,ovl->aread+1,ovl->bread+1);
+          return (1);
+        }
+    }
+dupcheck:
+  if (ovl->aread == last->aread && ovl->bread == last->bread &&
+      COMP(ovl->flags) == COMP(last->flags) && ovl->path.abpos == last->path.abpos)
+    equal = 1;
+inorder:
+  if (equal)
+    { if (ovl->path.aepos == last->path.aepos &&
+          ovl->path.bbpos == last->path.bbpos &&
+          ovl->path.bepos == last->path.bepos)
+        { sprintf(msg,"  %s: Duplicate LAs (%d vs %d)\n",disp,ovl->aread+1,ovl->bread+1);
+          return (1);
+        }
+    }
+  return (0);
+}
+
+  //  Check the novl LAs in the byte range [beg,end) of a file, the first of which is the
+  //    jbeg'th LA of the file.  A range always begins at the start of a chain, so the check
+  //    of its first LA against the LAs before the range can be made after the fact with the
+  //    last and prev LAs of the preceding range.  The ordinal of the first bad LA (if any)
+  //    is set in errj and either its error message is in emsg or, if it failed the trace
+  //    point check, a copy of it is in etrace.
+
+typedef struct
+  { FILE    *input;
+    int64    beg, end;
+    int64    jbeg, novl;
+    int      final;     //  Is this the last range (check for extra data)?
+    char    *disp;
+    int64    bsize;
+    Overlap  first;     //  First LA of the range
+    Overlap  last;      //  Last LA of the range and start of its last chain
+    Overlap  prev;
+    int64    errj;
+    char     emsg[200];
+    Overlap *etrace;
+  } Check_Arg;
+
+static void *check_thread(void *arg)
+{ Check_Arg  *data = (Check_Arg *) arg;
+  char       *disp = data->disp;
+  Las_Reader *reader;
+  Overlap     ovl, *w, last, prev;
+  int64       j;
+  int         r;
+
+  reader = Open_Las_Reader(data->input,data->beg,data->end,data->bsize,TBYTES);
+  if (reader == NULL)
+    exit (1);
+
+  last.aread = -1;
+  last.bread = -1;
+  last.flags =  0;
+  last.path.bbpos = last.path.abpos = 0;
+  last.path.bepos = last.path.aepos = 0;
+  prev = last;
+
+  data->errj   = -1;
+  data->etrace = NULL;
+  for (j = 0; j < data->novl; j++)
+    { w = Next_Las_Record(reader);
+      if (w == NULL)
+        { sprintf(data->emsg,"  %s: Too few alignment records\n",disp);
+          break;
+        }
+      ovl = *w;
+      ovl.path.trace = (void *) (w+1);
+      if (j == 0)
+        data->first = ovl;
+
+      r = check_basic(&ovl,disp,data->emsg);
+      if (r == 2)
+        { int64 tsize = ovl.path.tlen*TBYTES;
+
+          data->etrace = (Overlap *) Malloc(sizeof(Overlap)+tsize,"Allocating trace copy");
+          if (data->etrace == NULL)
+            exit (1);
+          *data->etrace = ovl;
+          data->etrace->path.trace = (void *) (data->etrace+1);
+          memcpy(data->etrace+1,w+1,tsize);
+        }
+      if (r != 0 || check_order(&ovl,&last,&prev,disp,data->emsg))
+        break;
+
+      last = ovl;
+      if (CHAIN_START(ovl.flags))
+        prev = ovl;
+    }
+
+  if (j < data->novl)
+    data->errj = data->jbeg + j;
+  else if (data->final && (Next_Las_Record(reader) != NULL || Las_Reader_Residue(reader) > 0))
+    { sprintf(data->emsg,"  %s: Too many alignment records\n",disp);
+      data->errj = data->jbeg + j;
+    }
+  data->last = last;
+  data->prev = prev;
+
+  Close_Las_Reader(reader);
+  return (NULL);
+}
+
+  //  Find up to nthreads-1 places to cut the novl LAs of input (of fsize bytes) into ranges
+  //    of roughly equal size, each beginning at the start of a chain, from the pile index
+  //    of the file las if there is one, and otherwise with a quick scan of the LAs.  The
+  //    offset and ordinal of the first LA of range k are placed in beg[k] and ord[k], and
+  //    the number of ranges is returned.  A single range is returned if the file is not
+  //    evidently well formed, as it is then best checked sequentially.  The ranges of a
+  //    blocked file are cut at the blocks of its block table, each of which starts a chain.
+
+static int partition(FILE *input, char *las, int64 novl, int64 fsize, int nthreads,
+                     int64 *beg, int64 *ord)
+{ Las_Index *index;
+  int64      hsize, target, off, j;
+  int        n;
+
+  hsize  = sizeof(int64) + sizeof(int);
+  beg[0] = hsize;
+  ord[0] = 0;
+  n      = 1;
+  if ((fsize-hsize)/nthreads < MIN_RANGE)
+    return (1);
+  target = hsize + (fsize-hsize)/nthreads;
+
+  if (Las_Is_Blocked(input))
+    { index = Read_Las_Blocks(input,NULL,NULL);
+      if (index == NULL || index->novl != novl)
+        { if (index != NULL)
+            Free_Las_Index(index);
+          return (1);
+        }
+      for (j = 1; j < index->nidx && n < nthreads; j++)
+        if (index->idx[j].offset >= target)
+          { beg[n] = index->idx[j].offset;
+            ord[n] = index->idx[j].ordinal;
+            n += 1;
+            target = hsize + ((fsize-hsize)/nthreads)*n;
+          }
+      Free_Las_Index(index);
+      return (n);
+    }
+
+  index = Open_Las_Index(las);
+  if (index != NULL && index->novl == novl)
+    { Las_Index_Entry *e;
+      Overlap          ovl;
+      int              i;
+
+      for (i = 1; i < index->nidx && n < nthreads; i++)
+        { e = index->idx + i;
+          if (e->offset < target)
+            continue;
+          if (HAS_CHAINS)
+            { if (pread(fileno(input),((char *) &ovl)+sizeof(void *),
+                        sizeof(Overlap)-sizeof(void *),e->offset)
+                     != (ssize_t) (sizeof(Overlap)-sizeof(void *)))
+                break;
+              if ( ! CHAIN_START(ovl.flags))
+                continue;
+            }
+          beg[n] = e->offset;
+          ord[n] = e->ordinal;
+          n += 1;
+          target = hsize + ((fsize-hsize)/nthreads)*(n);
+        }
+      Free_Las_Index(index);
+      return (n);
+    }
+  if (index != NULL)
+    Free_Las_Index(index);
+
+  { Las_Reader *reader;
+    Overlap    *w;
+
+    if (fseeko(input,hsize,SEEK_SET) != 0)
+      return (1);
+    reader = Open_Las_Reader(input,-1,-1,IBUFFER*1000000ll,TBYTES);
+    if (reader == NULL)
+      exit (1);
+
+    off = hsize;
+    for (j = 0; j < novl; j++)
+      { w = Next_Las_Record(reader);
+        if (w == NULL)
+          break;
+        if (off >= target && n < nthreads && (HAS_CHAINS ? CHAIN_START(w->flags) : 1))
+          { beg[n] = off;
+            ord[n] = j;
+            n += 1;
+            target = hsize + ((fsize-hsize)/nthreads)*n;
+          }
+        off += (sizeof(Overlap)-sizeof(void *)) + w->path.tlen*TBYTES;
+      }
+    if (j < novl || Next_Las_Record(reader) != NULL || Las_Reader_Residue(reader) > 0)
+      n = 1;
+
+    Close_Las_Reader(reader);
+  }
+
+  return (n);
+}
 
-#define MEMORY   1000   //  How many megabytes for output buffer
 
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1,  *db1  = &_db1;
   DAZZ_DB   _db2,  *db2  = &_db2;
-  int        VERBOSE;
-  int        MAP_ORDER;
-  int        SORTED;
+  int        NTHREADS;
   int        ISTWO;
   int        status;
 
   //  Process options
 
-  { int i, j, k;
-    int flags[128];
+  { int   i, j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAcheck")
 
+    NTHREADS = 1;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
@@ -45,6 +380,9 @@ int main(int argc, char *argv[])
         { default:
             ARG_FLAGS("vaS")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
         }
       else
         argv[j++] = argv[i];
@@ -61,6 +399,7 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -S: Check that .las is in sorted order.\n");
         fprintf(stderr,"      -a: If -S, then check sorted by A-read, A-position pairs\n");
         fprintf(stderr,"          off => check sorted by A,B-read pairs (LA-piles)\n");
+        fprintf(stderr,"      -T: Check each file in -T ranges concurrently.\n");
         exit (1);
       }
   }
@@ -101,23 +440,22 @@ int main(int argc, char *argv[])
     Trim_DB(db1);
   }
 
-  { char      *iblock;
-    int64      bsize, ovlsize, ptrsize;
-    int        i, j;
-    DAZZ_READ *reads1  = db1->reads;
-    int        nreads1 = db1->nreads;
-    DAZZ_READ *reads2  = db2->reads;
-    int        nreads2 = db2->nreads;
-
-    //  Setup IO buffers
-
-    ptrsize = sizeof(void *);
-    ovlsize = sizeof(Overlap) - ptrsize;
-    bsize   = MEMORY * 1000000ll;
-    iblock  = (char *) Malloc(bsize+ptrsize,"Allocating input block");
-    if (iblock == NULL)
+  { int        i;
+    int64     *beg, *ord;
+    Check_Arg *parm;
+    pthread_t *threads;
+
+    READS1  = db1->reads;
+    NREADS1 = db1->nreads;
+    READS2  = db2->reads;
+    NREADS2 = db2->nreads;
+
+    beg     = (int64 *) Malloc(sizeof(int64)*(NTHREADS+1),"Allocating range arrays");
+    ord     = (int64 *) Malloc(sizeof(int64)*(NTHREADS+1),"Allocating range arrays");
+    parm    = (Check_Arg *) Malloc(sizeof(Check_Arg)*NTHREADS,"Allocating thread records");
+    threads = (pthread_t *) Malloc(sizeof(pthread_t)*NTHREADS,"Allocating thread records");
+    if (beg == NULL || ord == NULL || parm == NULL || threads == NULL)
       exit (1);
-    iblock += ptrsize;
 
     //  For each file do
 
@@ -126,18 +464,18 @@ int main(int argc, char *argv[])
       { Block_Looper *parse;
         FILE     *input;
         char     *disp;
-        char     *iptr, *itop;
-        Overlap   last, prev;
-        int64     novl;
+        int64     novl, fsize;
         int       tspace, tbytes;
-        int       has_chains;
+        int       n, k;
 
         //  Establish IO and (novl,tspace) header
 
         parse = Parse_Block_LAS_Arg(argv[i]);
 
         while ((input = Next_Block_Arg(parse)) != NULL)
-          { disp = Block_Arg_Root(parse);
+          { struct stat info;
+
+            disp = Block_Arg_Root(parse);
 
             if (fread(&novl,sizeof(int64),1,input) != 1)
               SYSTEM_READ_ERROR
@@ -158,212 +496,102 @@ int main(int argc, char *argv[])
               tbytes = sizeof(uint8);
             else
               tbytes = sizeof(uint16);
+            TSPACE = tspace;
+            TBYTES = tbytes;
 
-            iptr = iblock;
-            itop = iblock + fread(iblock,1,bsize,input);
-
-            //  For each record in file do
-
-            has_chains = 0;
-            last.aread = -1;
-            last.bread = -1;
-            last.flags =  0;
-            last.path.bbpos = last.path.abpos = 0;
-            last.path.bepos = last.path.aepos = 0;
-            prev = last;
-            for (j = 0; j < novl; j++)
-              { Overlap ovl;
-                int     tsize;
-                int     equal;
-
-                //  Fetch next record
-
-                if (iptr + ovlsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                    if (iptr + ovlsize > itop)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Too few alignment records\n",disp);
-                        goto error;
-                      }
-                  }
+            if (fstat(fileno(input),&info) != 0)
+              SYSTEM_READ_ERROR
+            fsize = info.st_size;
+
+            //  Whether the file has chains is determined by its first LA
+
+            HAS_CHAINS = 0;
+            if (novl > 0 && Las_Is_Blocked(input))
+              { Las_Reader *reader;
+                Overlap    *w;
+
+                reader = Open_Las_Reader(input,sizeof(int64)+sizeof(int),fsize,
+                                         LAS_BLOCK_RAW,TBYTES);
+                if (reader == NULL)
+                  exit (1);
+                if ((w = Next_Las_Record(reader)) != NULL)
+                  HAS_CHAINS = ((w->flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
+                Close_Las_Reader(reader);
+              }
+            else if (novl > 0)
+              { Overlap first;
 
-                ovl   = *((Overlap *) (iptr - ptrsize));
-                iptr += ovlsize;
-                tsize = ovl.path.tlen*tbytes;
-
-                if (iptr + tsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                    if (iptr + tsize > itop)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Too few alignment records\n",disp);
-                        goto error;
-                      }
-                  }
-                ovl.path.trace = iptr;
-                iptr += tsize;
+                if (pread(fileno(input),((char *) &first)+sizeof(void *),
+                          sizeof(Overlap)-sizeof(void *),sizeof(int64)+sizeof(int))
+                       == (ssize_t) (sizeof(Overlap)-sizeof(void *)))
+                  HAS_CHAINS = ((first.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
+              }
 
-                //  Basic checks
+            //  Cut the file into ranges and check them concurrently
 
-                if (ovl.aread < 0 || ovl.bread < 0)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Read indices < 0\n",disp);
-                    goto error;
-                  }
-                if (ovl.aread >= nreads1 || ovl.bread >= nreads2)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Read indices out of range\n",disp);
-                    goto error;
-                  }
+            if (NTHREADS > 1 && novl > 0)
+              { char *path = Block_Arg_Path(parse);
 
-                if (ovl.path.abpos >= ovl.path.aepos || ovl.path.aepos > reads1[ovl.aread].rlen ||
-                    ovl.path.bbpos >= ovl.path.bepos || ovl.path.bepos > reads2[ovl.bread].rlen ||
-                    ovl.path.abpos < 0               || ovl.path.bbpos < 0                       )
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Non-sense alignment intervals\n",disp);
-                    goto error;
-                  }
+                n = partition(input,Catenate(path,"/",disp,".las"),novl,fsize,NTHREADS,beg,ord);
+                free(path);
+              }
+            else
+              { beg[0] = sizeof(int64) + sizeof(int);
+                ord[0] = 0;
+                n = 1;
+              }
+            beg[n] = fsize;
+            ord[n] = novl;
+
+            for (k = 0; k < n; k++)
+              { parm[k].input = input;
+                parm[k].beg   = beg[k];
+                parm[k].end   = beg[k+1];
+                parm[k].jbeg  = ord[k];
+                parm[k].novl  = ord[k+1] - ord[k];
+                parm[k].final = (k == n-1);
+                parm[k].disp  = disp;
+                parm[k].bsize = (IBUFFER*1000000ll)/n;
+              }
 
-                if (ovl.path.diffs < 0 || ovl.path.diffs > reads1[ovl.aread].rlen ||
-                                          ovl.path.diffs > reads2[ovl.bread].rlen)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Non-sense number of differences\n",disp);
-                    goto error;
-                  }
+            for (k = 1; k < n; k++)
+              pthread_create(threads+k,NULL,check_thread,parm+k);
+            check_thread(parm);
+            for (k = 1; k < n; k++)
+              pthread_join(threads[k],NULL);
 
-                if (Check_Trace_Points(&ovl,tspace,VERBOSE,disp))
-                  goto error;
+            //  Report the first error in file order, checking the first LA of each range
+            //    against the end of the preceding range
 
-                if (j == 0)
-                  has_chains = ((ovl.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
-                if (has_chains)
-                  { if (CHAIN_START(ovl.flags) && CHAIN_NEXT(ovl.flags))
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LA has both start & next flag set\n",disp);
-                        goto error;
-                      }
-                    if (BEST_CHAIN(ovl.flags) && CHAIN_NEXT(ovl.flags))
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LA has both best & next flag set\n",disp);
-                        goto error;
-                      }
-                  }
-                else
-                  { if ((ovl.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LAs should not have chain flags\n",disp);
-                        goto error;
-                      }
-                  }
+            for (k = 0; k < n; k++)
+              { Check_Arg *a = parm+k;
 
-                //  Duplicate check and sort check if -S set
-
-                equal = 0;
-                if (SORTED)
-                  { if (CHAIN_NEXT(ovl.flags))
-                      { if (ovl.aread == last.aread && ovl.bread != last.bread &&
-                            COMP(ovl.flags) != COMP(last.flags) &&
-                            ovl.path.abpos >= last.path.abpos &&
-                            ovl.path.bbpos >= last.path.bbpos)
-                          goto dupcheck;
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: Chain is not valid (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                    else if (!has_chains)
-                      { if (ovl.aread > last.aread) goto inorder;
-                        if (ovl.aread == last.aread)
-                          { if (MAP_ORDER)
-                              { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                if (ovl.path.abpos == prev.path.abpos)
-                                  goto dupcheck;
-                              }
-                            else
-                              { if (ovl.bread > last.bread) goto inorder;
-                                if (ovl.bread == last.bread)
-                                  { if (COMP(ovl.flags) > COMP(last.flags)) goto inorder;
-                                    if (COMP(ovl.flags) == COMP(last.flags))
-                                      { if (ovl.path.abpos > last.path.abpos) goto inorder;
-                                        if (ovl.path.abpos == last.path.abpos)
-                                          { equal = 1;
-                                            goto inorder;
-                                          }
-                                      }
-                                  }
-                              }
-                          }
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: LAs are not sorted (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                    else //  First element of a chain
-                      { if (ovl.aread > prev.aread) goto inorder;
-                        if (ovl.aread == prev.aread)
-                          { if (MAP_ORDER)
-                              { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                if (ovl.path.abpos == prev.path.abpos)
-                                  goto dupcheck;
-                              }
-                            else
-                              { if (ovl.bread > prev.bread) goto inorder;
-                                if (ovl.bread == prev.bread)
-                                  { if (COMP(ovl.flags) > COMP(prev.flags)) goto inorder;
-                                    if (COMP(ovl.flags) == COMP(prev.flags))
-                                      { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                        if (ovl.path.abpos == prev.path.abpos)
-                                          { equal = 1;
-                                            goto dupcheck;
-                                          }
-                                      }
-                                  }
-                              }
-                          }
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: Chains are not sorted (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                  }
-              dupcheck:
-                if (ovl.aread == last.aread && ovl.bread == last.bread &&
-                    COMP(ovl.flags) == COMP(last.flags) && ovl.path.abpos == last.path.abpos)
-                  equal = 1;
-              inorder:
-                if (equal)
-                  { if (ovl.path.aepos == last.path.aepos &&
-                        ovl.path.bbpos == last.path.bbpos &&
-                        ovl.path.bepos == last.path.bepos)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Duplicate LAs (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
+                if (k > 0 && a->errj != a->jbeg)
+                  { if (check_order(&(a->first),&(a[-1].last),&(a[-1].prev),disp,a->emsg))
+                      { if (a->etrace != NULL)
+                          free(a->etrace);
+                        a->etrace = NULL;
+                        a->errj   = a->jbeg;
                       }
                   }
-
-                last = ovl;
-                if (CHAIN_START(ovl.flags))
-                  prev = ovl;
+                if (a->errj >= 0)
+                  break;
               }
 
-            //  File processing epilog: Check all data read and print OK if -v
-
-            if (iptr < itop)
+            if (k < n)
               { if (VERBOSE)
-                  fprintf(stderr,"  %s: Too many alignment records\n",disp);
+                  { if (parm[k].etrace != NULL)
+                      Check_Trace_Points(parm[k].etrace,tspace,VERBOSE,disp);
+                    else
+                      fprintf(stderr,"%s",parm[k].emsg);
+                  }
+                for (k = 0; k < n; k++)
+                  free(parm[k].etrace);
                 goto error;
               }
 
+            //  File processing epilog: print OK if -v
+
             if (VERBOSE)
               { printf("  %s: ",disp);
                 Print_Number(novl,0,stdout);
@@ -386,7 +614,10 @@ int main(int argc, char *argv[])
         Free_Block_Arg(parse);
       }
 
-    free(iblock-ptrsize);
+    free(threads);
+    free(parm);
+    free(ord);
+    free(beg);
   }
 
   Close_DB(db1);
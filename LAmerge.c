@@ -10,209 +10,942 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include "DB.h"
 #include "align.h"
 
 #undef   DEBUG
 
-static char *Usage = "[-va] [-P<dir(/tmp)>] <merge:las> <parts:las> ...";
+static char *Usage =
+    "[-vaz] [-T<int(1)>] [-M<GB>] [-P<dir(/tmp)>] [-I<int>] <merge:las> <parts:las> ...";
 
-#define MEMORY 4000   // in Mb
+#define MEMORY_MAX 4000000000ll   //  Default buffer memory is a quarter of physical memory
+#define MEMORY_MIN  100000000ll   //    but no more than MEMORY_MAX and no less than MEMORY_MIN
+
+static int64 MEMORY;      //  Bytes for the scan and input buffers
 
 #define MAX_FILES 250
 
-  //  Heap sort of records according to (aread,bread,COMP(flags),abpos) order
-
-#define COMPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->bread > rp->bread)		\
-    bigger = 1;					\
-  else if (lp->bread < rp->bread)		\
-    bigger = 0;					\
-  else if (COMP(lp->flags) > COMP(rp->flags))	\
-    bigger = 1;					\
-  else if (COMP(lp->flags) < COMP(rp->flags))	\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
-
-static void reheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
+static int   MAP_SORT;   //  Merge in (aread,abpos) order as opposed to (aread,bread,COMP,abpos)
+static int   TBYTES;     //  Size of a trace element
+static int64 OSIZE;      //  Size of an overlap record on disk
+static int64 PSIZE;      //  Size of a pointer
+
+  //  Order of records according to (aread,bread,COMP(flags),abpos) or (aread,abpos) if
+  //    MAP_SORT.  Ties are broken by position in the ovls array, i.e. input file order.
+
+static inline int ovl_less(Overlap *lp, Overlap *rp)
+{ if (lp->aread != rp->aread)
+    return (lp->aread < rp->aread);
+  if ( ! MAP_SORT)
+    { if (lp->bread != rp->bread)
+        return (lp->bread < rp->bread);
+      if (COMP(lp->flags) != COMP(rp->flags))
+        return (COMP(lp->flags) < COMP(rp->flags));
+    }
+  if (lp->path.abpos != rp->path.abpos)
+    return (lp->path.abpos < rp->path.abpos);
+  return (lp < rp);
+}
+
+  //  Input data structure: a reader for a byte range of a file, the range [lo,hi) of A-reads
+    //  to take from it, its current record, and the number of records taken from it.  The
+    //  ranges are read with pread so that the inputs of several partitions can share one
+    //  file descriptor.  The byte range of a blocked file covers whole blocks, so it may
+    //  begin and end with records of the neighbouring partitions, which the A-read range
+    //  excludes.
+
+#define EXHAUSTED 0x7fffffff
+
+typedef struct
+  { Las_Reader *reader;
+    int         lo, hi;
+    Overlap    *rec;
+    int64       count;
+  } IO_block;
+
+  //  Advance to the next record of in, return 0 if there is none
+
+static int ovl_next(IO_block *in)
+{ Overlap *rec;
+
+  while ((rec = Next_Las_Record(in->reader)) != NULL && rec->aread < in->lo)
+    ;
+  if (rec != NULL && rec->aread >= in->hi)
+    rec = NULL;
+  in->rec = rec;
+  return (rec != NULL);
+}
+
+  //  Merge of the records in inputs in[0..fway-1] with a loser tree, writing the result at
+  //    position where of file ofd, or to writer if it is not NULL.  The tree has fway leaves,
+  //    tree[0] is the index of the winner and tree[1..fway-1] are the indices of the losers
+  //    at each internal node.  An exhausted input is given an aread that is larger than any
+  //    other.
+
+typedef struct
+  { IO_block *in;
+    int       fway;
+    int64     bsize;
+    char     *oblock;
+    int       ofd;
+    int64     where;
+    Las_Writer *writer;
+  } Merge_Arg;
+
+static void *merge_thread(void *arg)
+{ Merge_Arg *data  = (Merge_Arg *) arg;
+  IO_block  *in    = data->in;
+  int        fway  = data->fway;
+  int64      bsize = data->bsize;
+  int64      psize = PSIZE;
+  int64      osize = OSIZE;
+  int        tbytes = TBYTES;
+
+  int       *tree, *win;
+  Overlap   *ovls;
+  char      *oblock, *optr, *otop;
+  int64      where;
+  int        i, n, w, t;
+
+  tree = (int *) Malloc(sizeof(int)*2*fway,"Allocating loser tree");
+  win  = (int *) Malloc(sizeof(int)*2*fway,"Allocating loser tree");
+  ovls = (Overlap *) Malloc(sizeof(Overlap)*fway,"Allocating loser tree");
+  if (tree == NULL || win == NULL || ovls == NULL)
+    exit (1);
+
+  for (i = 0; i < fway; i++)
+    { if (ovl_next(in+i))
+        ovls[i] = *(in[i].rec);
+      else
+        ovls[i].aread = EXHAUSTED;
+      win[fway+i] = i;
+    }
+  for (n = fway-1; n >= 1; n--)
+    { int l = win[2*n];
+      int r = win[2*n+1];
+
+      if (ovl_less(ovls+l,ovls+r))
+        { win[n]  = l;
+          tree[n] = r;
+        }
       else
-        { hr = heap[r];
-          COMPARE(hr,hl)
+        { win[n]  = r;
+          tree[n] = l;
         }
-      if (bigger)
-        { COMPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
+    }
+  tree[0] = win[1];
+  free(win);
+
+  oblock = data->oblock;
+  optr   = oblock;
+  otop   = oblock + bsize;
+  where  = data->where;
+
+  //  While the winner is not exhausted do
+
+  while (ovls[w = tree[0]].aread != EXHAUSTED)
+    { Overlap  *ov;
+      IO_block *src;
+      int64     span;
+
+      ov  = ovls + w;
+      src = in + w;
+
+      do
+        { src->count += 1;
+
+          if (data->writer != NULL)
+            { src->rec->path.trace = (void *) (src->rec+1);
+              if (Write_Las_Record(data->writer,src->rec))
+                exit (1);
+              goto advance;
             }
-          else
-            break;
+
+          span = osize + ov->path.tlen*tbytes;
+          if (optr + span > otop)
+            { if (pwrite(data->ofd,oblock,optr-oblock,where) != (ssize_t) (optr-oblock))
+                SYSTEM_WRITE_ERROR
+              where += optr-oblock;
+              optr = oblock;
+            }
+
+          memmove(optr,((char *) src->rec) + psize,span);
+          optr += span;
+
+        advance:
+          if ( ! ovl_next(src))
+            { ov->aread = EXHAUSTED;
+              break;
+            }
+          *ov = *(src->rec);
         }
-      else
-        { COMPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
+      while (CHAIN_NEXT(ov->flags));
+
+      //  Replay the matches on the path from the leaf of w to the root
+
+      for (n = (fway+w)/2; n >= 1; n /= 2)
+        { t = tree[n];
+          if (ovl_less(ovls+t,ovls+w))
+            { tree[n] = w;
+              w = t;
             }
-          else
-            break;
         }
+      tree[0] = w;
+    }
+
+  if (optr > oblock)
+    { if (pwrite(data->ofd,oblock,optr-oblock,where) != (ssize_t) (optr-oblock))
+        SYSTEM_WRITE_ERROR
     }
-  if (c != s)
-    heap[c] = hs;
+
+  free(ovls);
+  free(tree);
+  return (NULL);
 }
 
-  //  Heap sort of records according to (aread,abpos) order
-
-#define MAPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
-
-static void maheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
-      else
-        { hr = heap[r];
-          MAPARE(hr,hl)
+  //  Partitioning for a threaded merge: each file is sampled for the A-read at a number of
+  //    record positions, taken from its pile index or block table if it has one, and
+  //    otherwise found by resynchronizing on the records at evenly spaced offsets.  These
+  //    samples are used to pick A-read boundaries that divide the total data evenly, and
+  //    then the position of each boundary in each file is narrowed down from the samples
+  //    either side of it by a binary search over resynchronized offsets, and found exactly
+  //    with a short forward scan (or by decoding the one block of a blocked file that holds
+  //    it).  Only a small part of each file is read.  Offsets of samples and boundaries are
+  //    in the raw format, i.e. for a blocked file the positions its records would have if
+  //    it were not blocked.
+
+#define HSIZE  ((int64) (sizeof(int64) + sizeof(int)))   //  Size of a .las header
+
+#define SCAN_READ    0x4000    //  Bytes read at a time when probing a file
+#define SCAN_BUFFER  0x40000   //  Size of the scan buffer of a file (enlarged for big records)
+#define SCAN_NARROW  0x40000   //  Scan forward to a boundary once within this many bytes
+#define RESYNC_SPAN  0x10000   //  Look this far past an offset for a record start
+#define RESYNC_RUN         8   //    at which this many well-formed records follow in order
+
+typedef struct
+  { int    aread;   //  A-read of the record at
+    int64  off;     //    this (raw) offset
+  } Sample;
+
+typedef struct
+  { FILE      *input;    //  File to scan
+    int        fd;       //    its descriptor
+    int64      size;     //    its size
+    int64      rend;     //    and the (raw) end of its records
+    int        tspace;   //  Trace spacing of its records
+    int        nprobe;   //  # of offsets at which to sample a file without an index
+    Las_Index *index;    //  Pile index, or block table if blocked (else NULL)
+    int64     *rbeg;     //  Raw offset of each block of a blocked file (else NULL)
+    char      *buf;      //  Scan buffer of bsize bytes covering file bytes [wbeg,wend)
+    int64      bsize;
+    int64      wbeg;
+    int64      wend;
+    Sample    *samp;     //  Sample positions
+    int        nsamp;
+  } Scan_Arg;
+
+  //  Return a pointer to the overlap record at file offset pos in s->buf, ensuring that the
+  //    len bytes following pos are in the buffer (or as many as there are in the file).  At
+  //    least SCAN_READ bytes are read at a time.
+
+static Overlap *scan_peek(Scan_Arg *s, int64 pos, int64 len)
+{ int64 n;
+
+  if (pos < s->wbeg || pos + len > s->wend)
+    { if (len > s->bsize)
+        { s->bsize = len;
+          s->buf   = (char *) Realloc(s->buf-PSIZE,s->bsize+PSIZE,"Enlarging scan buffer");
+          if (s->buf == NULL)
+            exit (1);
+          s->buf += PSIZE;
         }
-      if (bigger)
-        { MAPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
+      n = s->size - pos;
+      if (n > len && n > SCAN_READ)
+        n = (len > SCAN_READ ? len : SCAN_READ);
+      if (pread(s->fd,s->buf,n,pos) != n)
+        SYSTEM_READ_ERROR
+      s->wbeg = pos;
+      s->wend = pos + n;
+    }
+  return ((Overlap *) (s->buf + ((pos - s->wbeg) - PSIZE)));
+}
+
+  //  Is the header of the record at ov well formed?  And its trace (following it)?
+
+static int good_header(Overlap *ov, int tspace)
+{ Path *p = &(ov->path);
+
+  if (ov->aread < 0 || ov->bread < 0 || p->abpos < 0 || p->abpos >= p->aepos
+                    || p->bbpos < 0 || p->bbpos >= p->bepos || p->diffs < 0
+                    || p->diffs > (p->aepos-p->abpos) + (p->bepos-p->bbpos)
+                    || p->tlen < 0 || OSIZE + p->tlen*TBYTES > SCAN_BUFFER)
+    return (0);
+  if (tspace != 0)
+    return (((p->aepos-1)/tspace - p->abpos/tspace)*2 == p->tlen-2);
+  return ((p->tlen & 1) == 0);
+}
+
+static int good_trace(Overlap *ov, int tspace)
+{ Overlap o;
+
+  o = *ov;
+  o.path.trace = (void *) (ov+1);
+  return ( ! Check_Trace_Points(&o,tspace,0,NULL));
+}
+
+  //  Do RESYNC_RUN well-formed records in A-read order (or all that remain) begin at pos?
+
+static int records_at(Scan_Arg *s, int64 pos)
+{ Overlap *ov;
+  int64    span;
+  int      n, last;
+
+  last = -1;
+  for (n = 0; n < RESYNC_RUN && pos < s->size; n++)
+    { if (pos + OSIZE > s->size)
+        return (0);
+      ov = scan_peek(s,pos,OSIZE);
+      if (ov->aread < last || ! good_header(ov,s->tspace))
+        return (0);
+      span = OSIZE + ov->path.tlen*TBYTES;
+      if (pos + span > s->size)
+        return (0);
+      ov = scan_peek(s,pos,span);
+      if ( ! good_trace(ov,s->tspace))
+        return (0);
+      last = ov->aread;
+      pos += span;
+    }
+  return (1);
+}
+
+  //  Return the first record start in [pos,min(pos+RESYNC_SPAN,lim)), or -1 if none is found
+
+static int64 resync(Scan_Arg *s, int64 pos, int64 lim)
+{ if (lim > pos + RESYNC_SPAN)
+    lim = pos + RESYNC_SPAN;
+  for ( ; pos < lim; pos++)
+    if (records_at(s,pos))
+      return (pos);
+  return (-1);
+}
+
+static void add_sample(Scan_Arg *s, int *nmax, int aread, int64 off)
+{ if (s->nsamp >= *nmax)
+    { *nmax = 1.2*s->nsamp + 10;
+      s->samp = (Sample *) Realloc(s->samp,sizeof(Sample)*(*nmax),"Reallocating sample array");
+      if (s->samp == NULL)
+        exit (1);
+    }
+  s->samp[s->nsamp].aread = aread;
+  s->samp[s->nsamp].off   = off;
+  s->nsamp += 1;
+}
+
+static void sample_file(Scan_Arg *s)
+{ int64    pos, prev;
+  int      nmax, k;
+  Overlap *ov;
+
+  nmax    = 10;
+  s->samp = (Sample *) Malloc(sizeof(Sample)*nmax,"Allocating sample array");
+  if (s->samp == NULL)
+    exit (1);
+  s->nsamp = 0;
+
+  if (s->rbeg != NULL)                   //  Blocked: the blocks of the block table
+    { Las_Index_Entry *idx = s->index->idx;
+
+      pos = HSIZE;
+      for (k = 0; k < s->index->nidx; k++)
+        { int64 rsize = Las_Block_Size(s->input,idx+k);
+
+          if (rsize < 0)
+            SYSTEM_READ_ERROR
+          s->rbeg[k] = pos;
+          add_sample(s,&nmax,idx[k].aread,pos);
+          pos += rsize;
+        }
+      s->rbeg[k] = pos;
+    }
+
+  else if (s->index != NULL)             //  Pile index: its entries
+    { for (k = 0; k < s->index->nidx; k++)
+        add_sample(s,&nmax,s->index->idx[k].aread,s->index->idx[k].offset);
+    }
+
+  else if (s->size > HSIZE)      //  Neither: the first record and nprobe-1 others
+    { ov = scan_peek(s,HSIZE,OSIZE);
+      add_sample(s,&nmax,ov->aread,HSIZE);
+      prev = HSIZE;
+      for (k = 1; k < s->nprobe; k++)
+        { pos = resync(s,HSIZE + ((s->size-HSIZE)*k)/s->nprobe,s->size);
+          if (pos > prev)
+            { ov = scan_peek(s,pos,OSIZE);
+              add_sample(s,&nmax,ov->aread,pos);
+              prev = pos;
             }
-          else
-            break;
         }
+    }
+}
+
+  //  Find the first record of s with an aread >= bound, setting *raw to its raw offset, and
+  //    *fbeg and *fend to the file offsets at which the readers of the partitions after and
+  //    before it should begin and end, respectively.  These differ only for a blocked file,
+  //    as they are then the start and end of the block containing the record.
+
+static void scan_bound(Scan_Arg *s, int bound, int64 *raw, int64 *fbeg, int64 *fend)
+{ int64    lo, hi, mid;
+  int      l, r, m;
+  Overlap *ov;
+
+  l = -1;
+  r = s->nsamp;
+  while (r - l > 1)          //  s->samp[l].aread < bound <= s->samp[r].aread
+    { m = (l+r)/2;
+      if (s->samp[m].aread < bound)
+        l = m;
       else
-        { MAPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
-            }
-          else
-            break;
+        r = m;
+    }
+
+  if (s->rbeg != NULL)       //  Decode the block l that may contain it
+    { Las_Index_Entry *idx = s->index->idx;
+      Las_Reader      *reader;
+      int64            next;
+
+      if (l < 0)
+        { *raw  = HSIZE;
+          *fbeg = *fend = (s->index->nidx > 0 ? idx[0].offset : s->size);
+          return;
+        }
+      if (l+1 < s->index->nidx)
+        next = idx[l+1].offset;
+      else
+        next = s->size;
+      reader = Open_Las_Reader(s->input,idx[l].offset,next,s->bsize,TBYTES);
+      if (reader == NULL)
+        exit (1);
+      lo = s->rbeg[l];
+      while ((ov = Next_Las_Record(reader)) != NULL && ov->aread < bound)
+        lo += OSIZE + ov->path.tlen*TBYTES;
+      Close_Las_Reader(reader);
+      *raw = lo;
+      if (ov == NULL)
+        *fbeg = *fend = next;
+      else
+        { *fbeg = idx[l].offset;
+          *fend = next;
         }
+      return;
+    }
+
+  if (l < 0)
+    { *raw = *fbeg = *fend = HSIZE;
+      return;
+    }
+
+  lo = s->samp[l].off;
+  if (r < s->nsamp)
+    hi = s->samp[r].off;
+  else
+    hi = s->size;
+  while (hi - lo > SCAN_NARROW)
+    { mid = resync(s,lo + (hi-lo)/2,hi);
+      if (mid < 0)
+        break;
+      ov = scan_peek(s,mid,OSIZE);
+      if (ov->aread < bound)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  while (lo < s->size)
+    { ov = scan_peek(s,lo,OSIZE);
+      if (ov->aread >= bound)
+        break;
+      lo += OSIZE + ov->path.tlen*TBYTES;
     }
-  if (c != s)
-    heap[c] = hs;
+  *raw = *fbeg = *fend = lo;
+}
+
+  //  Thread to sample files [beg,end) if nbnd < 0, otherwise find the places of the
+  //    nbnd aread boundaries in bnd in each file
+
+typedef struct
+  { Scan_Arg *scan;
+    int       beg;
+    int       end;
+    int       nbnd;
+    int      *bnd;
+    int64    *bound;
+    int64    *fbeg;
+    int64    *fend;
+    int       fway;
+  } Part_Arg;
+
+static void *part_thread(void *arg)
+{ Part_Arg *data = (Part_Arg *) arg;
+  int       f, p, k;
+
+  for (f = data->beg; f < data->end; f++)
+    if (data->nbnd < 0)
+      sample_file(data->scan+f);
+    else
+      for (p = 1; p < data->nbnd; p++)
+        { k = p*data->fway+f;
+          scan_bound(data->scan+f,data->bnd[p],data->bound+k,data->fbeg+k,data->fend+k);
+        }
+  return (NULL);
 }
 
-#ifdef DEBUG
+static int SAMPLE_ORDER(const void *x, const void *y)
+{ Sample *l = (Sample *) x;
+  Sample *r = (Sample *) y;
+
+  return (l->aread - r->aread);
+}
 
-static void showheap(Overlap **heap, int hsize)
+  //  Determine up to npart partitions of the fway files of scan, returning the number of
+  //    partitions, in bnd[p] the first aread of partition p, and in bound[p*fway+f] the raw
+  //    offset in file f at which partition p begins, and in fbeg[p*fway+f] and fend[p*fway+f]
+  //    the file offsets at which the readers of partition p and p-1 begin and end (for p in
+  //    [1,npart-1], the caller sets the first and last).
+
+static int partition(Scan_Arg *scan, int fway, int npart, int nthreads, int *bnd,
+                     int64 *bound, int64 *fbeg, int64 *fend)
+{ pthread_t threads[nthreads];
+  Part_Arg  parm[nthreads];
+  Sample   *all;
+  int64     tot, cum;
+  int       nall, nbnd;
+  int       i, j, f;
+
+  for (i = 0; i < nthreads; i++)
+    { parm[i].scan  = scan;
+      parm[i].beg   = (fway*i)/nthreads;
+      parm[i].end   = (fway*(i+1))/nthreads;
+      parm[i].nbnd  = -1;
+      parm[i].bound = bound;
+      parm[i].fbeg  = fbeg;
+      parm[i].fend  = fend;
+      parm[i].fway  = fway;
+    }
+  for (i = 1; i < nthreads; i++)
+    pthread_create(threads+i,NULL,part_thread,parm+i);
+  part_thread(parm);
+  for (i = 1; i < nthreads; i++)
+    pthread_join(threads[i],NULL);
+
+  //  Weight each sample by the # of bytes to the next sample in its file, and pick
+  //    boundaries at the npart-quantiles of the weighted areads
+
+  nall = 0;
+  for (f = 0; f < fway; f++)
+    nall += scan[f].nsamp;
+  all = (Sample *) Malloc(sizeof(Sample)*(nall+1),"Allocating sample array");
+  if (all == NULL)
+    exit (1);
+
+  tot  = 0;
+  nall = 0;
+  for (f = 0; f < fway; f++)
+    for (j = 0; j < scan[f].nsamp; j++)
+      { all[nall].aread = scan[f].samp[j].aread;
+        if (j+1 < scan[f].nsamp)
+          all[nall].off = scan[f].samp[j+1].off - scan[f].samp[j].off;
+        else
+          all[nall].off = scan[f].rend - scan[f].samp[j].off;
+        tot  += all[nall].off;
+        nall += 1;
+      }
+  qsort(all,nall,sizeof(Sample),SAMPLE_ORDER);
+
+  nbnd = 1;
+  cum  = 0;
+  for (j = 0; j < nall && nbnd < npart; j++)
+    { if (cum*npart >= tot*nbnd && all[j].aread > all[0].aread
+                                && (nbnd == 1 || all[j].aread > bnd[nbnd-1]))
+        bnd[nbnd++] = all[j].aread;
+      cum += all[j].off;
+    }
+
+  for (i = 0; i < nthreads; i++)
+    { parm[i].nbnd = nbnd;
+      parm[i].bnd  = bnd;
+    }
+  for (i = 1; i < nthreads; i++)
+    pthread_create(threads+i,NULL,part_thread,parm+i);
+  part_thread(parm);
+  for (i = 1; i < nthreads; i++)
+    pthread_join(threads[i],NULL);
+
+  for (f = 0; f < fway; f++)
+    free(scan[f].samp);
+  free(all);
+  return (nbnd);
+}
+
+  //  Temporary files of a multi-level merge, removed at exit or on a fatal signal
+
+static char **TEMPS  = NULL;
+static int    NTEMPS = 0;
+static int    MTEMPS = 0;
+
+static void clean_temps()
 { int i;
-  printf("\n");
-  for (i = 1; i <= hsize; i++)
-    printf(" %3d: %5d, %5d\n",i,heap[i]->aread,heap[i]->bread);
+
+  for (i = 0; i < NTEMPS; i++)
+    if (TEMPS[i] != NULL)
+      unlink(TEMPS[i]);
 }
 
-#endif
+static void clean_signal(int sig)
+{ clean_temps();
+  signal(sig,SIG_DFL);
+  raise(sig);
+}
 
-  //  Input block data structure and block fetcher
+static char *new_temp(char *dir, int pid)
+{ char name[100];
 
-typedef struct
-  { FILE   *stream;
-    char   *block;
-    char   *ptr;
-    char   *top;
-    int64   count;
-  } IO_block;
+  if (NTEMPS >= MTEMPS)
+    { MTEMPS = 1.2*NTEMPS + 10;
+      TEMPS  = (char **) Realloc(TEMPS,sizeof(char *)*MTEMPS,"Allocating temp file list");
+      if (TEMPS == NULL)
+        exit (1);
+    }
+  if (NTEMPS == 0)
+    { atexit(clean_temps);
+      signal(SIGINT,clean_signal);
+      signal(SIGTERM,clean_signal);
+      signal(SIGHUP,clean_signal);
+    }
+  sprintf(name,"LM%d.%d",pid,NTEMPS);
+  TEMPS[NTEMPS] = Strdup(Catenate(dir,"/",name,".las"),"Allocating temp file name");
+  if (TEMPS[NTEMPS] == NULL)
+    exit (1);
+  return (TEMPS[NTEMPS++]);
+}
 
-static void ovl_reload(IO_block *in, int64 bsize)
-{ int64 remains;
+static void free_temp(char *name)
+{ int i;
 
-  remains = in->top - in->ptr;
-  if (remains > 0)
-    memmove(in->block, in->ptr, remains);
-  in->ptr  = in->block;
-  in->top  = in->block + remains;
-  in->top += fread(in->top,1,bsize-remains,in->stream);
+  for (i = 0; i < NTEMPS; i++)
+    if (TEMPS[i] == name)
+      { unlink(name);
+        free(name);
+        TEMPS[i] = NULL;
+      }
 }
 
-  //  The program
+  //  Merge the fway sorted files in names (all with trace spacing tspace) into file
+  //    oname using nthreads threads, in the blocked format if zip.  Return the # of
+  //    records merged.
 
-int main(int argc, char *argv[])
+static int64 merge_files(char **names, int fway, char *oname, int tspace, int nthreads,
+                         int zip, int verbose)
 { IO_block *in;
-  int64     bsize, osize, psize;
-  char     *block, *oblock;
-  int       i, c, fway, clen, nfile[argc];
-  Overlap **heap;
-  int       hsize;
-  Overlap  *ovls;
+  int64     bsize;
+  char     *block;
+  int       i;
   int64     totl;
-  int       tspace, tbytes;
   FILE     *output;
-  char     *optr, *otop;
+  FILE    **inputs;
+  int      *bnd;
+  int64    *bound, *fbeg, *fend;
+  int       npart;
+
+  //  Open all the input files, sum the record counts in their headers
+
+  inputs = (FILE **) Malloc(sizeof(FILE *)*fway,"Allocating LAmerge file array");
+  if (inputs == NULL)
+    exit (1);
+
+  totl = 0;
+  for (i = 0; i < fway; i++)
+    { int64 povl;
+
+      inputs[i] = Fopen(names[i],"r");
+      if (inputs[i] == NULL)
+        exit (1);
+      if (fread(&povl,sizeof(int64),1,inputs[i]) != 1)
+        SYSTEM_READ_ERROR
+      totl += povl;
+    }
+
+  //  Partition the merge into A-read ranges if threaded (and the output is not blocked, as
+  //    its blocks are written one after the other, nor is an input blocked but unsorted, as
+  //    its block table then cannot place a boundary)
+
+  bnd   = (int *) Malloc(sizeof(int)*(nthreads+1),"Allocating partition array");
+  bound = (int64 *) Malloc(sizeof(int64)*3*fway*(nthreads+1),"Allocating partition array");
+  if (bnd == NULL || bound == NULL)
+    exit (1);
+  fbeg = bound + fway*(nthreads+1);
+  fend = fbeg + fway*(nthreads+1);
+
+  { Scan_Arg *scan;
+    struct stat info;
+    int64     ssize;
+    int       split;
+
+    scan = (Scan_Arg *) Malloc(sizeof(Scan_Arg)*fway,"Allocating scan records");
+    if (scan == NULL)
+      exit (1);
+
+    split = (nthreads > 1 && ! zip);
+    for (i = 0; i < fway; i++)
+      { Scan_Arg *s = scan+i;
+
+        if (fstat(fileno(inputs[i]),&info) != 0)
+          SYSTEM_READ_ERROR
+        s->input  = inputs[i];
+        s->fd     = fileno(inputs[i]);
+        s->size   = info.st_size;
+        s->rend   = info.st_size;
+        s->tspace = tspace;
+        s->nprobe = (64*nthreads)/fway + 2;
+        if (s->nprobe > (s->size - HSIZE)/SCAN_NARROW + 1)
+          s->nprobe = (s->size - HSIZE)/SCAN_NARROW + 1;
+        s->index  = NULL;
+        s->rbeg   = NULL;
+        s->buf    = NULL;
+        s->wbeg   = 0;
+        s->wend   = 0;
+        if ( ! split)
+          continue;
+
+        if (Las_Is_Blocked(inputs[i]))
+          { int   sorted;
+            int64 rsize;
+
+            s->index = Read_Las_Blocks(inputs[i],&sorted,&rsize);
+            if (s->index == NULL || ! sorted)
+              split = 0;
+            else
+              { s->rend = HSIZE + rsize;
+                s->rbeg = (int64 *) Malloc(sizeof(int64)*(s->index->nidx+1),
+                                           "Allocating block offsets");
+                if (s->rbeg == NULL)
+                  exit (1);
+              }
+          }
+        else
+          { int64 novl;
+
+            s->index = Open_Las_Index(names[i]);
+            if (s->index != NULL && (pread(s->fd,&novl,sizeof(int64),0) != sizeof(int64)
+                                       || s->index->novl != novl))
+              { Free_Las_Index(s->index);
+                s->index = NULL;
+              }
+          }
+      }
+
+    if (split)
+      { ssize = MEMORY/fway;
+        if (ssize > SCAN_BUFFER)
+          ssize = SCAN_BUFFER;
+        if (ssize < SCAN_READ)
+          ssize = SCAN_READ;
+        for (i = 0; i < fway; i++)
+          { scan[i].buf = (char *) Malloc(ssize+PSIZE,"Allocating LAmerge scan blocks");
+            if (scan[i].buf == NULL)
+              exit (1);
+            scan[i].buf  += PSIZE;
+            scan[i].bsize = ssize;
+          }
+
+        npart = partition(scan,fway,nthreads,nthreads,bnd,bound,fbeg,fend);
+      }
+    else
+      npart = 1;
+
+    bnd[0]     = 0;
+    bnd[npart] = EXHAUSTED;
+    for (i = 0; i < fway; i++)
+      { bound[i] = HSIZE;
+        fbeg[i]  = HSIZE;
+        bound[npart*fway+i] = scan[i].rend;
+        fend[npart*fway+i]  = scan[i].size;
+        if (scan[i].buf != NULL)
+          free(scan[i].buf-PSIZE);
+        free(scan[i].rbeg);
+        if (scan[i].index != NULL)
+          Free_Las_Index(scan[i].index);
+      }
+
+    free(scan);
+  }
+
+  if (verbose && nthreads > 1)
+    { printf("  Merging in %d A-read partitions\n",npart);
+      fflush(stdout);
+    }
+
+  //  Initialize the input buffers of each partition
+
+  bsize  = MEMORY/(npart*(2*fway + 1));
+  block  = (char *) Malloc(bsize*npart,"Allocating LAmerge blocks");
+  in     = (IO_block *) Malloc(sizeof(IO_block)*npart*fway,"Allocating LAmerge IO-reacords");
+  if (block == NULL || in == NULL)
+    exit (1);
+
+  { int p, f;
+
+    for (p = 0; p < npart; p++)
+      for (f = 0; f < fway; f++)
+        { IO_block *b = in + (p*fway+f);
+
+          b->reader = Open_Las_Reader(inputs[f],fbeg[p*fway+f],fend[(p+1)*fway+f],
+                                      bsize,TBYTES);
+          if (b->reader == NULL)
+            exit (1);
+          b->lo     = bnd[p];
+          b->hi     = bnd[p+1];
+          b->rec    = NULL;
+          b->count  = 0;
+        }
+  }
+
+  //  Open the output file and write (novl,tspace) header
+
+  output = Fopen(oname,"w");
+  if (output == NULL)
+    exit (1);
+
+  if (fwrite(&totl,sizeof(int64),1,output) != 1)
+    SYSTEM_WRITE_ERROR
+  if (fwrite(&tspace,sizeof(int),1,output) != 1)
+    SYSTEM_WRITE_ERROR
+  fflush(output);
+
+  //  Merge each partition into its byte range of the output
+
+  { pthread_t threads[npart];
+    Merge_Arg parm[npart];
+    int64     where;
+    int       p, f;
+
+    if (zip)
+      { parm[0].writer = Open_Las_Writer(output,tspace);
+        if (parm[0].writer == NULL)
+          exit (1);
+      }
+    else
+      parm[0].writer = NULL;
+
+    where = sizeof(int64) + sizeof(int);
+    for (p = 0; p < npart; p++)
+      { parm[p].in     = in + p*fway;
+        parm[p].fway   = fway;
+        parm[p].bsize  = bsize;
+        parm[p].oblock = block + p*bsize;
+        parm[p].ofd    = fileno(output);
+        parm[p].where  = where;
+        if (p > 0)
+          parm[p].writer = NULL;
+        for (f = 0; f < fway; f++)
+          where += bound[(p+1)*fway+f] - bound[p*fway+f];
+      }
+
+    for (p = 1; p < npart; p++)
+      pthread_create(threads+p,NULL,merge_thread,parm+p);
+    merge_thread(parm);
+    for (p = 1; p < npart; p++)
+      pthread_join(threads[p],NULL);
+
+    if (zip && Close_Las_Writer(parm[0].writer))
+      exit (1);
+  }
+
+  //  Wind up, patching the header count with the number of records written
+
+  { int64 novl;
+
+    novl = 0;
+    for (i = 0; i < npart*fway; i++)
+      { novl += in[i].count;
+        Close_Las_Reader(in[i].reader);
+      }
+
+    rewind(output);
+    if (fwrite(&novl,sizeof(int64),1,output) != 1)
+      SYSTEM_WRITE_ERROR
+    FCLOSE(output);
+
+    for (i = 0; i < fway; i++)
+      fclose(inputs[i]);
+
+    if (totl != novl)
+      { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",Prog_Name,oname,totl-novl);
+        exit (1);
+      }
+  }
+
+  free(bound);
+  free(bnd);
+  free(inputs);
+  free(in);
+  free(block);
+
+  return (totl);
+}
+
+  //  The program
+
+int main(int argc, char *argv[])
+{ char    **names;
+  int       i, c, fway, nmax;
+  int64     totl;
+  int       tspace;
+  char     *oname;
 
   int       VERBOSE;
-  int       MAP_SORT;
+  int       NTHREADS;
   char     *TEMP_PATH;
+  int       INDEX;
+  int       BLOCKED;
 
   //  Process command line
 
-  { int  j, k;
-    int  flags[128];
-    DIR *dirp;
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+    DIR  *dirp;
 
     ARG_INIT("LAmerge")
 
     TEMP_PATH = "/tmp";
+    NTHREADS  = 1;
+    INDEX     = 0;
+    MEMORY    = MEMORY_MAX;
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    { int64 phys = ((int64) sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+
+      if (phys > 0 && phys/4 < MEMORY)
+        MEMORY = phys/4;
+      if (MEMORY < MEMORY_MIN)
+        MEMORY = MEMORY_MIN;
+    }
+#endif
 
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("va")
+            ARG_FLAGS("vaz")
             break;
           case 'P':
             TEMP_PATH = argv[i]+2;
@@ -222,6 +955,23 @@ int main(int argc, char *argv[])
               }
             closedir(dirp);
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'I':
+            ARG_POSITIVE(INDEX,"Pile index sampling interval")
+            break;
+          case 'M':
+            { double limit;
+
+              ARG_REAL(limit)
+              if (limit <= 0.)
+                { fprintf(stderr,"%s: -M memory budget must be positive\n",Prog_Name);
+                  exit (1);
+                }
+              MEMORY = limit * 0x40000000ll;
+              break;
+            }
         }
       else
         argv[j++] = argv[i];
@@ -229,6 +979,7 @@ int main(int argc, char *argv[])
 
     VERBOSE  = flags['v'];
     MAP_SORT = flags['a'];
+    BLOCKED  = flags['z'];
 
     if (argc < 3)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
@@ -236,14 +987,24 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
         fprintf(stderr,"      -a: sort .las by A-read,A-position pairs for map usecase\n");
         fprintf(stderr,"          off => sort .las by A,B-read pairs for overlap piles\n");
+        fprintf(stderr,"      -z: Write the merged file in the blocked, compressed format\n");
         fprintf(stderr,"      -P: Do any intermediate merging in directory -P.\n");
+        fprintf(stderr,"      -T: Use -T threads, each merging a range of A-reads.\n");
+        fprintf(stderr,"      -M: Use -M GB of memory for buffers (default 1/4 of memory");
+        fprintf(stderr," up to 4GB).\n");
+        fprintf(stderr,"      -I: Also write a pile index <merge>.las.idx with an entry every");
+        fprintf(stderr," -I A-reads.\n");
         exit (1);
       }
   }
 
-  //  Determine the number of files and check they are all mergeable
+  //  Determine the files and check they are all mergeable
+
+  nmax   = 100;
+  names  = (char **) Malloc(sizeof(char *)*nmax,"Allocating file name list");
+  if (names == NULL)
+    exit (1);
 
-  clen   = 2*strlen(TEMP_PATH) + 50;
   fway   = 0;
   totl   = 0;
   tspace = -1;
@@ -254,15 +1015,6 @@ int main(int argc, char *argv[])
 
       parse = Parse_Block_LAS_Arg(argv[c]);
 
-      path = Block_Arg_Path(parse);
-      root = Block_Arg_Root(parse);
-
-      clen += strlen(path) + strlen(root) + 30;
-
-      free(root);
-      free(path);
-
-      nfile[c] = 0;
       while ((input = Next_Block_Arg(parse)) != NULL)
         { int64 povl;
           int   mspace;
@@ -280,13 +1032,22 @@ int main(int argc, char *argv[])
               fprintf(stderr," (%d vs %d)\n",tspace,mspace);
               exit (1);
             }
-
           fclose(input);
-          nfile[c] += 1;
+
+          if (fway >= nmax)
+            { nmax  = 1.2*fway + 100;
+              names = (char **) Realloc(names,sizeof(char *)*nmax,"Allocating file name list");
+              if (names == NULL)
+                exit (1);
+            }
+          path = Block_Arg_Path(parse);
+          root = Block_Arg_Root(parse);
+          names[fway++] = Strdup(Catenate(path,"/",root,".las"),"Allocating file name");
+          free(root);
+          free(path);
         }
 
       Free_Block_Arg(parse);
-      fway += nfile[c];
     }
 
   if (VERBOSE)
@@ -296,229 +1057,75 @@ int main(int argc, char *argv[])
       fflush(stdout);
     }
 
-  //  Must recursively merge, emit sub-merges, then merge their results
-
-  if (fway > MAX_FILES)
-    { Block_Looper *parse;
-      int   mul, dim, fsum, cut;
-      char  command[clen], *com;
-      int   pid;
-
-      mul = 1;
-      for (c = 0; mul < fway; c++)
-        mul *= MAX_FILES;
-      dim = pow(1.*fway,1./c)+1;
-
-      fsum = 0;
-      c = 2;
-
-      parse = Parse_Block_LAS_Arg(argv[c]);
-
-      pid = getpid();
-      for (i = 1; i <= dim; i++)
-        { com = command;
-          com += sprintf(com,"LAmerge");
-          if (MAP_SORT)
-            com += sprintf(com," -a");
-          if (mul > 2)
-            com += sprintf(com," -P%s",TEMP_PATH);
-          com += sprintf(com," %s/LM%d.P%d",TEMP_PATH,pid,i);
-
-          cut = (fway * i) / dim;
-          while (fsum + nfile[c] <= cut)
-            { com  += sprintf(com," %s",Next_Block_Slice(parse,nfile[c]));
-              fsum += nfile[c];
-
-              c += 1;
-              if (c >= argc)
-                break;
-
-              Free_Block_Arg(parse);
-
-              parse = Parse_Block_LAS_Arg(argv[c]);
-            }
-          if (c < argc && fsum < cut)
-            { int n = cut-fsum;
-              com += sprintf(com," %s",Next_Block_Slice(parse,n));
-              nfile[c] -= n;
-              fsum     += n;
-            }
-          system(command);
-        }
-
-      Free_Block_Arg(parse);
-
-      com = command;
-      com += sprintf(com,"LAmerge");
-      if (MAP_SORT)
-        com += sprintf(com," -a");
-      com += sprintf(com," %s %s/LM%d.P%c",argv[1],TEMP_PATH,pid,BLOCK_SYMBOL);
-      system(command);
-
-      sprintf(command,"rm %s/LM%d.P*.las",TEMP_PATH,pid);
-      system(command);
-
-      exit (0);
-    }
-
-  //  Base level merge: Open all the input files and initialize their buffers
-
-  psize  = sizeof(void *);
-  osize  = sizeof(Overlap) - psize;
-  bsize  = (MEMORY*1000000ll)/(fway + 1);
-  block  = (char *) Malloc(bsize*(fway+1)+psize,"Allocating LAmerge blocks");
-  in     = (IO_block *) Malloc(sizeof(IO_block)*fway,"Allocating LAmerge IO-reacords");
-  if (block == NULL || in == NULL)
-    exit (1);
-  block += psize;
-
-  fway = 0;
-  for (c = 2; c < argc; c++)
-    { Block_Looper *parse;
-      FILE  *input;
-
-      parse = Parse_Block_LAS_Arg(argv[c]);
-
-      while ((input = Next_Block_Arg(parse)) != NULL)
-        { int64  novl;
-          int    mspace;
-          char  *iblock;
-
-          if (fread(&novl,sizeof(int64),1,input) != 1)
-            SYSTEM_READ_ERROR
-          if (fread(&mspace,sizeof(int),1,input) != 1)
-            SYSTEM_READ_ERROR
-
-          in[fway].stream = input;
-          in[fway].block  = iblock = block+fway*bsize;
-          in[fway].ptr    = iblock;
-          in[fway].top    = iblock + fread(in[fway].block,1,bsize,input);
-          in[fway].count  = 0;
-          fway += 1;
-        }
-
-      Free_Block_Arg(parse);
-    }
+  PSIZE  = sizeof(void *);
+  OSIZE  = sizeof(Overlap) - PSIZE;
   if (tspace <= TRACE_XOVR && tspace != 0)
-    tbytes = sizeof(uint8);
+    TBYTES = sizeof(uint8);
   else
-    tbytes = sizeof(uint16);
-
-  //  Open the output file buffer and write (novl,tspace) header
-
-  { char *pwd, *root;
-
-    pwd    = PathTo(argv[1]);
-    root   = Root(argv[1],".las");
-    output = Fopen(Catenate(pwd,"/",root,".las"),"w");
-    if (output == NULL)
-      exit (1);
-    free(pwd);
-    free(root);
-
-    if (fwrite(&totl,sizeof(int64),1,output) != 1)
-      SYSTEM_READ_ERROR
-    if (fwrite(&tspace,sizeof(int),1,output) != 1)
-      SYSTEM_READ_ERROR
-
-    oblock = block+fway*bsize;
-    optr   = oblock;
-    otop   = oblock + bsize;
-  }
-
-  //  Initialize the heap
-
-  heap = (Overlap **) Malloc(sizeof(Overlap *)*(fway+1),"Allocating heap");
-  ovls = (Overlap *) Malloc(sizeof(Overlap)*fway,"Allocating heap");
-  if (heap == NULL || ovls == NULL)
-    exit (1);
-
-  hsize = 0;
-  for (i = 0; i < fway; i++)
-    { if (in[i].ptr < in[i].top)
-        { ovls[i]     = *((Overlap *) (in[i].ptr - psize));
-          in[i].ptr  += osize;
-          hsize      += 1;
-          heap[hsize] = ovls + i;
-        }
-    }
-
-  if (hsize > 3)
-    { if (MAP_SORT)
-        for (i = hsize/2; i > 1; i--)
-          maheap(i,heap,hsize);
-      else
-        for (i = hsize/2; i > 1; i--)
-          reheap(i,heap,hsize);
-    }
-
-  //  While the heap is not empty do
-
-  while (hsize > 0)
-    { Overlap  *ov;
-      IO_block *src;
-      int64     tsize, span;
-
-      if (MAP_SORT)
-        maheap(1,heap,hsize);
-      else
-        reheap(1,heap,hsize);
-
-      ov  = heap[1];
-      src = in + (ov - ovls);
-
-      do
-        { src->count += 1;
-
-          tsize = ov->path.tlen*tbytes;
-          span  = osize + tsize;
-          if (src->ptr + span > src->top)
-            ovl_reload(src,bsize);
-          if (optr + span > otop)
-            { if (fwrite(oblock,1,optr-oblock,output) != (size_t) (optr-oblock))
-                SYSTEM_READ_ERROR
-              optr = oblock;
-            }
-
-          memmove(optr,((char *) ov) + psize,osize);
-          optr += osize;
-          memmove(optr,src->ptr,tsize);
-          optr += tsize;
+    TBYTES = sizeof(uint16);
+
+  //  While there are more than MAX_FILES files, merge them in groups of at most MAX_FILES
+  //    into temporary files in TEMP_PATH, removing the temporaries of the prior level as
+  //    soon as they have been merged.
+
+  { char **level;
+    int    first, dim, beg, end, k;
+    int    pid;
+
+    pid   = getpid();
+    first = 1;
+    while (fway > MAX_FILES)
+      { dim   = (fway-1)/MAX_FILES + 1;
+        level = (char **) Malloc(sizeof(char *)*dim,"Allocating file name list");
+        if (level == NULL)
+          exit (1);
+
+        if (VERBOSE)
+          { printf("  Merging %d files into %d intermediate files\n",fway,dim);
+            fflush(stdout);
+          }
+
+        for (k = 0; k < dim; k++)
+          { beg = (fway * k) / dim;
+            end = (fway * (k+1)) / dim;
+            level[k] = new_temp(TEMP_PATH,pid);
+            merge_files(names+beg,end-beg,level[k],tspace,NTHREADS,0,0);
+            for (i = beg; i < end; i++)
+              if (first)
+                free(names[i]);
+              else
+                free_temp(names[i]);
+          }
+
+        free(names);
+        names = level;
+        fway  = dim;
+        first = 0;
+      }
 
-          src->ptr += tsize;
-          if (src->ptr >= src->top)
-            { heap[1] = heap[hsize];
-              hsize  -= 1;
-              break;
-            }
-          *ov       = *((Overlap *) (src->ptr - psize));
-          src->ptr += osize;
-        }
-      while (CHAIN_NEXT(ov->flags));
-    }
+    //  Final merge into the target
 
-  //  Flush output buffer and wind up
+    { char *pwd, *root;
 
-  if (optr > oblock)
-    { if (fwrite(oblock,1,optr-oblock,output) != (size_t) (optr-oblock))
-        SYSTEM_READ_ERROR
+      pwd   = PathTo(argv[1]);
+      root  = Root(argv[1],".las");
+      oname = Strdup(Catenate(pwd,"/",root,".las"),"Allocating file name");
+      free(pwd);
+      free(root);
     }
-  fclose(output);
-
-  for (i = 0; i < fway; i++)
-    fclose(in[i].stream);
 
-  for (i = 0; i < fway; i++)
-    totl -= in[i].count;
-  if (totl != 0)
-    { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",argv[0],argv[1],totl);
+    merge_files(names,fway,oname,tspace,NTHREADS,BLOCKED,VERBOSE);
+    if (INDEX > 0 && Write_Las_Index(oname,INDEX))
       exit (1);
-    }
 
-  free(ovls);
-  free(heap);
-  free(in);
-  free(block-psize);
+    for (i = 0; i < fway; i++)
+      if (first)
+        free(names[i]);
+      else
+        free_temp(names[i]);
+    free(names);
+    free(oname);
+  }
 
   exit (0);
 }
@@ -17,14 +17,20 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #undef DEBUG_GAP_IMPROVER
 
 #include "DB.h"
 #include "align.h"
 
+#define IBUFFER  64    //  How many megabytes for each of the two input buffers
+#define CACHE   200    //  How many megabytes for the read cache(s)
+#define ROUND  1024    //  Records per thread displayed in each round
+#define CHUNK    16    //  Records claimed by a thread at a time
+
 static char *Usage[] =
-    { "[-caroU] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] ",
+    { "[-caroU] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] [-T<int(1)>]",
       "    <src1:db|dam> [ <src2:db|dam> ] <align:las> [ <reads:FILE> | <reads:range> ... ]"
     };
 
@@ -34,25 +40,369 @@ static int ORDER(const void *l, const void *r)
   return (x-y);
 }
 
+  //  Display settings and field widths shared by all threads
+
+static int  ALIGN, CARTOON, REFERENCE, OVERLAP;
+static int  INDENT, WIDTH, BORDER, UPPERCASE;
+static int  ISTWO;
+
+static int  tspace, small;
+static int  dam1, dam2;
+static int *amap, *alen, *actg;
+static int *bmap, *blen, *bctg;
+
+static int  ar_wide, br_wide;
+static int  ai_wide, bi_wide;
+static int  ac_wide, bc_wide;
+static int  mn_wide, mx_wide;
+static int  tp_wide;
+
+  //  Reads are fetched through a cache for each DB (one if the DBs are the same) that is
+  //    shared by the threads and into which the reads of each round are prefetched
+
+static DAZZ_CACHE *acache, *bcache;
+
+  //  Each thread has its own read buffers and work data.  When -T > 1 it formats the
+  //    records it claims into its own memory stream.
+
+typedef struct
+  { DAZZ_DB   *db1, *db2;
+    char      *abuffer, *bbuffer;
+    Work_Data *work;
+    FILE      *out;
+    char      *text;
+    size_t     tsize;
+    int        tno;
+  } Show_Arg;
+
+static void show_la(FILE *out, Show_Arg *parm, Overlap *ovl)
+{ DAZZ_DB   *db1 = parm->db1;
+  DAZZ_DB   *db2 = parm->db2;
+  Work_Data *work = parm->work;
+  Alignment  _aln, *aln = &_aln;
+
+  int   aread, bread;
+  int   aoffs, boffs;
+  int   alens, blens;
+  int64 tps;
+
+  aread = ovl->aread;
+  bread = ovl->bread;
+
+  aln->path  = &(ovl->path);
+  aln->alen  = db1->reads[aread].rlen;
+  aln->blen  = db2->reads[bread].rlen;
+  if (dam1)
+    { aoffs = db1->reads[aread].fpulse;
+      alens = alen[aread];
+    }
+  else
+    { aoffs = 0;
+      alens = aln->alen;
+    }
+  if (dam2)
+    { boffs = db2->reads[bread].fpulse;
+      blens = blen[bread];
+    }
+  else
+    { boffs = 0;
+      blens = aln->blen;
+    }
+  aln->flags = ovl->flags;
+  tps        = ovl->path.tlen/2;
+
+  //  If -o check display only overlaps
+
+  if (OVERLAP)
+    { if (ovl->path.abpos+aoffs != 0 && ovl->path.bbpos+boffs != 0)
+        return;
+      if (ovl->path.aepos+aoffs != alens && ovl->path.bepos+boffs != blens)
+        return;
+    }
+
+  //  Display it
+
+  if (ALIGN || CARTOON || REFERENCE)
+    fprintf(out,"\n");
+
+  if (BEST_CHAIN(ovl->flags))
+    fprintf(out,"> ");
+  else if (CHAIN_START(ovl->flags))
+    fprintf(out,"+ ");
+  else if (CHAIN_NEXT(ovl->flags))
+    fprintf(out," -");
+
+  if (dam1)
+    { Print_Number((int64) amap[aread]+1,ar_wide+1,out);
+      fprintf(out,".%0*d",ac_wide,actg[aread]+1);
+    }
+  else
+    Print_Number((int64) aread+1,ar_wide+1,out);
+  fprintf(out,"  ");
+  if (dam2)
+    { Print_Number((int64) bmap[bread]+1,br_wide+1,out);
+      fprintf(out,".%0*d",bc_wide,bctg[bread]+1);
+    }
+  else
+    Print_Number((int64) bread+1,br_wide+1,out);
+  if (COMP(ovl->flags))
+    fprintf(out," c");
+  else
+    fprintf(out," n");
+  if (ovl->path.abpos+aoffs == 0)
+    fprintf(out,"   <");
+  else
+    fprintf(out,"   [");
+  Print_Number((int64) ovl->path.abpos+aoffs,ai_wide,out);
+  fprintf(out,"..");
+  Print_Number((int64) ovl->path.aepos+aoffs,ai_wide,out);
+  if (ovl->path.aepos+aoffs == alens)
+    fprintf(out,"> x ");
+  else
+    fprintf(out,"] x ");
+  if (ovl->path.bbpos+boffs == 0)
+    fprintf(out,"<");
+  else
+    fprintf(out,"[");
+  if (COMP(ovl->flags))
+    { Print_Number((int64) (blens - (ovl->path.bbpos+boffs)),bi_wide,out);
+      fprintf(out,"..");
+      Print_Number((int64) (blens - (ovl->path.bepos+boffs)),bi_wide,out);
+    }
+  else
+    { Print_Number((int64) ovl->path.bbpos+boffs,bi_wide,out);
+      fprintf(out,"..");
+      Print_Number((int64) ovl->path.bepos+boffs,bi_wide,out);
+    }
+  if (ovl->path.bepos+boffs == blens)
+    fprintf(out,">");
+  else
+    fprintf(out,"]");
+
+  if (!CARTOON)
+    fprintf(out,"  ~  %5.2f%% ",(200.*ovl->path.diffs) /
+           ((ovl->path.aepos - ovl->path.abpos) + (ovl->path.bepos - ovl->path.bbpos)) );
+  fprintf(out,"  (");
+  Print_Number(alens,ai_wide,out);
+  fprintf(out," x ");
+  Print_Number(blens,bi_wide,out);
+  fprintf(out," bps,");
+  if (CARTOON)
+    { Print_Number(tps,tp_wide,out);
+      fprintf(out," trace pts)\n\n");
+    }
+  else
+    { Print_Number((int64) ovl->path.diffs,mn_wide,out);
+      fprintf(out," diffs, ");
+      Print_Number(tps,tp_wide,out);
+      fprintf(out," trace pts)\n");
+    }
+
+  if (ALIGN || CARTOON || REFERENCE)
+    { if (ALIGN || REFERENCE)
+        { char *aseq, *bseq;
+          int   amin,  amax;
+          int   bmin,  bmax;
+          int   self;
+
+          if (small)
+            Decompress_TraceTo16(ovl);
+
+          self = (ISTWO == 0) && (aread == bread) && !COMP(ovl->flags);
+
+          amin = ovl->path.abpos - BORDER;
+          if (amin < 0) amin = 0;
+          amax = ovl->path.aepos + BORDER;
+          if (amax > aln->alen) amax = aln->alen;
+          if (COMP(aln->flags))
+            { bmin = (aln->blen-ovl->path.bepos) - BORDER;
+              if (bmin < 0) bmin = 0;
+              bmax = (aln->blen-ovl->path.bbpos) + BORDER;
+              if (bmax > aln->blen) bmax = aln->blen;
+            }
+          else
+            { bmin = ovl->path.bbpos - BORDER;
+              if (bmin < 0) bmin = 0;
+              bmax = ovl->path.bepos + BORDER;
+              if (bmax > aln->blen) bmax = aln->blen;
+              if (self)
+                { if (bmin < amin)
+                    amin = bmin;
+                  if (bmax > amax)
+                    amax = bmax;
+                }
+            }
+
+          aseq = Load_Cached_Subread(acache,aread,amin,amax,parm->abuffer,0);
+          if (!self)
+            bseq = Load_Cached_Subread(bcache,bread,bmin,bmax,parm->bbuffer,0);
+          else
+            bseq = aseq;
+
+          aln->aseq = aseq - amin;
+          if (COMP(aln->flags))
+            { Complement_Seq(bseq,bmax-bmin);
+              aln->bseq = bseq - (aln->blen - bmax);
+            }
+          else if (self)
+            aln->bseq = aln->aseq;
+          else
+            aln->bseq = bseq - bmin;
+
+          if (tspace == 0)
+            Compute_Trace_IRR(aln,work,GREEDIEST);
+          else
+            Compute_Trace_PTS(aln,work,tspace,GREEDIEST);
+          Gap_Improver(aln,work);
+        }
+
+#ifndef DEBUG_GAP_IMPROVER
+      aln->path->abpos += aoffs;
+      aln->path->aepos += aoffs;
+      aln->alen = alens;
+      aln->path->bbpos += boffs;
+      aln->path->bepos += boffs;
+      aln->blen = blens;
+      if (ALIGN || REFERENCE)
+        { int *trace = aln->path->trace;
+          int  tlen  = aln->path->tlen;
+          int  i;
+
+          aln->aseq -= aoffs;
+          aln->bseq -= boffs;
+          for (i = 0; i < tlen; i++)
+            if (trace[i] < 0)
+              trace[i] -= aoffs;
+            else
+              trace[i] += boffs;
+        }
+#endif
+
+      if (CARTOON)
+        Alignment_Cartoon(out,aln,INDENT,mx_wide);
+      if (REFERENCE)
+        Print_Reference(out,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+      if (ALIGN)
+        Print_Alignment(out,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+    }
+}
+
+  //  A round of selected records is displayed by the threads, each claiming CHUNK records
+  //    at a time and noting where the text for each begins and ends in its stream.  The
+  //    main thread then outputs the text of the records in their input order.
+
+static Overlap *Round_Ovl;      //  The records of the current round
+static int     *Round_Tno;      //  Thread that displayed each record
+static long    *Round_Beg;      //  Start and end of each record's text in that thread's stream
+static long    *Round_End;
+static int     *Round_Ids;      //  Read ids to prefetch for the round
+static int      Round_Len;
+static int      Round_Next;
+
+static pthread_mutex_t Round_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *show_thread(void *arg)
+{ Show_Arg *parm = (Show_Arg *) arg;
+  int       i, e;
+
+  parm->out = open_memstream(&parm->text,&parm->tsize);
+  if (parm->out == NULL)
+    { fprintf(stderr,"%s: Cannot open memory stream for thread %d\n",Prog_Name,parm->tno);
+      exit (1);
+    }
+
+  while (1)
+    { pthread_mutex_lock(&Round_Mutex);
+      i = Round_Next;
+      Round_Next += CHUNK;
+      pthread_mutex_unlock(&Round_Mutex);
+      if (i >= Round_Len)
+        break;
+
+      e = i+CHUNK;
+      if (e > Round_Len)
+        e = Round_Len;
+      for ( ; i < e; i++)
+        { Round_Tno[i] = parm->tno;
+          Round_Beg[i] = ftell(parm->out);
+          show_la(parm->out,parm,Round_Ovl+i);
+          Round_End[i] = ftell(parm->out);
+        }
+    }
+
+  if (fclose(parm->out) != 0)
+    { fprintf(stderr,"%s: Cannot close memory stream for thread %d\n",Prog_Name,parm->tno);
+      exit (1);
+    }
+  return (NULL);
+}
+
+static void show_round(int nthreads, Show_Arg *parm, int nrec)
+{ pthread_t threads[nthreads];
+  int       i, t;
+
+  if (acache != NULL)
+    { for (i = 0; i < nrec; i++)
+        Round_Ids[i] = Round_Ovl[i].aread;
+      if (bcache == acache)
+        { for (i = 0; i < nrec; i++)
+            Round_Ids[nrec+i] = Round_Ovl[i].bread;
+          if (Prefetch_Reads(acache,2*nrec,Round_Ids))
+            exit (1);
+        }
+      else
+        { if (Prefetch_Reads(acache,nrec,Round_Ids))
+            exit (1);
+          for (i = 0; i < nrec; i++)
+            Round_Ids[i] = Round_Ovl[i].bread;
+          if (Prefetch_Reads(bcache,nrec,Round_Ids))
+            exit (1);
+        }
+    }
+
+  if (nthreads == 1)
+    { for (i = 0; i < nrec; i++)
+        show_la(stdout,parm,Round_Ovl+i);
+      return;
+    }
+
+  Round_Len  = nrec;
+  Round_Next = 0;
+
+  for (t = 1; t < nthreads; t++)
+    pthread_create(threads+t,NULL,show_thread,parm+t);
+  show_thread(parm);
+  for (t = 1; t < nthreads; t++)
+    pthread_join(threads[t],NULL);
+
+  for (i = 0; i < nrec; i++)
+    { t = Round_Tno[i];
+      if (fwrite(parm[t].text+Round_Beg[i],1,Round_End[i]-Round_Beg[i],stdout)
+               != (size_t) (Round_End[i]-Round_Beg[i]))
+        SYSTEM_WRITE_ERROR
+    }
+
+  for (t = 0; t < nthreads; t++)
+    free(parm[t].text);
+}
+
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1, *db1 = &_db1; 
   DAZZ_DB   _db2, *db2 = &_db2; 
   Overlap   _ovl, *ovl = &_ovl;
-  Alignment _aln, *aln = &_aln;
 
   FILE   *input;
-  int64   novl;
-  int     tspace, tbytes, small;
+  Las_Reader *reader;
+  Las_Index  *pindex;
+  int64   novl, jbeg;
+  int     tbytes;
   int     reps, *pts;
   int     input_pts;
 
-  int     ALIGN, CARTOON, REFERENCE, OVERLAP;
-  int     INDENT, WIDTH, BORDER, UPPERCASE;
-  int     ISTWO;
+  int     nascaff, amaxlen, actgmax;
+  int     nbscaff, bmaxlen, bctgmax;
 
-  int     dam1, dam2;
-  int    *amap, *alen, *actg, nascaff, amaxlen, actgmax;
-  int    *bmap, *blen, *bctg, nbscaff, bmaxlen, bctgmax;
+  int     NTHREADS;
 
   //  Process options
 
@@ -65,6 +415,7 @@ int main(int argc, char *argv[])
     INDENT    = 4;
     WIDTH     = 100;
     BORDER    = 10;
+    NTHREADS  = 1;
 
     j = 1;
     for (i = 1; i < argc; i++)
@@ -82,6 +433,9 @@ int main(int argc, char *argv[])
           case 'b':
             ARG_NON_NEGATIVE(BORDER,"Alignment border")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
         }
       else
         argv[j++] = argv[i];
@@ -107,6 +461,8 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -i: Indent alignments and cartoons by -i.\n");
         fprintf(stderr,"      -w: Width of each row of alignment in symbols (-a) or bps (-r).\n");
         fprintf(stderr,"      -b: # of border bp.s to show on each side of LA.\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -T: Use -T threads to compute and format the LAs.\n");
         exit (1);
       }
   }
@@ -119,6 +475,8 @@ int main(int argc, char *argv[])
     struct stat stat1, stat2;
 
     ISTWO  = 0;
+    nascaff = amaxlen = actgmax = 0;
+    nbscaff = bmaxlen = bctgmax = 0;
     dam1   = Open_DB(argv[1],db1);
     if (dam1 < 0)
       exit (1);
@@ -386,6 +744,28 @@ int main(int argc, char *argv[])
         tbytes = sizeof(uint16);
       }
 
+    //  If reads ranges are given and the file has a pile index, then start at the pile
+    //    of the first read requested and stop after the pile of the last
+
+    pindex = NULL;
+    jbeg  = 0;
+    if ( ! input_pts && pts[0] > 1)
+      { pindex = Open_Las_Index(over);
+        if (pindex != NULL && pindex->novl != novl)
+          { Free_Las_Index(pindex);
+            pindex = NULL;
+          }
+        if (pindex != NULL)
+          { jbeg = Seek_Las_Pile(input,pindex,pts[0]-1);
+            if (jbeg < 0)
+              SYSTEM_READ_ERROR
+          }
+      }
+
+    reader = Open_Las_Reader(input,-1,-1,IBUFFER*1000000ll,tbytes);
+    if (reader == NULL)
+      exit (1);
+
     printf("\n%s: ",root);
     Print_Number(novl,0,stdout);
     printf(" records\n");
@@ -398,33 +778,83 @@ int main(int argc, char *argv[])
   
   { int        j;
     uint16    *trace;
-    Work_Data *work;
     int        tmax;
     int        in, npt, idx, ar;
-    int64      tps;
-
     int        aread, bread;
-    int        aoffs, boffs;
-    int        alens, blens;
-    char      *abuffer, *bbuffer;
-    int        ar_wide, br_wide;
-    int        ai_wide, bi_wide;
-    int        ac_wide, bc_wide;
-    int        mn_wide, mx_wide;
-    int        tp_wide;
-    int        blast, match, seen, lhalf, rhalf;
-
-    aln->path = &(ovl->path);
+    Show_Arg  *parm;
+    uint16    *tarena;
+    int64      tfill, tcap;
+    int        nrec, rmax, batch;
+
+    //  Set up the read caches and the per-thread display state
+
     if (ALIGN || REFERENCE)
-      { work = New_Work_Data();
-        abuffer = New_Read_Buffer(db1);
-        bbuffer = New_Read_Buffer(db2);
+      { acache = Open_Read_Cache(db1,CACHE*1000000ll);
+        if (acache == NULL)
+          exit (1);
+        if (db2 == db1)
+          bcache = acache;
+        else
+          { bcache = Open_Read_Cache(db2,CACHE*1000000ll);
+            if (bcache == NULL)
+              exit (1);
+          }
+      }
+    else
+      acache = bcache = NULL;
+
+    parm = (Show_Arg *) Malloc(sizeof(Show_Arg)*NTHREADS,"Allocating thread records");
+    if (parm == NULL)
+      exit (1);
+
+    for (j = 0; j < NTHREADS; j++)
+      { Show_Arg *p = parm+j;
+
+        p->tno  = j;
+        p->text = NULL;
+        p->db1  = db1;
+        p->db2  = db2;
+        if (ALIGN || REFERENCE)
+          { p->work    = New_Work_Data();
+            p->abuffer = New_Read_Buffer(db1);
+            p->bbuffer = New_Read_Buffer(db2);
+            if (p->work == NULL || p->abuffer == NULL || p->bbuffer == NULL)
+              exit (1);
+          }
+        else
+          { p->abuffer = NULL;
+            p->bbuffer = NULL;
+            p->work    = NULL;
+          }
+      }
+
+    //  With -T > 1, or if reads are needed, selected records and their traces are
+    //    collected into a round whose traces are kept in an arena with room for their
+    //    16-bit expansion, and whose reads are prefetched before it is displayed
+
+    batch = (NTHREADS > 1 || acache != NULL);
+    if (batch)
+      { rmax = ROUND*NTHREADS;
+        Round_Ovl = (Overlap *) Malloc(sizeof(Overlap)*rmax,"Allocating round");
+        Round_Tno = (int *) Malloc(sizeof(int)*3*rmax,"Allocating round");
+        Round_Beg = (long *) Malloc(sizeof(long)*2*rmax,"Allocating round");
+        if (Round_Ovl == NULL || Round_Tno == NULL || Round_Beg == NULL)
+          exit (1);
+        Round_End = Round_Beg + rmax;
+        Round_Ids = Round_Tno + rmax;
+
+        tcap   = 1000*rmax;
+        tarena = (uint16 *) Malloc(sizeof(uint16)*tcap,"Allocating round traces");
+        if (tarena == NULL)
+          exit (1);
       }
     else
-      { abuffer = NULL;
-        bbuffer = NULL;
-        work = NULL;
+      { rmax   = 0;
+        tcap   = 0;
+        tarena = NULL;
       }
+    nrec  = 0;
+    tfill = 0;
 
     tmax  = 1000;
     trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
@@ -478,26 +908,20 @@ int main(int argc, char *argv[])
 
     //  For each record do
 
-    blast = -1;
-    match = 0;
-    seen  = 0;
-    lhalf = rhalf = 0;
-    for (j = 0; j < novl; j++)
+    for (j = jbeg; j < novl; j++)
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+      { Overlap *w;
+
+        w = Next_Las_Record(reader);
+        if (w == NULL)
+          { fprintf(stderr,"%s: .las file has fewer records than its header says\n",Prog_Name);
+            exit (1);
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
 
-        aread = ovl->aread;
-        bread = ovl->bread;
+        aread = w->aread;
+        bread = w->bread;
 
         if (aread >= db1->nreads)
           { fprintf(stderr,"%s: A-read is out-of-range of DB %s\n",Prog_Name,argv[1]);
@@ -532,210 +956,76 @@ int main(int argc, char *argv[])
               }
           }
         if (!in)
-          continue;
-
-        aln->alen  = db1->reads[aread].rlen;
-        aln->blen  = db2->reads[bread].rlen;
-        if (dam1)
-          { aoffs = db1->reads[aread].fpulse;
-            alens = alen[aread];
-          }
-        else
-          { aoffs = 0;
-            alens = aln->alen;
-          }
-        if (dam2)
-          { boffs = db2->reads[bread].fpulse;
-            blens = blen[bread];
-          }
-        else
-          { boffs = 0;
-            blens = aln->blen;
+          { if (pindex != NULL && npt == INT32_MAX)
+              break;
+            continue;
           }
-        aln->flags = ovl->flags;
-        tps        = ovl->path.tlen/2;
 
-        //  If -o check display only overlaps
+        //  Display it now, or add it to the current round
 
-        if (OVERLAP)
-          { if (ovl->path.abpos+aoffs != 0 && ovl->path.bbpos+boffs != 0)
-              continue;
-            if (ovl->path.aepos+aoffs != alens && ovl->path.bepos+boffs != blens)
-              continue;
-          }
+        if (!batch)
+          { *ovl = *w;
+            if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            ovl->path.trace = (void *) trace;
+            memcpy(trace,(void *) (w+1),ovl->path.tlen*tbytes);
 
-        //  Display it
-            
-        if (ALIGN || CARTOON || REFERENCE)
-          printf("\n");
-
-        if (BEST_CHAIN(ovl->flags))
-          printf("> ");
-        else if (CHAIN_START(ovl->flags))
-          printf("+ ");
-        else if (CHAIN_NEXT(ovl->flags))
-          printf(" -");
-
-        if (dam1)
-          { Print_Number((int64) amap[aread]+1,ar_wide+1,stdout);
-            printf(".%0*d",ac_wide,actg[aread]+1);
-          }
-        else
-          Print_Number((int64) aread+1,ar_wide+1,stdout);
-        printf("  ");
-        if (dam2)
-          { Print_Number((int64) bmap[bread]+1,br_wide+1,stdout);
-            printf(".%0*d",bc_wide,bctg[bread]+1);
-          }
-        else
-          Print_Number((int64) bread+1,br_wide+1,stdout);
-        if (COMP(ovl->flags))
-          printf(" c");
-        else
-          printf(" n");
-        if (ovl->path.abpos+aoffs == 0)
-          printf("   <");
-        else
-          printf("   [");
-        Print_Number((int64) ovl->path.abpos+aoffs,ai_wide,stdout);
-        printf("..");
-        Print_Number((int64) ovl->path.aepos+aoffs,ai_wide,stdout);
-        if (ovl->path.aepos+aoffs == alens)
-          printf("> x ");
-        else
-          printf("] x ");
-        if (ovl->path.bbpos+boffs == 0)
-          printf("<");
-        else
-          printf("[");
-        if (COMP(ovl->flags))
-          { Print_Number((int64) (blens - (ovl->path.bbpos+boffs)),bi_wide,stdout);
-            printf("..");
-            Print_Number((int64) (blens - (ovl->path.bepos+boffs)),bi_wide,stdout);
-          }
-        else
-          { Print_Number((int64) ovl->path.bbpos+boffs,bi_wide,stdout);
-            printf("..");
-            Print_Number((int64) ovl->path.bepos+boffs,bi_wide,stdout);
-          }
-        if (ovl->path.bepos+boffs == blens)
-          printf(">");
-        else
-          printf("]");
-
-        if (!CARTOON)
-          printf("  ~  %5.2f%% ",(200.*ovl->path.diffs) /
-                 ((ovl->path.aepos - ovl->path.abpos) + (ovl->path.bepos - ovl->path.bbpos)) );
-        printf("  (");
-        Print_Number(alens,ai_wide,stdout);
-        printf(" x ");
-        Print_Number(blens,bi_wide,stdout);
-        printf(" bps,");
-        if (CARTOON)
-          { Print_Number(tps,tp_wide,stdout);
-            printf(" trace pts)\n\n");
+            show_la(stdout,parm,ovl);
           }
         else
-          { Print_Number((int64) ovl->path.diffs,mn_wide,stdout);
-            printf(" diffs, ");
-            Print_Number(tps,tp_wide,stdout);
-            printf(" trace pts)\n");
+          { if (nrec >= rmax || tfill + w->path.tlen > tcap)
+              { show_round(NTHREADS,parm,nrec);
+                nrec  = 0;
+                tfill = 0;
+              }
+            if (w->path.tlen > tcap)
+              { tcap   = ((int64) (1.2*w->path.tlen)) + 100;
+                tarena = (uint16 *) Realloc(tarena,sizeof(uint16)*tcap,
+                                            "Allocating round traces");
+                if (tarena == NULL)
+                  exit (1);
+              }
+            Round_Ovl[nrec] = *w;
+            Round_Ovl[nrec].path.trace = (void *) (tarena+tfill);
+            memcpy(tarena+tfill,(void *) (w+1),w->path.tlen*tbytes);
+            tfill += w->path.tlen;
+            nrec  += 1;
           }
+      }
 
-        if (ALIGN || CARTOON || REFERENCE)
-          { if (ALIGN || REFERENCE)
-              { char *aseq, *bseq;
-                int   amin,  amax;
-                int   bmin,  bmax;
-                int   self;
-
-                if (small)
-                  Decompress_TraceTo16(ovl);
-
-                self = (ISTWO == 0) && (aread == bread) && !COMP(ovl->flags);
-
-                amin = ovl->path.abpos - BORDER;
-                if (amin < 0) amin = 0;
-                amax = ovl->path.aepos + BORDER;
-                if (amax > aln->alen) amax = aln->alen;
-                if (COMP(aln->flags))
-                  { bmin = (aln->blen-ovl->path.bepos) - BORDER;
-                    if (bmin < 0) bmin = 0;
-                    bmax = (aln->blen-ovl->path.bbpos) + BORDER;
-                    if (bmax > aln->blen) bmax = aln->blen;
-                  }
-                else
-                  { bmin = ovl->path.bbpos - BORDER;
-                    if (bmin < 0) bmin = 0;
-                    bmax = ovl->path.bepos + BORDER;
-                    if (bmax > aln->blen) bmax = aln->blen;
-                    if (self)
-                      { if (bmin < amin)
-                          amin = bmin;
-                        if (bmax > amax)
-                          amax = bmax;
-                      }
-                  }
-
-                aseq = Load_Subread(db1,aread,amin,amax,abuffer,0);
-                if (!self)
-                  bseq = Load_Subread(db2,bread,bmin,bmax,bbuffer,0);
-                else
-                  bseq = aseq;
+    if (nrec > 0)
+      show_round(NTHREADS,parm,nrec);
 
-                aln->aseq = aseq - amin;
-                if (COMP(aln->flags))
-                  { Complement_Seq(bseq,bmax-bmin);
-                    aln->bseq = bseq - (aln->blen - bmax);
-                  }
-                else if (self)
-                  aln->bseq = aln->aseq;
-                else
-                  aln->bseq = bseq - bmin;
-
-                if (tspace == 0)
-                  Compute_Trace_IRR(aln,work,GREEDIEST);
-                else
-                  Compute_Trace_PTS(aln,work,tspace,GREEDIEST);
-                Gap_Improver(aln,work);
-              }
+    Close_Las_Reader(reader);
+    fclose(input);
+    if (pindex != NULL)
+      Free_Las_Index(pindex);
 
-#ifndef DEBUG_GAP_IMPROVER
-            aln->path->abpos += aoffs;
-            aln->path->aepos += aoffs;
-            aln->alen = alens;
-            aln->path->bbpos += boffs;
-            aln->path->bepos += boffs;
-            aln->blen = blens;
-            if (ALIGN || REFERENCE)
-              { int *trace = aln->path->trace;
-                int  tlen  = aln->path->tlen;
-                int  i;
-
-                aln->aseq -= aoffs;
-                aln->bseq -= boffs;
-                for (i = 0; i < tlen; i++)
-                  if (trace[i] < 0)
-                    trace[i] -= aoffs;
-                  else
-                    trace[i] += boffs;
-              }
-#endif
+    free(trace);
+    if (batch)
+      { free(tarena);
+        free(Round_Beg);
+        free(Round_Tno);
+        free(Round_Ovl);
+      }
+    for (j = 0; j < NTHREADS; j++)
+      { Show_Arg *p = parm+j;
 
-            if (CARTOON)
-              Alignment_Cartoon(stdout,aln,INDENT,mx_wide);
-            if (REFERENCE)
-              Print_Reference(stdout,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
-            if (ALIGN)
-              Print_Alignment(stdout,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+        if (ALIGN || REFERENCE)
+          { free(p->bbuffer-1);
+            free(p->abuffer-1);
+            Free_Work_Data(p->work);
           }
       }
-
-    free(trace);
-    if (ALIGN)
-      { free(bbuffer-1);
-        free(abuffer-1);
-        Free_Work_Data(work);
+    free(parm);
+    if (acache != NULL)
+      { if (bcache != acache)
+          Close_Read_Cache(bcache);
+        Close_Read_Cache(acache);
       }
   }
 
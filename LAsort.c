@@ -15,203 +15,796 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <signal.h>
 
 #include "DB.h"
 #include "align.h"
+#include "thread.pool.h"
+#include "lsd.sort.h"
 
-static char *Usage = "[-va] <align:las> ...";
+static char *Usage = "[-va] [-T<int(4)>] [-M<GB>] [-P<dir(/tmp)>] [-I<int>] <align:las> ...";
 
 #define MEMORY   1000   //  How many megabytes for output buffer
 
-static char *IBLOCK;
+#define MAX_RUNS  250   //  Maximum # of sorted runs merged at one time
+#define RUN_CHUNK  64   //  How many megabytes to read at a time when filling a run
 
-static int SORT_OVL(const void *x, const void *y)
-{ int64 l = *((int64 *) x);
-  int64 r = *((int64 *) y);
+#define NKEYS       8   //  # of integer fields in a sort key
 
-  Overlap *ol, *or;
-  int      al, ar;
+//  Sorting is performed with the threaded radix sort of lsd.sort.c on records that consist
+//    of the int64 offset of an overlap in the input block followed by a packed key.  The key
+//    has the NKEYS fields of the pile or map order (see GET_KEY), most significant first, each
+//    offset by its minimum value and stored little-endian in only as many bytes as are needed
+//    to hold its range of values.  As the radix sort is stable and the records are initially
+//    in offset order, ties are broken by the position of the overlap in the file.
+
+static int     NTHREADS;    //  # of threads to use
+static Thread_Pool *POOL;   //  ... in this pool
+static int     MAP_ORDER;   //  Sort in map order (aread,abpos,bread,...) as opposed to pile order
+
+static char   *IBLOCK;      //  Input block (at ptrsize past its start)
+static char   *IEND;        //  End of input block less ptrsize
+static int64   OVLSIZE;     //  Size of an overlap record on disk
+static int     TBYTES;      //  Size of a trace element
+
+static int64   MEM_BUDGET;  //  Memory budget in bytes (0 => unlimited)
+static char   *TEMP_PATH;   //  Directory for sorted runs of an external sort
+static int     INDEX;       //  Pile index sampling interval (0 => no index)
+
+static int     RSIZE;        //  Span of a sort record
+static int     KMIN[NKEYS];  //  Minimum value of each key field
+static int     KLEN[NKEYS];  //  # of bytes to encode (value - minimum) of each key field
+static int     KPOS[NKEYS];  //  Position of each key field in a sort record
+
+#define KEY_MEMORY  ((int64) (2*(sizeof(int64)+NKEYS*sizeof(int))))  //  Max. sort bytes per overlap
+
+static inline void GET_KEY(Overlap *o, int *key)
+{ key[0] = o->aread;
+  if (MAP_ORDER)
+    { key[1] = o->path.abpos;
+      key[2] = o->bread;
+      key[3] = COMP(o->flags);
+    }
+  else
+    { key[1] = o->bread;
+      key[2] = COMP(o->flags);
+      key[3] = o->path.abpos;
+    }
+  key[4] = o->path.aepos;
+  key[5] = o->path.bbpos;
+  key[6] = o->path.bepos;
+  key[7] = o->path.diffs;
+}
+
+//  Fill in the packed keys of sort records [beg,end) given the offsets in perm
+
+typedef struct
+  { int64  beg;
+    int64  end;
+    int64 *perm;
+    uint8 *sort;
+  } Key_Arg;
+
+static void *key_thread(void *arg)
+{ Key_Arg *data = (Key_Arg *) arg;
+  int64   *perm = data->perm;
+  uint8   *rec  = data->sort + data->beg*RSIZE;
+
+  int64    j;
+  int      f, b, key[NKEYS];
+  uint32   v;
+
+  for (j = data->beg; j < data->end; j++)
+    { *((int64 *) rec) = perm[j];
+      GET_KEY((Overlap *) (IBLOCK+perm[j]),key);
+      for (f = 0; f < NKEYS; f++)
+        { v = (uint32) (key[f] - KMIN[f]);
+          for (b = 0; b < KLEN[f]; b++)
+            { rec[KPOS[f]+b] = (uint8) v;
+              v >>= 8;
+            }
+        }
+      rec += RSIZE;
+    }
+  return (NULL);
+}
+
+//  Output the chains of sort records [beg,end) in order, always removing duplicates.  The output
+//    is computed in two passes: the first determines the number of records and bytes that
+//    will be output, and after the file position of each segment has been determined by
+//    a prefix sum, the second fills the thread's buffer and writes it at said position.
+
+typedef struct
+  { int64  beg;
+    int64  end;
+    uint8 *sort;
+    int64  novl;     //  # of records output
+    int64  nbyte;    //  # of bytes output
+    int64  where;    //  File position at which to write output
+    char  *buffer;   //  Output buffer for this thread
+    int64  bsize;    //  and its size
+    int    fd;       //  Output file descriptor
+  } Out_Arg;
+
+static int EQUAL(Overlap *ol, Overlap *or)
+{ int      al, ar;
   int      bl, br;
   int      cl, cr;
   int      pl, pr;
 
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
-
   al = ol->aread;
   ar = or->aread;
   if (al != ar)
-    return (al-ar);
+    return (0);
 
   bl = ol->bread;
   br = or->bread;
   if (bl != br)
-    return (bl-br);
+    return (0);
 
   cl = COMP(ol->flags);
   cr = COMP(or->flags);
   if (cl != cr)
-    return (cl-cr);
+    return (0);
 
   pl = ol->path.abpos;
   pr = or->path.abpos;
   if (pl != pr)
-    return (pl-pr);
+    return (0);
 
   pl = ol->path.aepos;
   pr = or->path.aepos;
   if (pl != pr)
-    return (pl-pr);
+    return (0);
 
   pl = ol->path.bbpos;
   pr = or->path.bbpos;
   if (pl != pr)
-    return (pl-pr);
+    return (0);
 
   pl = ol->path.bepos;
   pr = or->path.bepos;
   if (pl != pr)
-    return (pl-pr);
+    return (0);
 
-  pl = ol->path.diffs;
-  pr = or->path.diffs;
-  if (pl != pr)
-    return (pl-pr);
+  return (1);
+}
+
+static void *out_thread(void *arg)
+{ Out_Arg *data   = (Out_Arg *) arg;
+  int64    ptrsize = sizeof(void *);
+  char    *iblock  = IBLOCK;
+  char    *iend    = IEND;
+  int64    ovlsize = OVLSIZE;
+  int      tbytes  = TBYTES;
+  uint8   *sort    = data->sort;
+  int      write   = (data->buffer != NULL);
+
+  int      equal;
+  int64    j, novl, nbyte;
+  Overlap *w, *x, y;
+  int64    tsize, span;
+  char    *fptr, *ftop, *wo;
+
+  //  Establish the last record output before this segment
+
+  if (data->beg == 0)
+    { y.aread = ((Overlap *) (iblock + *((int64 *) sort)))->aread+1;
+      x = &y;
+    }
+  else
+    { x = (Overlap *) (wo = iblock + *((int64 *) (sort + (data->beg-1)*RSIZE)));
+      while (1)
+        { wo += ovlsize + x->path.tlen*tbytes;
+          if (wo >= iend || ! CHAIN_NEXT(((Overlap *) wo)->flags))
+            break;
+          x = (Overlap *) wo;
+        }
+    }
+
+  novl  = 0;
+  nbyte = 0;
+  fptr  = data->buffer;
+  ftop  = data->buffer + data->bsize;
+  for (j = data->beg; j < data->end; j++)
+    { w = (Overlap *) (wo = iblock + *((int64 *) (sort + j*RSIZE)));
+      do
+        { equal = EQUAL(w,x);
+          tsize = w->path.tlen*tbytes;
+          span  = ovlsize + tsize;
+          if ( ! equal)
+            { novl  += 1;
+              if (write)
+                { if (fptr + span > ftop)
+                    { if (pwrite(data->fd,data->buffer,fptr-data->buffer,data->where)
+                                != (ssize_t) (fptr-data->buffer))
+                        SYSTEM_WRITE_ERROR
+                      data->where += fptr-data->buffer;
+                      fptr = data->buffer;
+                    }
+                  memmove(fptr,((char *) w)+ptrsize,ovlsize);
+                  fptr += ovlsize;
+                  memmove(fptr,(char *) (w+1),tsize);
+                  fptr += tsize;
+                }
+              else
+                nbyte += span;
+            }
+          x = w;
+          w = (Overlap *) (wo += span);
+        }
+      while (wo < iend && CHAIN_NEXT(w->flags));
+    }
+  if (write && fptr > data->buffer)
+    { if (pwrite(data->fd,data->buffer,fptr-data->buffer,data->where)
+                != (ssize_t) (fptr-data->buffer))
+        SYSTEM_WRITE_ERROR
+    }
+
+  data->novl  = novl;
+  data->nbyte = nbyte;
+  return (NULL);
+}
+
+//  Sort the novl overlaps in the size bytes of iblock (that must have sizeof(void *) bytes
+//    available before it) and write them as a .las file with trace spacing tspace to foutput,
+//    using fblock of osize bytes for output buffers.  If chain then sort chains on the basis
+//    of their first LA.  Duplicates are removed.  Return the # of LAs written.
 
-  if (ol < or)
-    return (-1);
-  else if (ol > or)
-    return (1);
+static int64 sort_block(char *iblock, int64 size, int64 novl, int tspace, int chain,
+                        FILE *foutput, char *fblock, int64 osize)
+{ int64    *perm;
+  uint8    *sort, *rez;
+  int64     sov, ptrsize, ovlsize;
+  int       tbytes;
+
+  ptrsize = sizeof(void *);
+  ovlsize = sizeof(Overlap) - ptrsize;
+  if (tspace <= TRACE_XOVR && tspace != 0)
+    tbytes = sizeof(uint8);
   else
+    tbytes = sizeof(uint16);
+
+  if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+  if (fwrite(&tspace,sizeof(int),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+  if (novl == 0)
     return (0);
+
+  //  Set up unsorted permutation array and determine the range of each key field
+
+  perm = (int64 *) Malloc(sizeof(int64)*novl,"Allocating LAsort permutation vector");
+  if (perm == NULL)
+    exit (1);
+
+  { int64 off;
+    int   j, f;
+    int   key[NKEYS], kmax[NKEYS];
+
+    for (f = 0; f < NKEYS; f++)
+      { KMIN[f] = 0x7fffffff;
+        kmax[f] = -0x7fffffff;
+      }
+    sov = 0;
+    off = -ptrsize;
+    for (j = 0; j < novl; j++)
+      { if ( ! chain || CHAIN_START(((Overlap *) (iblock+off))->flags))
+          { perm[sov++] = off;
+            GET_KEY((Overlap *) (iblock+off),key);
+            for (f = 0; f < NKEYS; f++)
+              { if (key[f] < KMIN[f])
+                  KMIN[f] = key[f];
+                if (key[f] > kmax[f])
+                  kmax[f] = key[f];
+              }
+          }
+        off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
+      }
+
+    RSIZE = sizeof(int64);
+    for (f = 0; f < NKEYS; f++)
+      { uint32 range = (uint32) (kmax[f] - KMIN[f]);
+
+        KPOS[f] = RSIZE;
+        for (KLEN[f] = 0; range != 0; KLEN[f]++)
+          range >>= 8;
+        RSIZE += KLEN[f];
+      }
+    RSIZE = ((RSIZE-1)/sizeof(int64)+1)*sizeof(int64);
+  }
+
+  IBLOCK  = iblock;
+  IEND    = iblock + (size - ptrsize);
+  OVLSIZE = ovlsize;
+  TBYTES  = tbytes;
+
+  //  Build the sort records in parallel and radix sort them on the bytes of their
+  //    keys from least to most significant
+
+  { Key_Arg   parmk[NTHREADS];
+    uint8    *trg;
+    int       bytes[NKEYS*sizeof(int)+1];
+    int       j, f, b;
+
+    sort = (uint8 *) Malloc(sov*RSIZE,"Allocating LAsort sort records");
+    if (sort == NULL)
+      exit (1);
+
+    for (j = 0; j < NTHREADS; j++)
+      { parmk[j].beg  = (sov*j)/NTHREADS;
+        parmk[j].end  = (sov*(j+1))/NTHREADS;
+        parmk[j].perm = perm;
+        parmk[j].sort = sort;
+      }
+    Pool_For(POOL,"keys",key_thread,parmk,sizeof(Key_Arg),NTHREADS);
+
+    free(perm);
+
+    j = 0;
+    for (f = NKEYS-1; f >= 0; f--)
+      for (b = 0; b < KLEN[f]; b++)
+        bytes[j++] = KPOS[f]+b;
+    bytes[j] = -1;
+
+    if (j > 0)
+      { trg = (uint8 *) Malloc(sov*RSIZE,"Allocating LAsort sort records");
+        if (trg == NULL)
+          exit (1);
+        rez = (uint8 *) LSD_Sort(sov,sort,trg,RSIZE,RSIZE,bytes);
+        if (rez == sort)
+          free(trg);
+        else
+          { free(sort);
+            sort = rez;
+          }
+      }
+  }
+
+  //  Output the records in sorted order, each thread preparing and writing the
+  //    output for a contiguous segment of the sorted records
+
+  { Out_Arg   parmo[NTHREADS];
+    int64     where;
+    int       j;
+
+    fflush(foutput);
+    for (j = 0; j < NTHREADS; j++)
+      { parmo[j].beg    = (sov*j)/NTHREADS;
+        parmo[j].end    = (sov*(j+1))/NTHREADS;
+        parmo[j].sort   = sort;
+        parmo[j].buffer = NULL;
+        parmo[j].fd     = fileno(foutput);
+      }
+
+    Pool_For(POOL,"output",out_thread,parmo,sizeof(Out_Arg),NTHREADS);
+
+    novl  = 0;
+    where = sizeof(int64) + sizeof(int);
+    for (j = 0; j < NTHREADS; j++)
+      { parmo[j].where  = where;
+        parmo[j].buffer = fblock + j*(osize/NTHREADS);
+        parmo[j].bsize  = osize/NTHREADS;
+        where += parmo[j].nbyte;
+        novl  += parmo[j].novl;
+      }
+
+    Pool_For(POOL,"output",out_thread,parmo,sizeof(Out_Arg),NTHREADS);
+  }
+
+  free(sort);
+
+  rewind(foutput);
+  if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+  fseeko(foutput,0,SEEK_END);
+
+  return (novl);
 }
 
-static int SORT_MAP(const void *x, const void *y)
-{ int64 l = *((int64 *) x);
-  int64 r = *((int64 *) y);
+//  External sort:  A file that does not fit within the memory budget is cut into runs that
+//    do, each run is sorted and written to a temporary file in TEMP_PATH, and then the runs
+//    are merged with a heap, at most MAX_RUNS at a time.  A run always begins with the start
+//    of a chain and runs are kept in file order so that the result is identical to that of
+//    an in-memory sort.
 
-  Overlap *ol, *or;
-  int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
+typedef struct
+  { FILE       *stream;
+    Las_Reader *reader;
+    Overlap    *rec;     //  Current record of the run
+    int         run;     //  Index of run (for tie-breaking)
+  } Run_IO;
 
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
+static int64 RUN_BSIZE;   //  Size of each run buffer
+static int   RUN_PID;     //  Process id for naming runs
 
-  al = ol->aread;
-  ar = or->aread;
-  if (al != ar)
-    return (al-ar);
+static char *Run_Name(int run)
+{ static char name[20];
 
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
-  if (pl != pr)
-    return (pl-pr);
+  sprintf(name,"LS%d.%d",RUN_PID,run);
+  return (Catenate(TEMP_PATH,"/",name,".las"));
+}
 
-  bl = ol->bread;
-  br = or->bread;
-  if (bl != br)
-    return (bl-br);
+  //  Runs [0,RUN_TOP) may exist, and OUT_PART if not NULL is a sorted file not yet completely
+  //    written.  They are removed at exit or on a fatal signal.
 
-  cl = COMP(ol->flags);
-  cr = COMP(or->flags);
-  if (cl != cr)
-    return (cl-cr);
+static int   RUN_TOP  = 0;
+static char *RUN_PATH = NULL;   //  Buffer for their names
+static char *OUT_PART = NULL;
 
-  pl = ol->path.aepos;
-  pr = or->path.aepos;
-  if (pl != pr)
-    return (pl-pr);
+static void clean_runs()
+{ int i;
 
-  pl = ol->path.bbpos;
-  pr = or->path.bbpos;
-  if (pl != pr)
-    return (pl-pr);
+  for (i = 0; i < RUN_TOP; i++)
+    { sprintf(RUN_PATH,"%s/LS%d.%d.las",TEMP_PATH,RUN_PID,i);
+      unlink(RUN_PATH);
+    }
+  if (OUT_PART != NULL)
+    unlink(OUT_PART);
+}
 
-  pl = ol->path.bepos;
-  pr = or->path.bepos;
-  if (pl != pr)
-    return (pl-pr);
+static void clean_signal(int sig)
+{ clean_runs();
+  signal(sig,SIG_DFL);
+  raise(sig);
+}
 
-  pl = ol->path.diffs;
-  pr = or->path.diffs;
-  if (pl != pr)
-    return (pl-pr);
+static void catch_exits()
+{ if (RUN_PATH == NULL)
+    { RUN_PATH = (char *) Malloc(strlen(TEMP_PATH)+50,"Allocating run name");
+      if (RUN_PATH == NULL)
+        exit (1);
+      atexit(clean_runs);
+      signal(SIGINT,clean_signal);
+      signal(SIGTERM,clean_signal);
+      signal(SIGHUP,clean_signal);
+    }
+}
 
-  if (ol < or)
-    return (-1);
-  else if (ol > or)
-    return (1);
-  else
-    return (0);
+static FILE *new_run(int run)
+{ FILE *f;
+
+  catch_exits();
+  if (run >= RUN_TOP)
+    RUN_TOP = run+1;
+  f = Fopen(Run_Name(run),"w");
+  if (f == NULL)
+    exit (1);
+  return (f);
 }
 
-static int EQUAL(Overlap *ol, Overlap *or)
-{ int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
+  //  Advance to the next record of a run, return 0 if at end of the run
 
-  al = ol->aread;
-  ar = or->aread;
-  if (al != ar)
-    return (0);
+static int run_next(Run_IO *in)
+{ in->rec = Next_Las_Record(in->reader);
+  return (in->rec != NULL);
+}
 
-  bl = ol->bread;
-  br = or->bread;
-  if (bl != br)
-    return (0);
+  //  Does record of run l precede that of run r in sort order?
 
-  cl = COMP(ol->flags);
-  cr = COMP(or->flags);
-  if (cl != cr)
-    return (0);
+static int run_less(Run_IO *l, Run_IO *r)
+{ int kl[NKEYS], kr[NKEYS];
+  int f;
 
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
-  if (pl != pr)
-    return (0);
+  GET_KEY(l->rec,kl);
+  GET_KEY(r->rec,kr);
+  for (f = 0; f < NKEYS; f++)
+    if (kl[f] != kr[f])
+      return (kl[f] < kr[f]);
+  return (l->run < r->run);
+}
 
-  pl = ol->path.aepos;
-  pr = or->path.aepos;
-  if (pl != pr)
-    return (0);
+static void run_heap(int s, Run_IO **heap, int hsize)
+{ int     c, l, r;
+  Run_IO *hs, *hl, *hr;
+
+  c  = s;
+  hs = heap[s];
+  while ((l = 2*c) <= hsize)
+    { r  = l+1;
+      hl = heap[l];
+      if (r <= hsize)
+        { hr = heap[r];
+          if (run_less(hr,hl))
+            { hl = hr;
+              l  = r;
+            }
+        }
+      if (run_less(hl,hs))
+        { heap[c] = hl;
+          c = l;
+        }
+      else
+        break;
+    }
+  if (c != s)
+    heap[c] = hs;
+}
 
-  pl = ol->path.bbpos;
-  pr = or->path.bbpos;
-  if (pl != pr)
-    return (0);
+  //  Merge runs [beg,end) into foutput, removing duplicates if unique.  Each run is read with
+  //    a pair of RUN_BSIZE/2 buffers and fblock of osize bytes is the output buffer.  Return
+  //    # of LAs written.
+
+static int64 merge_runs(int beg, int end, int tspace, int chain, int unique,
+                        FILE *foutput, char *fblock, int64 osize)
+{ Run_IO   in[MAX_RUNS];
+  Run_IO  *heap[MAX_RUNS+1];
+  int      hsize;
+  int64    novl;
+  Overlap *w, x;
+  int64    span;
+  char    *fptr, *ftop;
+  int      i;
+
+  novl = 0;
+  if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+  if (fwrite(&tspace,sizeof(int),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+
+  hsize = 0;
+  for (i = beg; i < end; i++)
+    { Run_IO *r = in + (i-beg);
+
+      r->stream = Fopen(Run_Name(i),"r");
+      if (r->stream == NULL)
+        exit (1);
+      if (fseeko(r->stream,sizeof(int64)+sizeof(int),SEEK_SET) != 0)
+        SYSTEM_READ_ERROR
+      r->reader = Open_Las_Reader(r->stream,-1,-1,RUN_BSIZE/2,TBYTES);
+      if (r->reader == NULL)
+        exit (1);
+      r->run = i;
+      if (run_next(r))
+        heap[++hsize] = r;
+      else
+        { Close_Las_Reader(r->reader);
+          fclose(r->stream);
+        }
+    }
+  for (i = hsize/2; i >= 1; i--)
+    run_heap(i,heap,hsize);
+
+  memset(&x,0,sizeof(Overlap));
+  x.aread = -1;
+  fptr    = fblock;
+  ftop    = fblock + osize;
+  while (hsize > 0)
+    { Run_IO *r = heap[1];
+
+      do
+        { w    = r->rec;
+          span = OVLSIZE + w->path.tlen*TBYTES;
+          if ( ! unique || ! EQUAL(w,&x))
+            { if (fptr + span > ftop)
+                { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
+                    SYSTEM_WRITE_ERROR
+                  fptr = fblock;
+                }
+              memmove(fptr,((char *) w) + sizeof(void *),span);
+              fptr += span;
+              novl += 1;
+            }
+          x = *w;
+          if ( ! run_next(r))
+            { Close_Las_Reader(r->reader);
+              fclose(r->stream);
+              heap[1] = heap[hsize--];
+              break;
+            }
+        }
+      while (chain && CHAIN_NEXT(r->rec->flags));
 
-  pl = ol->path.bepos;
-  pr = or->path.bepos;
-  if (pl != pr)
-    return (0);
+      if (hsize > 0)
+        run_heap(1,heap,hsize);
+    }
+  if (fptr > fblock)
+    { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
+        SYSTEM_WRITE_ERROR
+    }
 
-  return (1);
+  rewind(foutput);
+  if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
+    SYSTEM_WRITE_ERROR
+  fseeko(foutput,0,SEEK_END);
+
+  for (i = beg; i < end; i++)
+    unlink(Run_Name(i));
+
+  return (novl);
+}
+
+  //  Sort the novl LAs remaining in input into foutput within the memory budget.  iblock
+  //    is a buffer of isize bytes (with sizeof(void *) bytes available before it) that is
+  //    freed once the runs are formed so that its space can go to the run readers.  Return
+  //    the # of LAs written and the number of runs in *nruns.  If reader is not NULL then
+  //    the input is blocked and the records are read through it.
+
+static int64 sort_external(FILE *input, Las_Reader *reader, int64 novl, int tspace, FILE *foutput,
+                           char *iblock, int64 isize, char *fblock, int64 osize, int *nruns)
+{ int64 top, scan, cut, cnt, ccnt, span, mspan;
+  int64 chunk, nread;
+  int   chain, eof;
+  int   nrun, beg, end;
+
+  chain = -1;
+  mspan = 0;
+  nrun  = 0;
+  top   = 0;
+  eof   = 0;
+  chunk = RUN_CHUNK * 1000000ll;
+  while ( ! eof || top > 0)
+    {
+      //  Read LAs until the next would exceed the budget, cut at the start of the last chain
+
+      scan = cut = 0;
+      cnt  = ccnt = 0;
+      while (1)
+        { if (top - scan >= OVLSIZE)
+            span = OVLSIZE + ((Overlap *) (iblock + (scan - sizeof(void *))))->path.tlen*TBYTES;
+          else
+            span = OVLSIZE;
+          if (top - scan < span)
+            { if (eof)
+                break;
+              nread = isize - top;
+              if (nread > chunk)
+                nread = chunk;
+              if (nread <= 0)
+                break;
+              if (reader != NULL)
+                nread = Read_Las_Bytes(reader,iblock+top,nread);
+              else
+                nread = fread(iblock+top,1,nread,input);
+              if (nread == 0)
+                eof = 1;
+              top += nread;
+              continue;
+            }
+          if (scan + span + (cnt+1)*KEY_MEMORY > isize)
+            break;
+          if (chain < 0)
+            chain = CHAIN_START(((Overlap *) (iblock - sizeof(void *)))->flags);
+          if ( ! chain || CHAIN_START(((Overlap *) (iblock + (scan - sizeof(void *))))->flags))
+            { cut  = scan;
+              ccnt = cnt;
+            }
+          if (span > mspan)
+            mspan = span;
+          scan += span;
+          cnt  += 1;
+        }
+      if (eof && scan == top)
+        { cut  = scan;
+          ccnt = cnt;
+        }
+      if (ccnt == 0)
+        { if (top == 0)
+            break;
+          fprintf(stderr,"%s: Memory budget too small for a chain or LA of the input\n",Prog_Name);
+          exit (1);
+        }
+
+      //  Sort the run into a temporary file and move the remainder to the front of iblock
+
+      { FILE *run;
+
+        run = new_run(nrun);
+        sort_block(iblock,cut,ccnt,tspace,chain,run,fblock,osize);
+        fclose(run);
+        nrun += 1;
+
+        novl -= ccnt;
+        top  -= cut;
+        if (top > 0)
+          memmove(iblock,iblock+cut,top);
+      }
+    }
+  if (novl != 0)
+    { fprintf(stderr,"%s: LA count in header does not match the file contents\n",Prog_Name);
+      exit (1);
+    }
+  *nruns = nrun;
+  if (chain < 0)
+    chain = 0;
+
+  //  Merge the runs, MAX_RUNS at a time into new runs until at most MAX_RUNS remain
+
+  free(iblock - sizeof(void *));
+
+  beg = 0;
+  end = nrun;
+  while (1)
+    { int   w, k;
+      FILE *run;
+
+      w = end-beg;
+      if (w > MAX_RUNS)
+        w = MAX_RUNS;
+      RUN_BSIZE = isize/w - sizeof(void *);
+      if (RUN_BSIZE < 2*mspan)
+        { fprintf(stderr,"%s: Memory budget too small to merge %d runs\n",Prog_Name,w);
+          exit (1);
+        }
+      if (end-beg <= MAX_RUNS)
+        break;
+
+      for (k = beg; k < end; k += MAX_RUNS)
+        { run = new_run(nrun);
+          merge_runs(k,(k+MAX_RUNS < end ? k+MAX_RUNS : end),tspace,chain,0,
+                     run,fblock,osize);
+          fclose(run);
+          nrun += 1;
+        }
+      beg = end;
+      end = nrun;
+    }
+
+  return (merge_runs(beg,end,tspace,chain,1,foutput,fblock,osize));
 }
 
 int main(int argc, char *argv[])
-{ char     *iblock, *fblock, *iend;
+{ char     *iblock, *fblock;
   int64     isize,   osize;
   int64     ovlsize, ptrsize;
-  int       tspace, tbytes;
+  int       tspace;
   int       i;
 
   int       VERBOSE;
-  int       MAP_ORDER;
  
   //  Process options
 
-  { int j, k;
-    int flags[128];
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+    DIR  *dirp;
 
     ARG_INIT("LAsort")
 
+    NTHREADS   = 4;
+    MEM_BUDGET = 0;
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    MEM_BUDGET = ((int64) sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+    if (MEM_BUDGET < 0)
+      MEM_BUDGET = 0;
+#endif
+    TEMP_PATH = "/tmp";
+    INDEX     = 0;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("va") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("va")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'M':
+            { double limit;
+
+              ARG_REAL(limit)
+              if (limit <= 0.)
+                { fprintf(stderr,"%s: -M memory budget must be positive\n",Prog_Name);
+                  exit (1);
+                }
+              MEM_BUDGET = limit * 0x40000000ll;
+              break;
+            }
+          case 'P':
+            TEMP_PATH = argv[i]+2;
+            if ((dirp = opendir(TEMP_PATH)) == NULL)
+              { fprintf(stderr,"%s: -P option: cannot open directory %s\n",Prog_Name,TEMP_PATH);
+                exit (1);
+              }
+            closedir(dirp);
+            break;
+          case 'I':
+            ARG_POSITIVE(INDEX,"Pile index sampling interval")
+            break;
+        }
       else
         argv[j++] = argv[i];
     argc = j;
@@ -225,8 +818,18 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
         fprintf(stderr,"      -a: sort .las by A-read,A-position pairs for map usecase\n");
         fprintf(stderr,"          off => sort .las by A,B-read pairs for overlap piles\n");
+        fprintf(stderr,"      -T: Use -T threads.\n");
+        fprintf(stderr,"      -M: Use at most -M Gb of memory (default is physical memory).\n");
+        fprintf(stderr,"          Larger files are sorted in runs that are merged.\n");
+        fprintf(stderr,"      -P: Place the runs of such an external sort in directory -P.\n");
+        fprintf(stderr,"      -I: Also write a pile index <align>.S.las.idx with an entry every");
+        fprintf(stderr," -I A-reads.\n");
         exit (1);
       }
+
+    POOL = New_Thread_Pool(NTHREADS,0);
+    Set_LSD_Params(POOL,0);
+    RUN_PID = getpid();
   }
 
   //  For each file do
@@ -236,170 +839,157 @@ int main(int argc, char *argv[])
   isize   = 0;
   iblock  = NULL;
   osize   = MEMORY * 1000000ll;
+  if (MEM_BUDGET > 0 && osize > MEM_BUDGET/4)
+    osize = MEM_BUDGET/4;
   fblock  = Malloc(osize,"Allocating LAsort output block");
+  if (fblock == NULL)
+    exit (1);
 
   for (i = 1; i < argc; i++)
-    { int64    *perm;
-      FILE     *input, *foutput;
-      int64     novl, sov, bovl;
+    { FILE     *input, *foutput;
+      int64     novl, bovl;
+      int64     size, need;
+      int       nrun;
+      Las_Reader   *reader;
       Block_Looper *parse;
 
       parse = Parse_Block_LAS_Arg(argv[i]);
 
       while ((input = Next_Block_Arg(parse)) != NULL)
-        {
-          //  Read in the entire file and output header
-
-          { int64  size;
-            struct stat info;
-            char  *root, *path;
-
-            path = Block_Arg_Path(parse);
-            root = Block_Arg_Root(parse);
-
-            stat(Catenate(path,"/",root,".las"),&info);
-            size = info.st_size;
-
-            if (fread(&novl,sizeof(int64),1,input) != 1)
-              SYSTEM_READ_ERROR
-            if (fread(&tspace,sizeof(int),1,input) != 1)
-              SYSTEM_READ_ERROR
-
-            if (tspace <= TRACE_XOVR && tspace != 0)
-              tbytes = sizeof(uint8);
-            else
-              tbytes = sizeof(uint16);
-
-            if (VERBOSE)
-              { printf("  %s: ",root);
-                Print_Number(novl,0,stdout);
-                printf(" records, ");
-                Print_Number(size-novl*ovlsize,0,stdout);
-                printf(" trace bytes");
-                fflush(stdout);
-              }
+        { char  *root, *path, *oname;
+          struct stat info;
 
-            foutput = Fopen(Catenate(path,"/",root,".S.las"),"w");
-            if (foutput == NULL)
-              exit (1);
+          //  Read the header, and open output
 
-            if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
-              SYSTEM_WRITE_ERROR
-            if (fwrite(&tspace,sizeof(int),1,foutput) != 1)
-              SYSTEM_WRITE_ERROR
- 
-            if (size > isize)
-              { if (iblock == NULL)
-                  iblock = Malloc(size+ptrsize,"Allocating LAsort input block");
-                else
-                  iblock = Realloc(iblock-ptrsize,size+ptrsize,"Allocating LAsort input block");
-                if (iblock == NULL)
-                  exit (1);
-                iblock += ptrsize;
-                isize   = size;
-              }
-            size -= (sizeof(int64) + sizeof(int));
-            if (size > 0)
-              { if (fread(iblock,size,1,input) != 1)
-                  SYSTEM_READ_ERROR
-              }
-            fclose(input);
-            iend = iblock + (size - ptrsize);
+          path = Block_Arg_Path(parse);
+          root = Block_Arg_Root(parse);
 
-            free(root);
-            free(path);
-          }
+          stat(Catenate(path,"/",root,".las"),&info);
+          size = info.st_size;
 
-          if (novl == 0)
-            { fclose(foutput);
-              continue;
-            }
-    
-          //  Set up unsorted permutation array
-        
-          perm = (int64 *) Malloc(sizeof(int64)*novl,"Allocating LAsort permutation vector");
-          if (perm == NULL)
-            exit (1);
-    
-          { int64 off;
-            int   j;
-    
-            if (CHAIN_START(((Overlap *) (iblock-ptrsize))->flags))
-              { sov = 0;
-                off = -ptrsize;
-                for (j = 0; j < novl; j++)
-                  { if (CHAIN_START(((Overlap *) (iblock+off))->flags))
-                      perm[sov++] = off;
-                    off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
-                  }
-              }
-            else
-              { off = -ptrsize;
-                for (j = 0; j < novl; j++)
-                  { perm[j] = off;
-                    off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
-                  }
-                sov = novl;
-              }
-          }
+          if (fread(&novl,sizeof(int64),1,input) != 1)
+            SYSTEM_READ_ERROR
+          if (fread(&tspace,sizeof(int),1,input) != 1)
+            SYSTEM_READ_ERROR
 
-          //  Sort permutation array of ptrs to records
-    
-          IBLOCK = iblock;
-          if (MAP_ORDER)
-            qsort(perm,sov,sizeof(int64),SORT_MAP);
+          if (tspace <= TRACE_XOVR && tspace != 0)
+            TBYTES = sizeof(uint8);
           else
-            qsort(perm,sov,sizeof(int64),SORT_OVL);
+            TBYTES = sizeof(uint16);
+          OVLSIZE = ovlsize;
 
-          //  Output the records in sorted order
-    
-          { int      j, equal;
-            Overlap *w, *x, y;
-            int64    tsize, span;
-            char    *fptr, *ftop, *wo;
-    
-            y.aread = ((Overlap *) (iblock+perm[0]))->aread+1;
-            x = &y;
-
-            bovl = novl;
-            fptr = fblock;
-            ftop = fblock + osize;
-            for (j = 0; j < sov; j++)
-              { w = (Overlap *) (wo = iblock+perm[j]);
-                do
-                  { equal = EQUAL(w,x); 
-                    tsize = w->path.tlen*tbytes;
-                    span  = ovlsize + tsize;
-                    if (fptr + span > ftop)
-                      { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
-                          SYSTEM_WRITE_ERROR
-                        fptr = fblock;
-                      }
-                    if (equal)
-                      novl -= 1;
-                    else
-                      { memmove(fptr,((char *) w)+ptrsize,ovlsize);
-                        fptr += ovlsize;
-                        memmove(fptr,(char *) (w+1),tsize);
-                        fptr += tsize;
-                      }
-                    x = w;
-                    w = (Overlap *) (wo += span);
-                  }
-                while (wo < iend && CHAIN_NEXT(w->flags));
-              }
-            if (fptr > fblock)
-              { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
-                  SYSTEM_WRITE_ERROR
-              }
-          }
+          //  A blocked file is decoded as it is read, its raw size is in its block table
+
+          reader = NULL;
+          if (Las_Is_Blocked(input))
+            { Las_Index *table;
+
+              table = Read_Las_Blocks(input,NULL,&size);
+              if (table == NULL)
+                { fprintf(stderr,"%s: Block table of %s.las is missing or corrupted\n",
+                                 Prog_Name,root);
+                  exit (1);
+                }
+              Free_Las_Index(table);
+              size  += sizeof(int64) + sizeof(int);
+              reader = Open_Las_Reader(input,-1,-1,RUN_CHUNK*1000000ll,TBYTES);
+              if (reader == NULL)
+                exit (1);
+            }
+
+          if (VERBOSE)
+            { printf("  %s: ",root);
+              Print_Number(novl,0,stdout);
+              printf(" records, ");
+              Print_Number(size-novl*ovlsize,0,stdout);
+              printf(" trace bytes");
+              fflush(stdout);
+            }
+
+          oname   = Strdup(Catenate(path,"/",root,".S.las"),"Allocating file name");
+          if (oname == NULL)
+            exit (1);
+          catch_exits();
+          OUT_PART = oname;
+          foutput  = Fopen(oname,"w");
+          if (foutput == NULL)
+            exit (1);
 
-          rewind(foutput);
-          if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
-            SYSTEM_WRITE_ERROR
+          free(root);
+          free(path);
+
+          size -= (sizeof(int64) + sizeof(int));
+          need  = size + novl*KEY_MEMORY + osize;
+          bovl  = novl;
+          nrun  = 0;
+
+          //  If the file fits in the memory budget then read it in its entirety and sort it,
+          //    otherwise perform an external sort with runs that fit in the budget
+
+          if (MEM_BUDGET == 0 || need <= MEM_BUDGET)
+            { if (size > isize)
+                { if (iblock == NULL)
+                    iblock = Malloc(size+ptrsize,"Allocating LAsort input block");
+                  else
+                    iblock = Realloc(iblock-ptrsize,size+ptrsize,"Allocating LAsort input block");
+                  if (iblock == NULL)
+                    exit (1);
+                  iblock += ptrsize;
+                  isize   = size;
+                }
+              if (reader != NULL)
+                { if (Read_Las_Bytes(reader,iblock,size) != size)
+                    { fprintf(stderr,"%s: Blocked .las file is shorter than its table says\n",
+                                     Prog_Name);
+                      exit (1);
+                    }
+                  Close_Las_Reader(reader);
+                }
+              else if (size > 0)
+                { if (fread(iblock,size,1,input) != 1)
+                    SYSTEM_READ_ERROR
+                }
+              fclose(input);
+
+              if (novl > 0)
+                novl = sort_block(iblock,size,novl,tspace,
+                                  CHAIN_START(((Overlap *) (iblock-ptrsize))->flags),
+                                  foutput,fblock,osize);
+              else
+                { if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
+                    SYSTEM_WRITE_ERROR
+                  if (fwrite(&tspace,sizeof(int),1,foutput) != 1)
+                    SYSTEM_WRITE_ERROR
+                }
+            }
+          else
+            { int64 rsize = MEM_BUDGET - osize;
+
+              if (rsize > isize)
+                { if (iblock == NULL)
+                    iblock = Malloc(rsize+ptrsize,"Allocating LAsort input block");
+                  else
+                    iblock = Realloc(iblock-ptrsize,rsize+ptrsize,"Allocating LAsort input block");
+                  if (iblock == NULL)
+                    exit (1);
+                  iblock += ptrsize;
+                  isize   = rsize;
+                }
+              novl = sort_external(input,reader,novl,tspace,foutput,iblock,rsize,fblock,osize,&nrun);
+              if (reader != NULL)
+                Close_Las_Reader(reader);
+              fclose(input);
+              iblock = NULL;
+              isize  = 0;
+            }
 
           if (VERBOSE)
-            { if (bovl == novl)
+            { if (nrun > 0)
+                { printf(", ");
+                  Print_Number(nrun,0,stdout);
+                  printf(" runs");
+                }
+              if (bovl == novl)
                 fprintf(stdout,"\n");
               else
                 { fprintf(stdout,", ");
@@ -408,8 +998,12 @@ int main(int argc, char *argv[])
                 }
             }
 
-          free(perm);
-          fclose(foutput);
+          FCLOSE(foutput);
+          OUT_PART = NULL;
+
+          if (INDEX > 0 && Write_Las_Index(oname,INDEX))
+            exit (1);
+          free(oname);
         }
       Free_Block_Arg(parse);
     }
@@ -417,6 +1011,7 @@ int main(int argc, char *argv[])
   if (iblock != NULL)
     free(iblock - ptrsize);
   free(fblock);
+  Free_Thread_Pool(POOL);
 
   exit (0);
 }
@@ -1,7 +1,9 @@
 /*******************************************************************************************
  *
  *  Split an OVL file arriving from the standard input into 'parts' equal sized .las-files
- *    <align>.1.las, <align>.2.las ... or according to a current partitioning of <path>
+ *    <align>.1.las, <align>.2.las ... or according to a current partitioning of <path>.
+ *    If the OVL file is given as an argument, the split points are found first and then
+ *    the parts are copied from it concurrently.
  *
  *  Author:  Gene Myers
  *  Date  :  June 2014
@@ -15,47 +17,178 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
 
-static char *Usage = "-v <target:las> (<parts:int> | <path:db|dam>) < <source>.las";
+static char *Usage[] =
+    { "[-v] [-T<int(4)>] <target:las> (<parts:int> | <path:db|dam>) < <source>.las",
+      "[-v] [-T<int(4)>] <target:las> (<parts:int> | <path:db|dam>)   <source:las>"
+    };
 
 #define MEMORY   1000   //  How many megabytes for output buffer
+#define IBUFFER    64   //  How many megabytes for each of the two input buffers
+#define SBUFFER     4   //  How many megabytes for each input buffer when scanning for splits
+
+  //  A scan of the records of a .las file from a given offset and ordinal, used to find the
+  //    split points of a source given as a file
+
+typedef struct
+  { FILE       *input;
+    int64       fsize;
+    int         tbytes;
+    Las_Reader *reader;   //  Reader delivering the records from off on (or NULL if not open)
+    int64       off;      //  Offset and ordinal of the next record
+    int64       ord;
+    Overlap    *w;        //  The next record if it has been read
+  } Scan;
+
+static Overlap *scan_peek(Scan *s)
+{ if (s->w == NULL)
+    { if (s->reader == NULL)
+        { s->reader = Open_Las_Reader(s->input,s->off,s->fsize,SBUFFER*1000000ll,s->tbytes);
+          if (s->reader == NULL)
+            exit (1);
+        }
+      s->w = Next_Las_Record(s->reader);
+    }
+  return (s->w);
+}
 
-int main(int argc, char *argv[])
-{ char      *iblock, *oblock;
+static void scan_skip(Scan *s)
+{ s->off += (sizeof(Overlap) - sizeof(void *)) + s->w->path.tlen*s->tbytes;
+  s->ord += 1;
+  s->w    = NULL;
+}
+
+static void scan_seek(Scan *s, int64 off, int64 ord)
+{ if (s->reader != NULL)
+    Close_Las_Reader(s->reader);
+  s->reader = NULL;
+  s->w      = NULL;
+  s->off    = off;
+  s->ord    = ord;
+}
+
+  //  Return the last entry of index whose ordinal is not greater than ord
+
+static Las_Index_Entry *find_ordinal(Las_Index *index, int64 ord)
+{ int64 l, r, m;
+
+  l = 0;
+  r = index->nidx;
+  if (r == 0 || index->idx[0].ordinal > ord)
+    return (NULL);
+  while (r - l > 1)               //  idx[l].ordinal <= ord < idx[r].ordinal
+    { m = (l+r)/2;
+      if (index->idx[m].ordinal <= ord)
+        l = m;
+      else
+        r = m;
+    }
+  return (index->idx + l);
+}
+
+  //  The parts of a source file, copied concurrently by threads that take the next part
+  //    to be written
+
+typedef struct
+  { char  *name;    //  File name of the part
+    int64  off;     //  Offset in the source of its first record
+    int64  len;     //    the number of bytes of its records
+    int64  novl;    //    and the number of them
+  } Part;
+
+static Part           *Parts;
+static int             Nparts;
+static int             Next_Part;
+static pthread_mutex_t Part_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct
+  { int    fd;       //  Source file
+    int    tspace;
+    char  *buffer;   //  Buffer of bsize bytes for copies that cannot be made in the kernel
+    int64  bsize;
+  } Split_Arg;
+
+static void *split_thread(void *arg)
+{ Split_Arg *data = (Split_Arg *) arg;
   FILE      *output;
+  Part      *p;
+  int        i;
+
+  while (1)
+    { pthread_mutex_lock(&Part_Mutex);
+      i = Next_Part++;
+      pthread_mutex_unlock(&Part_Mutex);
+      if (i >= Nparts)
+        break;
+      p = Parts + i;
+
+      output = Fopen(p->name,"w");
+      if (output == NULL)
+        exit (1);
+      if (fwrite(&(p->novl),sizeof(int64),1,output) != 1)
+        SYSTEM_WRITE_ERROR
+      if (fwrite(&(data->tspace),sizeof(int),1,output) != 1)
+        SYSTEM_WRITE_ERROR
+      fflush(output);
+      Copy_Bytes(data->fd,p->off,fileno(output),p->len,data->buffer,data->bsize);
+      FCLOSE(output);
+    }
+  return (NULL);
+}
+
+int main(int argc, char *argv[])
+{ char      *oblock;
+  FILE      *input, *output;
   DAZZ_STUB *stub;
   int64      novl, bsize, ovlsize, ptrsize;
   int        parts, tspace, tbytes;
   char      *pwd, *root, *root2;
+  char      *source;
 
   int        VERBOSE;
+  int        NTHREADS;
 
   //  Process options
 
-  { int i, j, k;
-    int flags[128];
+  { int   i, j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAsplit")
 
+    NTHREADS = 4;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("v") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
       else
         argv[j++] = argv[i];
     argc = j;
 
     VERBOSE = flags['v'];
 
-    if (argc != 3)
-      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+    if (argc != 3 && argc != 4)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
+        fprintf(stderr,"       %*s %s\n",(int) strlen(Prog_Name),"",Usage[1]);
         fprintf(stderr,"\n");
         fprintf(stderr,"    <target> is a template that must have a single %c-sign in it\n",
                        BLOCK_SYMBOL);
         fprintf(stderr,"    This symbol is replaced by numbers 1 to n = the number of parts\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, report the number of la's in each part.\n");
+        fprintf(stderr,"      -T: Copy the parts of a <source> file with -T threads.\n");
         exit (1);
       }
   }
@@ -91,10 +224,8 @@ int main(int argc, char *argv[])
   ovlsize = sizeof(Overlap) - ptrsize;
   bsize   = MEMORY * 1000000ll;
   oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
+  if (oblock == NULL)
     exit (1);
-  iblock += ptrsize;
 
   pwd   = PathTo(argv[1]);
   root  = Root(argv[1],".las");
@@ -111,9 +242,27 @@ int main(int argc, char *argv[])
     }
   *root2++ = '\0';
 
-  if (fread(&novl,sizeof(int64),1,stdin) != 1)
+  if (argc == 4)
+    { char *spwd  = PathTo(argv[3]);
+      char *sroot = Root(argv[3],".las");
+
+      source = Strdup(Catenate(spwd,"/",sroot,".las"),"Allocating source name");
+      if (source == NULL)
+        exit (1);
+      input = Fopen(source,"r");
+      if (input == NULL)
+        exit (1);
+      free(sroot);
+      free(spwd);
+    }
+  else
+    { source = NULL;
+      input  = stdin;
+    }
+
+  if (fread(&novl,sizeof(int64),1,input) != 1)
     SYSTEM_READ_ERROR
-  if (fread(&tspace,sizeof(int),1,stdin) != 1)
+  if (fread(&tspace,sizeof(int),1,input) != 1)
     SYSTEM_READ_ERROR
   if (tspace <= TRACE_XOVR && tspace != 0)
     tbytes = sizeof(uint8);
@@ -125,104 +274,220 @@ int main(int argc, char *argv[])
       fflush(stdout);
     }
 
-  { int      i;
-    Overlap *w;
-    int64    j, low, hgh, last;
-    int64    tsize, povl;
-    char    *iptr, *itop;
-    char    *optr, *otop;
-
-    iptr = iblock;
-    itop = iblock + fread(iblock,1,bsize,stdin);
-
-    hgh = 0;
-    for (i = 0; i < parts; i++)
-      { output = Fopen(Catenate(pwd,"/",Numbered_Suffix(root,i+1,root2),".las"),"w");
-        if (output == NULL)
-          exit (1);
-
-        low = hgh;
-        if (stub != NULL)
-          { last = stub->tblocks[i+1];
-            hgh  = 0;
-          }
-        else
-          { last = 0;
-            hgh  = (novl*(i+1))/parts;
+  //  If the source is a file in the raw format, then find the offset and ordinal of the
+  //    first record of each part, skipping forward from the entries of its pile index if
+  //    it has one, and then copy the parts concurrently.  The split points are exactly those
+  //    of the sequential split below.
+
+  if (source != NULL && ! Las_Is_Blocked(input))
+    { Las_Index       *index;
+      Las_Index_Entry *e;
+      Overlap         *w;
+      Scan             scan;
+      struct stat      info;
+      int64            hgh, last;
+      int              i;
+
+      if (fstat(fileno(input),&info) != 0)
+        SYSTEM_READ_ERROR
+
+      index = Open_Las_Index(source);
+      if (index != NULL && index->novl != novl)
+        { Free_Las_Index(index);
+          index = NULL;
+        }
+
+      scan.input  = input;
+      scan.fsize  = info.st_size;
+      scan.tbytes = tbytes;
+      scan.reader = NULL;
+      scan.off    = sizeof(int64) + sizeof(int);
+      scan.ord    = 0;
+      scan.w      = NULL;
+
+      Parts = (Part *) Malloc(sizeof(Part)*parts,"Allocating parts");
+      if (Parts == NULL)
+        exit (1);
+
+      for (i = 0; i < parts; i++)
+        { Parts[i].name = Strdup(Catenate(pwd,"/",Numbered_Suffix(root,i+1,root2),".las"),
+                                 "Allocating part name");
+          if (Parts[i].name == NULL)
+            exit (1);
+          Parts[i].off  = scan.off;
+          Parts[i].novl = scan.ord;
+
+          if (stub != NULL)
+            { last = stub->tblocks[i+1];
+              if (index != NULL)
+                { e = Find_Las_Pile(index,last);
+                  if (e != NULL && e->ordinal > scan.ord)
+                    scan_seek(&scan,e->offset,e->ordinal);
+                }
+              while (scan.ord < novl)
+                { if ((w = scan_peek(&scan)) == NULL)
+                    break;
+                  if (w->aread >= last)
+                    break;
+                  scan_skip(&scan);
+                }
+            }
+          else
+            { hgh  = (novl*(i+1))/parts;
+              last = 0;
+              if (index != NULL)
+                { e = find_ordinal(index,hgh);
+                  if (e != NULL && e->ordinal > scan.ord)
+                    { scan_seek(&scan,e->offset,e->ordinal);
+                      last = -1;
+                    }
+                }
+              while (scan.ord < novl)
+                { if ((w = scan_peek(&scan)) == NULL)
+                    break;
+                  if (scan.ord >= hgh && w->aread > last)
+                    break;
+                  last = w->aread;
+                  scan_skip(&scan);
+                }
+            }
+          if (scan.ord < novl && scan.w == NULL)
+            { fprintf(stderr,"%s: Input has fewer records than its header says\n",Prog_Name);
+              exit (1);
+            }
+
+          Parts[i].len  = scan.off - Parts[i].off;
+          Parts[i].novl = scan.ord - Parts[i].novl;
+        }
+      if (scan.reader != NULL)
+        Close_Las_Reader(scan.reader);
+      if (index != NULL)
+        Free_Las_Index(index);
+
+      //  Copy the parts with NTHREADS threads
+
+      { pthread_t threads[NTHREADS];
+        Split_Arg parm[NTHREADS];
+
+        Nparts    = parts;
+        Next_Part = 0;
+        for (i = 0; i < NTHREADS; i++)
+          { parm[i].fd     = fileno(input);
+            parm[i].tspace = tspace;
+            parm[i].bsize  = bsize/NTHREADS;
+            parm[i].buffer = oblock + i*parm[i].bsize;
           }
+        for (i = 1; i < NTHREADS; i++)
+          pthread_create(threads+i,NULL,split_thread,parm+i);
+        split_thread(parm);
+        for (i = 1; i < NTHREADS; i++)
+          pthread_join(threads[i],NULL);
+      }
+
+      for (i = 0; i < parts; i++)
+        { if (VERBOSE)
+            { printf("  Split off %s: %lld la\'s\n",
+                     Numbered_Suffix(root,i+1,root2),Parts[i].novl);
+              fflush(stdout);
+            }
+          free(Parts[i].name);
+        }
+      free(Parts);
+    }
 
-        povl = 0;
-        fwrite(&povl,sizeof(int64),1,output);
-        fwrite(&tspace,sizeof(int),1,output);
-
-        optr = oblock;
-        otop = oblock + bsize;
-
-        for (j = low; j < novl; j++)
-          { if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memmove(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
-
-            w = (Overlap *) (iptr-ptrsize);
-            if (stub == NULL)
-              { if (j >= hgh && w->aread > last)
-                  break;
-                last = w->aread;
-              }
-            else
-              { if (w->aread >= last)
-                  break;
-              }
-
-            tsize = w->path.tlen*tbytes;
-            if (optr + ovlsize + tsize > otop)
-              { fwrite(oblock,1,optr-oblock,output);
-                optr = oblock;
-              }
+  else   //  Otherwise split the records as they are read
+    { int      i;
+      Overlap *w;
+      int64    j, low, hgh, last;
+      int64    span, povl;
+      char    *optr, *otop;
+      Las_Reader *reader;
+
+      reader = Open_Las_Reader(input,-1,-1,IBUFFER*1000000ll,tbytes);
+      if (reader == NULL)
+        exit (1);
+      w = NULL;
+
+      hgh = 0;
+      for (i = 0; i < parts; i++)
+        { output = Fopen(Catenate(pwd,"/",Numbered_Suffix(root,i+1,root2),".las"),"w");
+          if (output == NULL)
+            exit (1);
+
+          low = hgh;
+          if (stub != NULL)
+            { last = stub->tblocks[i+1];
+              hgh  = 0;
+            }
+          else
+            { last = 0;
+              hgh  = (novl*(i+1))/parts;
+            }
+
+          povl = 0;
+          fwrite(&povl,sizeof(int64),1,output);
+          fwrite(&tspace,sizeof(int),1,output);
+
+          optr = oblock;
+          otop = oblock + bsize;
+
+          for (j = low; j < novl; j++)
+            { if (w == NULL)
+                { w = Next_Las_Record(reader);
+                  if (w == NULL)
+                    { fprintf(stderr,"%s: Input has fewer records than its header says\n",
+                                     Prog_Name);
+                      exit (1);
+                    }
+                }
+
+              if (stub == NULL)
+                { if (j >= hgh && w->aread > last)
+                    break;
+                  last = w->aread;
+                }
+              else
+                { if (w->aread >= last)
+                    break;
+                }
+
+              span = ovlsize + w->path.tlen*tbytes;
+              if (optr + span > otop)
+                { fwrite(oblock,1,optr-oblock,output);
+                  optr = oblock;
+                }
             
-            memmove(optr,iptr,ovlsize);
-            optr += ovlsize;
-            iptr += ovlsize;
-
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memmove(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
-	    memmove(optr,iptr,tsize);
-            optr += tsize;
-            iptr += tsize;
-          }
-        hgh = j;
+              memmove(optr,((char *) w) + ptrsize,span);
+              optr += span;
+              w = NULL;
+            }
+          hgh = j;
 
-        if (optr > oblock)
-          fwrite(oblock,1,optr-oblock,output);
+          if (optr > oblock)
+            fwrite(oblock,1,optr-oblock,output);
 
-        rewind(output);
-        povl = hgh-low;
-        fwrite(&povl,sizeof(int64),1,output);
+          rewind(output);
+          povl = hgh-low;
+          fwrite(&povl,sizeof(int64),1,output);
 
-        if (VERBOSE)
-          { printf("  Split off %s: %lld la\'s\n",Numbered_Suffix(root,i+1,root2),povl);
-            fflush(stdout);
-          }
+          if (VERBOSE)
+            { printf("  Split off %s: %lld la\'s\n",Numbered_Suffix(root,i+1,root2),povl);
+              fflush(stdout);
+            }
 
-        fclose(output);
-      }
-  }
+          fclose(output);
+        }
 
+      Close_Las_Reader(reader);
+    }
+
+  if (source != NULL)
+    { fclose(input);
+      free(source);
+    }
   free(pwd);
   free(root);
   Free_DB_Stub(stub);
-  free(iblock-ptrsize);
   free(oblock);
 
   exit (0);
@@ -1,11 +1,28 @@
+/*******************************************************************************************
+ *
+ *  Convert a 1-code .dal file back into a .las file.  With -T the piles of a binary .dal
+ *    file are decoded by T threads, each taking every T'th chunk of PILE_CHUNK piles, and
+ *    the .las segment for each chunk is written out in order as soon as its turn comes up,
+ *    so memory is bounded by T chunks regardless of the size of the file.
+ *
+ *******************************************************************************************/
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "DB.h"
 #include "align.h"
 #include "ONElib.h"
 
+#define PILE_CHUNK  1024   //  # of piles converted by a thread before writing its segment
+
+#define PTRSIZE  sizeof(void *)
+#define OVLSIZE  (sizeof(Overlap) - PTRSIZE)
+
+static char *Usage = "[-T<int(1)>] <align:dal> > (.las)";
+
 static char *One_Schema =
   "P 3 dal\n"
   "D X 1 3 INT\n"             //  Data prolog: trace spacing
@@ -21,48 +38,320 @@ static char *One_Schema =
   "D T 1 8 INT_LIST\n"        //       trace segment length
   "D Q 1 8 INT_LIST\n";       //       trace segment diffs
 
-int main(int argc, char *argv[])
-{ int64    novls, Pmax, Tmax, psize;
-  Overlap *ovls, *otop, *o;
-  void    *trace, *ttop;
+static int     NTHREADS;    //  # of conversion threads
+static int     tbytes;      //  # of bytes per trace element
+static int64   Pmax, Tmax;  //  Largest pile and trace list in the .dal file
+static int64   Npile;       //  # of piles in the .dal file
+
+  //  Segments are written to the standard output in chunk order: a thread with a finished
+  //    chunk waits until Next_Chunk is its chunk.
+
+static pthread_mutex_t Out_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Out_Turn  = PTHREAD_COND_INITIALIZER;
+static int64           Next_Chunk = 0;
+
+typedef struct
+  { OneFile *file1;    //  This thread's reader
+    int      tid;      //  Thread index
+    Overlap *ovls;     //  Pile buffers
+    void    *trace;
+    char    *seg;      //  .las bytes of the current chunk
+    int64    stop;
+    int64    smax;
+    int64    novl;     //  # of LAs output by this thread
+  } Convert_Arg;
+
+  //  Decode the pile whose P-line has just been read from parm->file1 and append its
+  //    .las records to parm->seg
+
+static void convert_pile(Convert_Arg *parm)
+{ OneFile *file1 = parm->file1;
+  Overlap *ovls  = parm->ovls;
+  Overlap *otop, *o;
+  void    *ttop;
+  int64    psize, need;
+  int64   *list;
+  char    *string;
   int      aread;
   int      has[128];
-  int      tspace, small, tbytes;
+  int      t, i, j, k;
+
+  psize = oneLen(file1);
+  list  = oneIntList(file1);
+  aread = oneInt(file1,0)-1;
+  for (i = 0; i < psize; i++)
+    { ovls[i].aread = aread;
+      ovls[i].bread = list[i]-1;
+    }
+
+  ttop = parm->trace;
+  otop = ovls + psize;
+  has['O'] = has['C'] = has['A'] = has['B'] = has['L'] = has['D'] = has['T'] = has['Q'] = 0;
+  for (o = ovls; o < otop; o++)
+    { o->flags = 0;
+      o->path.tlen = -1;
+    }
+  for (j = 0; j < 6+2*psize; j++)
+    { t = oneReadLine(file1);
+
+      if (t == 0)
+        { fprintf(stderr,"ONE2LA: Pile object not followed by sufficient auxiliary lines\n");
+          exit (1);
+        }
+      if (has[t] > 0 && t != 'T' && t != 'Q')
+        { fprintf(stderr,"ONE2LA: Pile has more than one '%c' line\n",t);
+          exit (1);
+        }
+      has[t] += 1;
+      if (t == 'A' || t == 'B')
+        { if (oneLen(file1) != 2*psize)
+            { fprintf(stderr,"ONE2LA: %c-line has incorrect list length\n",t);
+              exit (1);
+            }
+        }
+      else if (t != 'T' && t != 'Q')
+        { if (oneLen(file1) != psize)
+            { fprintf(stderr,"ONE2LA: %c-line has incorrect list length\n",t);
+              exit (1);
+            }
+        }
+      else
+        { if (has[t] > psize)
+            { fprintf(stderr,"ONE2LA: Too many %c-lines for pile\n",t);
+              exit (1);
+            }
+        }
+
+      switch (t)
+      { case 'O':
+          string = oneString(file1);
+          i = 0;
+          for (o = ovls; o < otop; o++)
+            if (string[i++] == 'c')
+              o->flags |= COMP_FLAG;
+          break;
+        case 'C':
+          string = oneString(file1);
+          i = 0;
+          for (o = ovls; o < otop; o++)
+            if (string[i] == '-')
+              o->flags |= NEXT_FLAG;
+            else if (string[i] == '>')
+              o->flags |= BEST_FLAG;
+            else if (string[i] == '+')
+              o->flags |= START_FLAG;
+          break;
+        case 'A':
+          list = oneIntList(file1);
+          i = 0;
+          for (o = ovls; o < otop; o++)
+            { o->path.abpos = list[i++];
+              o->path.aepos = list[i++];
+            }
+          break;
+        case 'B':
+          list = oneIntList(file1);
+          i = 0;
+          for (o = ovls; o < otop; o++)
+            { o->path.bbpos = list[i++];
+              o->path.bepos = list[i++];
+            }
+          break;
+        case 'L':
+          break;
+        case 'D':
+          list = oneIntList(file1);
+          i = 0;
+          for (o = ovls; o < otop; o++)
+            o->path.diffs = list[i++];
+          break;
+        case 'T':
+        case 'Q':
+          list = oneIntList(file1);
+          o = ovls + (has[t]-1);
+          if (o->path.tlen >= 0)
+            { if (o->path.tlen != 2*oneLen(file1))
+                { fprintf(stderr,"LA2ONE: T and Q line lengths do not correspond\n");
+                  exit (1);
+                }
+            }
+          else
+            { o->path.tlen  = 2*oneLen(file1);
+              o->path.trace = ttop;
+              ttop += o->path.tlen*tbytes;
+            }
+          if (t == 'Q')
+            k = 0;
+          else
+            k = 1;
+          if (tbytes == 1)
+            { uint8 *t8 = (uint8 *) o->path.trace;
+              for (i = 0; k < o->path.tlen; k += 2)
+                t8[k] = list[i++];
+            }
+          else
+            { uint16 *t16 = (uint16 *) o->path.trace;
+              for (i = 0; k < o->path.tlen; k += 2)
+                t16[k] = list[i++];
+            }
+          break;
+        default:
+          fprintf(stderr,"LA2ONE: Unrecognized line type '%c'\n",t);
+          exit (1);
+      }
+    }
+
+  if (has['T'] != psize || has['Q'] != psize)
+    { fprintf(stderr,"ONE2LA: # of pile traces != pile size\n");
+      exit (1);
+    }
+
+
+  need = parm->stop + psize*OVLSIZE + (ttop - parm->trace);
+  if (need > parm->smax)
+    { parm->smax = 1.2*need + 1024*1024;
+      parm->seg  = Realloc(parm->seg,parm->smax,"Growing segment buffer");
+      if (parm->seg == NULL)
+        exit (1);
+    }
+
+  for (o = ovls; o < otop; o++)
+    { memcpy(parm->seg+parm->stop,((char *) o) + PTRSIZE,OVLSIZE);
+      parm->stop += OVLSIZE;
+      memcpy(parm->seg+parm->stop,o->path.trace,o->path.tlen*tbytes);
+      parm->stop += o->path.tlen*tbytes;
+    }
+  parm->novl += psize;
+}
+
+  //  Wait for chunk c's turn and write the thread's segment to the standard output
+
+static void write_segment(Convert_Arg *parm, int64 c)
+{ pthread_mutex_lock(&Out_Mutex);
+  while (Next_Chunk != c)
+    pthread_cond_wait(&Out_Turn,&Out_Mutex);
+  if (parm->stop > 0 && fwrite(parm->seg,parm->stop,1,stdout) != 1)
+    { fprintf(stderr,"ONE2LA: Cannot write .las output\n");
+      exit (1);
+    }
+  Next_Chunk += 1;
+  pthread_cond_broadcast(&Out_Turn);
+  pthread_mutex_unlock(&Out_Mutex);
+  parm->stop = 0;
+}
+
+  //  With one thread convert piles until the end of the file, otherwise convert every
+  //    NTHREADS'th chunk of piles starting with chunk tid, positioning with the object index
+
+static void *convert_thread(void *arg)
+{ Convert_Arg *parm  = (Convert_Arg *) arg;
+  OneFile     *file1 = parm->file1;
+  int64        c, p, beg, end;
+  int          t;
+
+  if (NTHREADS == 1)
+    { c = p = 0;
+      while ((t = oneReadLine(file1)) != 0)
+        { if (t != 'P')
+            { fprintf(stderr,"ONE2LA: Pile data does not begin with a P-line\n");
+              exit (1);
+            }
+          convert_pile(parm);
+          if (++p % PILE_CHUNK == 0)
+            write_segment(parm,c++);
+        }
+      write_segment(parm,c);
+      return (NULL);
+    }
+
+  for (c = parm->tid; c*PILE_CHUNK < Npile; c += NTHREADS)
+    { beg = c*PILE_CHUNK;
+      end = beg + PILE_CHUNK;
+      if (end > Npile)
+        end = Npile;
+      if ( ! oneGotoObject(file1,beg))
+        { fprintf(stderr,"ONE2LA: Cannot seek to pile %lld\n",beg);
+          exit (1);
+        }
+      for (p = beg; p < end; p++)
+        { t = oneReadLine(file1);
+          if (t != 'P')
+            { fprintf(stderr,"ONE2LA: Pile data does not begin with a P-line\n");
+              exit (1);
+            }
+          convert_pile(parm);
+        }
+      write_segment(parm,c);
+    }
+  return (NULL);
+}
+
+int main(int argc, char *argv[])
+{ int64    novls, total;
+  int      tspace;
 
   OneFile   *file1;
   OneSchema *schema;
-  int64     *list;
-  char      *string, *command;
+  char      *command;
 
-  int t, i, j, k;
+  Convert_Arg *parm;
+
+  int t, i;
 
   //  Process arguments and capture command line for provenance
 
-  { int   n, t;
-    char *c;
+  { int    j, k;
+    int    flags[128];
+    char  *eptr;
 
-    n = 0;
-    for (t = 1; t < argc; t++)
-      n += strlen(argv[t])+1;
+    ARG_INIT("ONE2LA")
 
-    command = Malloc(n+1,"Allocating command string");
-    if (command == NULL)
-      exit (1);
+    NTHREADS = 1;
 
-    c = command;
-    if (argc >= 1)
-      { c += sprintf(c,"%s",argv[1]);
-        for (t = 2; t < argc; t++)
-          c += sprintf(c," %s",argv[t]);
-      }
-    *c = '\0';
-  }
+    { int   n, t;
+      char *c;
 
-  if (argc != 2)
-    { fprintf(stderr,"Usage: ONE2LA <align:dal> > (.las)\n");
-      exit (1);
+      n = 0;
+      for (t = 1; t < argc; t++)
+        n += strlen(argv[t])+1;
+
+      command = Malloc(n+1,"Allocating command string");
+      if (command == NULL)
+        exit (1);
+
+      c = command;
+      if (argc >= 1)
+        { c += sprintf(c,"%s",argv[1]);
+          for (t = 2; t < argc; t++)
+            c += sprintf(c," %s",argv[t]);
+        }
+      *c = '\0';
     }
 
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+    (void) flags;    //  No flag options, ARG_FLAGS only rejects unknown ones
+
+    if (argc != 2)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -T: Decode chunks of %d piles with this many threads\n",PILE_CHUNK);
+        exit (1);
+      }
+  }
+
   { char *pwd, *root, *path;
     FILE *output;
 
@@ -84,7 +373,7 @@ int main(int argc, char *argv[])
 
     schema = oneSchemaCreateFromText(One_Schema);
 
-    file1 = oneFileOpenRead(path,schema,"dal",1);
+    file1 = oneFileOpenRead(path,schema,"dal",NTHREADS);
 
     oneAddProvenance(file1,"ONE2LA","1.0","%s >?.las",command);
   }
@@ -98,6 +387,11 @@ int main(int argc, char *argv[])
       exit (1);
     }
 
+  //  Piles can only be distributed if the file has an object index, i.e. is binary
+
+  if ( ! file1->isIndexIn)
+    NTHREADS = 1;
+
   t = oneReadLine(file1);
   if (t == 0 || t != 'X')
     { fprintf(stderr,"ONE2LA: .dal data segment does not begine with an 'X'-line\n");
@@ -106,167 +400,72 @@ int main(int argc, char *argv[])
 
   tspace = oneInt(file1,0);
   if (tspace <= TRACE_XOVR && tspace != 0)
-    { small  = 1;
-      tbytes = 1;
-    }
+    tbytes = 1;
   else
-    { small  = 0;
-      tbytes = 2;
+    tbytes = 2;
+
+  Pmax  = file1->info['P']->given.max;
+  Tmax  = file1->info['T']->given.max;
+  Npile = file1->info['P']->given.count;
+
+  parm = (Convert_Arg *) Malloc(sizeof(Convert_Arg)*NTHREADS,"Allocating thread records");
+  if (parm == NULL)
+    exit (1);
+  for (i = 0; i < NTHREADS; i++)
+    { parm[i].file1 = file1+i;
+      parm[i].tid   = i;
+      parm[i].trace = Malloc(2*tbytes*Tmax*Pmax+1,"Allocating trace buffer");
+      parm[i].ovls  = Malloc(sizeof(Overlap)*Pmax+1,"Allocating overlap vector");
+      parm[i].seg   = NULL;
+      parm[i].stop  = 0;
+      parm[i].smax  = 0;
+      parm[i].novl  = 0;
+      if (parm[i].trace == NULL || parm[i].ovls == NULL)
+        exit (1);
+      memset(parm[i].ovls,0,sizeof(Overlap)*Pmax);   //  so padding bytes are output as 0
     }
 
-  Pmax = file1->info['P']->given.max;
-  Tmax = file1->info['T']->given.max;
-
-  trace  = Malloc(sizeof(uint16)*Tmax*Pmax,"Allocating trace buffer");
-  ovls   = Malloc(sizeof(Overlap)*Pmax,"Allocating overlap vector");
-  list   = Malloc(sizeof(int64)*(Pmax+Tmax),"Allocating integer list");
-  string = Malloc(Pmax+1,"Allocating max string");
+  //  The LA count in the header is taken from the .dal header and corrected at the end
+  //    if the number of LAs actually converted differs
 
   novls = file1->info['P']->given.total;
   fwrite(&novls,sizeof(int64),1,stdout);
   fwrite(&tspace,sizeof(int),1,stdout);
 
-  while ((t = oneReadLine(file1)) != 0)
-    { if (t != 'P')
-        { fprintf(stderr,"ONE2LA: Pile data does not begin with a P-line\n");
-          exit(1);
-        } 
-      psize = oneLen(file1);
-      list  = oneIntList(file1);
-      aread = oneInt(file1,0)-1;
-      for (i = 0; i < psize; i++)
-        { ovls[i].aread = aread;
-          ovls[i].bread = list[i]-1;
-        }
-
-      ttop = trace;
-      otop = ovls + psize;
-      has['O'] = has['C'] = has['A'] = has['B'] = has['L'] = has['D'] = has['T'] = has['Q'] = 0;
-      for (o = ovls; o < otop; o++)
-        { o->flags = 0;
-          o->path.tlen = -1;
-        }
-
-
-      for (j = 0; j < 6+2*psize; j++)
-        { t = oneReadLine(file1);
-
-          if (t == 0)
-            { fprintf(stderr,"ONE2LA: Pile object not followed by sufficient auxiliary lines\n");
-              exit (1);
-            }
-          if (has[t] > 0 && t != 'T' && t != 'Q')
-            { fprintf(stderr,"ONE2LA: Pile has more than one '%c' line\n",t);
-              exit (1);
-            }
-          has[t] += 1;
-          if (t == 'A' || t == 'B')
-            { if (oneLen(file1) != 2*psize)
-                { fprintf(stderr,"ONE2LA: %c-line has incorrect list length\n",t);
-                  exit (1);
-                }
-            }
-          else if (t != 'T' && t != 'Q')
-            { if (oneLen(file1) != psize)
-                { fprintf(stderr,"ONE2LA: %c-line has incorrect list length\n",t);
-                  exit (1);
-                }
-            }
-          else
-            { if (has[t] > psize)
-                { fprintf(stderr,"ONE2LA: Too many %c-lines for pile\n",t);
-                  exit (1);
-                }
-            }
+  if (NTHREADS == 1)
+    convert_thread(parm);
+  else
+    { pthread_t threads[NTHREADS];
 
-          switch (t)
-          { case 'O':
-              string = oneString(file1);
-              i = 0;
-              for (o = ovls; o < otop; o++)
-                if (string[i++] == 'c')
-                  o->flags |= COMP_FLAG;
-              break;
-            case 'C':
-              string = oneString(file1);
-              i = 0;
-              for (o = ovls; o < otop; o++)
-                if (string[i] == '-')
-                  o->flags |= NEXT_FLAG;
-                else if (string[i] == '>')
-                  o->flags |= BEST_FLAG;
-                else if (string[i] == '+')
-                  o->flags |= START_FLAG;
-              break;
-            case 'A':
-              list = oneIntList(file1);
-              i = 0;
-              for (o = ovls; o < otop; o++)
-                { o->path.abpos = list[i++];
-                  o->path.aepos = list[i++];
-                }
-              break;
-            case 'B':
-              list = oneIntList(file1);
-              i = 0;
-              for (o = ovls; o < otop; o++)
-                { o->path.bbpos = list[i++];
-                  o->path.bepos = list[i++];
-                }
-              break;
-            case 'L':
-              break;
-            case 'D':
-              list = oneIntList(file1);
-              i = 0;
-              for (o = ovls; o < otop; o++)
-                o->path.diffs = list[i++];
-              break;
-            case 'T':
-            case 'Q':
-              list = oneIntList(file1);
-              o = ovls + (has[t]-1);
-              if (o->path.tlen >= 0)
-                { if (o->path.tlen != 2*oneLen(file1))
-                    { fprintf(stderr,"LA2ONE: T and Q line lengths do not correspond\n");
-                      exit (1);
-                    }
-                }
-              else
-                { o->path.tlen  = 2*oneLen(file1);
-                  o->path.trace = ttop;
-                  ttop += o->path.tlen*tbytes;
-                }
-              if (t == 'Q')
-                k = 0;
-              else
-                k = 1;
-              if (tbytes == 1)
-                { uint8 *t8 = (uint8 *) o->path.trace;
-                  for (i = 0; k < o->path.tlen; k += 2)
-                    t8[k] = list[i++];
-                }
-              else
-                { uint16 *t16 = (uint16 *) o->path.trace;
-                  for (i = 0; k < o->path.tlen; k += 2)
-                    t16[k] = list[i++];
-                }
-              break;
-            default:
-              fprintf(stderr,"LA2ONE: Unrecognized line type '%c'\n",t);
-              exit (1);
-          }
-        }
+      for (i = 1; i < NTHREADS; i++)
+        pthread_create(threads+i,NULL,convert_thread,parm+i);
+      convert_thread(parm);
+      for (i = 1; i < NTHREADS; i++)
+        pthread_join(threads[i],NULL);
+    }
 
-      if (has['T'] != psize || has['Q'] != psize)
-        { fprintf(stderr,"ONE2LA: # of pile traces != pile size\n");
+  total = 0;
+  for (i = 0; i < NTHREADS; i++)
+    total += parm[i].novl;
+  if (total != novls)
+    { fflush(stdout);
+      if (fseeko(stdout,0,SEEK_SET) != 0 || fwrite(&total,sizeof(int64),1,stdout) != 1)
+        { fprintf(stderr,"ONE2LA: .dal header claims %lld LAs but %lld were converted",
+                         novls,total);
+          fprintf(stderr," and output is not seekable\n");
           exit (1);
         }
+    }
+  fflush(stdout);
 
-      for (o = ovls; o < otop; o++)
-        Write_Overlap(stdout,o,tbytes);
+  for (i = 0; i < NTHREADS; i++)
+    { free(parm[i].seg);
+      free(parm[i].ovls);
+      free(parm[i].trace);
     }
+  free(parm);
 
+  oneFileClose(file1);
   oneSchemaDestroy(schema);
 
   free(command);
@@ -2140,55 +2140,63 @@ void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
 		die ("ONE write error line %" PRId64 ": failed to write list field %d listLen %" PRId64 " listSize %" PRId64 " listBuf %lx",
 		     vf->line, li->listField, listLen, listSize, listBuf);
 	      vf->byte += listSize;
-	      if (li->listCodec != NULL)
+	      if (li->listCodec != NULL && vf->share == 0)
 		{ vcAddToTable (li->listCodec, listSize, listBuf);
 		  li->listTack += listSize;
 		  
 		  if (li->listTack > vf->codecTrainingSize)
-		    { if (vf->share == 0)
-			{ vcCreateCodec (li->listCodec, 1);
-			  li->isUseListCodec = true;
-			}
-		      else
-			{ OneFile  *ms;
-			  OneInfo *lx;
-			  
-			  if (vf->share < 0)
-			    { ms = vf + vf->share;
-			      lx = ms->info[(int) t]; 
-			    }
-			  else
-			    { ms = vf;
-			      lx = li;
+		    { vcCreateCodec (li->listCodec, 1);
+		      li->isUseListCodec = true;
+		    }
+		}
+	      else if (li->listCodec != NULL && ! li->isUseListCodec)
+		{ OneFile  *ms;
+		  OneInfo *lx;
+		  
+		  // In a threaded group the master replaces (and frees) the codec of every file
+		  //   when it creates the shared codec, so the histogram of a file is only added
+		  //   to under the master's lock and only while the shared codec does not exist.
+		  //   Once it does the lock is no longer taken, but as another file may have
+		  //   created it since the test above, the test is repeated under the lock.
+		  
+		  if (vf->share < 0)
+		    { ms = vf + vf->share;
+		      lx = ms->info[(int) t]; 
+		    }
+		  else
+		    { ms = vf;
+		      lx = li;
+		    }
+		  
+		  pthread_mutex_lock(&ms->listLock);
+		  
+		  if ( ! li->isUseListCodec)
+		    { vcAddToTable (li->listCodec, listSize, listBuf);
+		      li->listTack += listSize;
+		      
+		      if (li->listTack > vf->codecTrainingSize)
+			{ if (vf->share < 0)
+			    { lx->listTack += li->listTack;
+			      li->listTack = 0;
 			    }
-			  
-			  pthread_mutex_lock(&ms->listLock);
-			  
-			  if ( ! li->isUseListCodec)
-			    
-			    { if (vf->share < 0)
-				{ lx->listTack += li->listTack;
-				  li->listTack = 0;
-				}
-			      if (lx->listTack > ms->codecTrainingSize)
-				{ for (i = 1; i < ms->share; i++)
-				    vcAddHistogram (lx->listCodec,
-						    ms[i].info[(int) t]->listCodec);
-				  vcCreateCodec (lx->listCodec, 1);
-				  for (i = 1; i < ms->share; i++)
-				    { OneCodec *m = ms[i].info[(int) t]->listCodec;
-				      ms[i].info[(int) t]->listCodec = lx->listCodec;
-				      vcDestroy (m);
-				    }
-				  lx->isUseListCodec = true;
-				  for (i = 1; i < ms->share; i++)
-				    ms[i].info[(int) t]->isUseListCodec = true;
+			  if (lx->listTack > ms->codecTrainingSize)
+			    { for (i = 1; i < ms->share; i++)
+				vcAddHistogram (lx->listCodec,
+						ms[i].info[(int) t]->listCodec);
+			      vcCreateCodec (lx->listCodec, 1);
+			      for (i = 1; i < ms->share; i++)
+				{ OneCodec *m = ms[i].info[(int) t]->listCodec;
+				  ms[i].info[(int) t]->listCodec = lx->listCodec;
+				  vcDestroy (m);
 				}
+			      lx->isUseListCodec = true;
+			      for (i = 1; i < ms->share; i++)
+				ms[i].info[(int) t]->isUseListCodec = true;
 			    }
-			  
-			  pthread_mutex_unlock(&ms->listLock);
 			}
 		    }
+		  
+		  pthread_mutex_unlock(&ms->listLock);
 		}
 	    }
 	}
@@ -16,10 +16,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "DB.h"
 #include "align.h"
@@ -3236,6 +3240,1210 @@ int Check_Trace_Points(Overlap *ovl, int tspace, int verbose, char *fname)
 }
 
 
+/****************************************************************************************\
+*                                                                                        *
+*  ASYNCHRONOUS .LAS READER                                                              *
+*                                                                                        *
+\****************************************************************************************/
+
+//  A reader has two buffers, the one whose records are being consumed, and the other that
+//    is being filled with the next portion of the file by one of the LAS_IO_THREADS threads
+//    of a pool shared by all readers.  A record that straddles the two buffers is assembled
+//    in a "spill" buffer.  All coordination is through the single mutex LAS_Mutex:  a reader
+//    with a pending fill request is on the LAS_Queue and LAS_Work is signaled, when a fill
+//    is complete LAS_Done is broadcast.  For a blocked file a fill decodes whole blocks into
+//    the buffer (enlarging it if a single block does not fit), so records never straddle.
+
+#define LAS_IO_THREADS 4
+
+#define LAS_BLOCK_MAGIC  0xb10c4c41u   //  Start of every block of a blocked .las file
+#define LAS_TABLE_MAGIC  0x7ab14c41u   //  Start of its block table
+
+typedef struct
+  { uint32 magic;    //  LAS_BLOCK_MAGIC
+    int    nrec;     //  # of records in the block
+    int    csize;    //  # of bytes of coded records following the header
+    int    rsize;    //  # of bytes of the records in the raw format
+    int    tspace;   //  Trace spacing
+    int    tbytes;   //    and trace element size of the records
+  } Las_Block;
+
+typedef struct
+  { uint32 magic;    //  LAS_TABLE_MAGIC
+    int    sorted;   //  Are the records sorted on A-read?
+    int64  nblk;     //  # of blocks (and entries following)
+    int64  rsize;    //  Total size of the records in the raw format
+  } Las_Table;
+
+#define BUF_EMPTY  0
+#define BUF_FILL   1
+#define BUF_FULL   2
+
+typedef struct _las_reader
+  { FILE   *input;      //  Source file
+    int     fd;         //  and its descriptor
+    int64   off;        //  Next file position to read (if ranged)
+    int64   end;        //  End of range (< 0 if reading the stream sequentially)
+    int     tbytes;     //  Bytes per trace element
+    int64   bsize;      //  Size of each buffer
+    char   *buf[2];     //  The two buffers (with PtrSize bytes before each)
+    int64   bmax[2];    //  Their allocated sizes (>= bsize)
+    int64   len[2];     //  # of bytes in each full buffer
+    int     last[2];    //  Is the buffer the last portion of the input?
+    int     state[2];   //  BUF_EMPTY, BUF_FILL, or BUF_FULL
+    int     cur;        //  Buffer being consumed (-1 until first record is requested)
+    char   *ptr;        //  Next unconsumed byte of the current buffer
+    char   *top;        //  End of current buffer data
+    char   *spill;      //  Buffer for assembling straddling records
+    int64   smax;       //    and its size
+    int64   residue;    //  # of bytes in an incomplete final record
+    int     pend;       //  Buffer of pending fill request
+    struct _las_reader *next;   //  Link in LAS_Queue
+    int     blocked;    //  Is the input in the blocked format?
+    char    peek[4];    //  Bytes read from a stream to see if it is blocked
+    int     npeek;      //    and not yet delivered
+    Las_Block hdr;      //  Header of the next block
+    int     hvalid;     //    if it has been read
+    char   *code;       //  Coded records of a block
+    int64   cmax;       //    and the size of its buffer
+  } _Las_Reader;
+
+static pthread_mutex_t LAS_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  LAS_Work  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  LAS_Done  = PTHREAD_COND_INITIALIZER;
+
+static _Las_Reader *LAS_Queue = NULL;   //  FIFO of readers with a pending fill request
+static _Las_Reader *LAS_Tail  = NULL;
+static int          LAS_Pool  = 0;      //  Has the thread pool been started?
+
+  //  Variable length integer coding (7 bits per byte, low order first), and zig-zag
+  //    coding of signed 32-bit differences
+
+#define ZIG(x)  ((((uint32) (x)) << 1) ^ (uint32) (((int32) (x)) >> 31))
+#define ZAG(v)  ((int32) (((v) >> 1) ^ (-((v) & 1))))
+
+static inline char *put_varint(char *p, uint32 v)
+{ while (v >= 0x80)
+    { *p++ = (char) (v | 0x80);
+      v >>= 7;
+    }
+  *p++ = (char) v;
+  return (p);
+}
+
+static inline char *get_varint(char *p, char *e, uint32 *v)
+{ uint32 x;
+  int    s;
+
+  x = 0;
+  for (s = 0; s < 35; s += 7)
+    { if (p >= e)
+        return (NULL);
+      x |= ((uint32) (*p & 0x7f)) << s;
+      if ((*p++ & 0x80) == 0)
+        { *v = x;
+          return (p);
+        }
+    }
+  return (NULL);
+}
+
+  //  Rice coding of trace values: the quotient v >> k in unary (a run of 1's ended by a 0)
+  //    followed by the k low order bits of v.  A quotient of RICE_ESC or more is instead
+  //    RICE_ESC 1's followed by v in 32 bits.  Bits are packed high order first.
+
+#define RICE_ESC 24
+
+typedef struct
+  { uint8 *ptr;     //  Next byte
+    uint8 *end;     //  End of buffer (reading only)
+    uint64 acc;     //  Bit accumulator
+    int    nbits;   //    and # of bits in it
+  } Bit_IO;
+
+static inline void put_bits(Bit_IO *b, uint32 v, int n)
+{ if (n == 32)
+    { put_bits(b,v >> 16,16);
+      v &= 0xffff;
+      n  = 16;
+    }
+  b->acc    = (b->acc << n) | v;
+  b->nbits += n;
+  while (b->nbits >= 8)
+    { b->nbits -= 8;
+      *b->ptr++ = (uint8) (b->acc >> b->nbits);
+    }
+}
+
+static inline void put_rice(Bit_IO *b, uint32 v, int k)
+{ uint32 q = v >> k;
+
+  if (q >= RICE_ESC)
+    { put_bits(b,(1u << RICE_ESC) - 1,RICE_ESC);
+      put_bits(b,v,32);
+      return;
+    }
+  while (q >= 16)
+    { put_bits(b,0xffff,16);
+      q -= 16;
+    }
+  put_bits(b,((1u << q) - 1) << 1,q+1);
+  if (k > 0)
+    put_bits(b,v & ((1u << k) - 1),k);
+}
+
+static inline int get_bit(Bit_IO *b, uint32 *v)
+{ if (b->nbits == 0)
+    { if (b->ptr >= b->end)
+        return (1);
+      b->acc   = *b->ptr++;
+      b->nbits = 8;
+    }
+  b->nbits -= 1;
+  *v = (b->acc >> b->nbits) & 0x1;
+  return (0);
+}
+
+static inline int get_bits(Bit_IO *b, int n, uint32 *v)
+{ uint32 x, y;
+
+  x = 0;
+  while (n-- > 0)
+    { if (get_bit(b,&y))
+        return (1);
+      x = (x << 1) | y;
+    }
+  *v = x;
+  return (0);
+}
+
+static inline int get_rice(Bit_IO *b, int k, uint32 *v)
+{ uint32 q, x, y;
+
+  q = 0;
+  while (1)
+    { if (get_bit(b,&y))
+        return (1);
+      if (y == 0)
+        break;
+      if (++q == RICE_ESC)
+        return (get_bits(b,32,v));
+    }
+  if (get_bits(b,k,&x))
+    return (1);
+  *v = (q << k) | x;
+  return (0);
+}
+
+  //  Bytes of an Overlap record following its bread field (padding) in the raw format
+
+#define PAD_OFF  (offsetof(Overlap,bread) + sizeof(int) - sizeof(void *))
+#define PAD_LEN  ((int) (sizeof(Overlap) - sizeof(void *) - PAD_OFF))
+
+  //  The value a trace element is coded relative to:  the b-advance of a pair relative to
+  //    tspace, and the # of differences relative to the mean over the record's pairs
+
+static inline int trace_base(Overlap *ovl, int i, int tspace)
+{ int np;
+
+  if (i & 0x1)
+    return (tspace);
+  np = ovl->path.tlen/2;
+  if (np == 0 || ovl->path.diffs < 0)
+    return (0);
+  return ((ovl->path.diffs + np/2) / np);
+}
+
+static inline uint32 trace_value(Overlap *ovl, void *t, int i, int tbytes, int tspace)
+{ int v;
+
+  if (tbytes == 1)
+    v = ((uint8 *) t)[i];
+  else
+    v = ((uint16 *) t)[i];
+  return (ZIG(v - trace_base(ovl,i,tspace)));
+}
+
+  //  Code the nrec records in the raw format at raw into code, returning the size of the coding.
+  //    The coding is: the Rice parameters for the # of differences and the b-advances of
+  //    trace pairs (a byte each), then the size of the field coding as a varint, the field
+  //    coding, and lastly the Rice coding of the traces of all the records.  The A- and
+  //    B-read of a record are coded relative to those of the previous record.
+
+static int64 las_encode(char *raw, int nrec, int tbytes, int tspace, char *code)
+{ char    *o, *p, *f;
+  Overlap *ovl;
+  Bit_IO   bio;
+  uint32   pad, v;
+  int64    cost[2][16];
+  int      aread, bread;
+  int      i, j, k, r, kpar[2];
+
+  //  Choose the Rice parameter for each kind of trace value that minimizes its coding
+
+  for (j = 0; j < 2; j++)
+    for (k = 0; k < 16; k++)
+      cost[j][k] = 0;
+  for (o = raw, r = 0; r < nrec; r++)
+    { ovl = (Overlap *) (o - PtrSize);
+      o  += OvlIOSize;
+      for (i = 0; i < ovl->path.tlen; i++)
+        { v = trace_value(ovl,o,i,tbytes,tspace);
+          for (k = 0; k < 16; k++)
+            if ((v >> k) >= RICE_ESC)
+              cost[i&0x1][k] += RICE_ESC + 32;
+            else
+              cost[i&0x1][k] += (v >> k) + 1 + k;
+        }
+      o += ovl->path.tlen * tbytes;
+    }
+  for (j = 0; j < 2; j++)
+    { kpar[j] = 0;
+      for (k = 1; k < 16; k++)
+        if (cost[j][k] < cost[j][kpar[j]])
+          kpar[j] = k;
+    }
+
+  //  Code the fields into code (after room for the header), then move them into place
+
+  f = code + 16;
+  p = f;
+  aread = bread = 0;
+  for (o = raw, r = 0; r < nrec; r++)
+    { ovl = (Overlap *) (o - PtrSize);
+      p = put_varint(p,ZIG((uint32) ovl->aread - (uint32) aread));
+      p = put_varint(p,ZIG((uint32) ovl->bread - (uint32) bread));
+      p = put_varint(p,ovl->flags);
+      p = put_varint(p,ZIG(ovl->path.abpos));
+      p = put_varint(p,ZIG((uint32) ovl->path.aepos - (uint32) ovl->path.abpos));
+      p = put_varint(p,ZIG(ovl->path.bbpos));
+      p = put_varint(p,ZIG((uint32) ovl->path.bepos - (uint32) ovl->path.bbpos));
+      p = put_varint(p,ZIG(ovl->path.diffs));
+      p = put_varint(p,ZIG(ovl->path.tlen));
+      pad = 0;
+      if (PAD_LEN > 0)
+        memcpy(&pad,o + PAD_OFF,PAD_LEN);
+      p = put_varint(p,pad);
+      aread = ovl->aread;
+      bread = ovl->bread;
+      o += OvlIOSize + ovl->path.tlen * tbytes;
+    }
+
+  code[0] = (char) kpar[0];
+  code[1] = (char) kpar[1];
+  o = put_varint(code+2,(uint32) (p-f));
+  memmove(o,f,p-f);
+  p = o + (p-f);
+
+  //  Rice code the traces
+
+  bio.ptr   = (uint8 *) p;
+  bio.acc   = 0;
+  bio.nbits = 0;
+  for (o = raw, r = 0; r < nrec; r++)
+    { ovl = (Overlap *) (o - PtrSize);
+      o  += OvlIOSize;
+      for (i = 0; i < ovl->path.tlen; i++)
+        put_rice(&bio,trace_value(ovl,o,i,tbytes,tspace),kpar[i&0x1]);
+      o += ovl->path.tlen * tbytes;
+    }
+  if (bio.nbits > 0)
+    put_bits(&bio,0,8-bio.nbits);
+
+  return (((char *) bio.ptr) - code);
+}
+
+  //  An upper bound on the size of the coding of rsize bytes of nrec raw records
+
+#define LAS_CODE_BOUND(rsize,nrec)  (16 + 50*(nrec) + 8*(rsize))
+
+  //  Decode the nrec records coded in code[0..csize-1] into the rsize bytes at out.  Return
+  //    non-zero if the coding is not consistent with these sizes.
+
+static int las_decode(char *code, int64 csize, int nrec, char *out, int64 rsize,
+                      int tbytes, int tspace)
+{ char    *p, *e, *o, *f;
+  Overlap *ovl;
+  Bit_IO   bio;
+  uint32   v, pad;
+  int      aread, bread;
+  int      i, r, kpar[2];
+
+  e = code + csize;
+  f = out + rsize;
+  if (csize < 3)
+    return (nrec != 0 || rsize != 0);
+  kpar[0] = code[0];
+  kpar[1] = code[1];
+  if (kpar[0] < 0 || kpar[0] >= 16 || kpar[1] < 0 || kpar[1] >= 16)
+    return (1);
+  if ((p = get_varint(code+2,e,&v)) == NULL || v > e-p)
+    return (1);
+  e = p + v;
+
+#define GET(v)  { if ((p = get_varint(p,e,&(v))) == NULL) return (1); }
+
+  o = out;
+  aread = bread = 0;
+  for (r = 0; r < nrec; r++)
+    { if (o + OvlIOSize > f)
+        return (1);
+      ovl = (Overlap *) (o - PtrSize);
+      GET(v) aread = (int) ((uint32) aread + (uint32) ZAG(v));
+      GET(v) bread = (int) ((uint32) bread + (uint32) ZAG(v));
+      ovl->aread = aread;
+      ovl->bread = bread;
+      GET(v) ovl->flags = v;
+      GET(v) ovl->path.abpos = ZAG(v);
+      GET(v) ovl->path.aepos = (int) ((uint32) ovl->path.abpos + (uint32) ZAG(v));
+      GET(v) ovl->path.bbpos = ZAG(v);
+      GET(v) ovl->path.bepos = (int) ((uint32) ovl->path.bbpos + (uint32) ZAG(v));
+      GET(v) ovl->path.diffs = ZAG(v);
+      GET(v) ovl->path.tlen  = ZAG(v);
+      GET(pad)
+      if (PAD_LEN > 0)
+        memcpy(o + PAD_OFF,&pad,PAD_LEN);
+      o += OvlIOSize;
+      if (ovl->path.tlen < 0 || ovl->path.tlen > (f-o)/tbytes)
+        return (1);
+      o += ovl->path.tlen * tbytes;
+    }
+  if (o != f || p != e)
+    return (1);
+
+#undef GET
+
+  bio.ptr   = (uint8 *) e;
+  bio.end   = (uint8 *) (code + csize);
+  bio.nbits = 0;
+  for (o = out, r = 0; r < nrec; r++)
+    { ovl = (Overlap *) (o - PtrSize);
+      o  += OvlIOSize;
+      for (i = 0; i < ovl->path.tlen; i++)
+        { if (get_rice(&bio,kpar[i&0x1],&v))
+            return (1);
+          v = ZAG(v) + trace_base(ovl,i,tspace);
+          if (tbytes == 1)
+            ((uint8 *) o)[i] = (uint8) v;
+          else
+            ((uint16 *) o)[i] = (uint16) v;
+        }
+      o += ovl->path.tlen * tbytes;
+    }
+  return (bio.ptr != bio.end);
+}
+
+  //  Read the next n bytes of r's input into dst, first delivering any bytes peeked at when
+  //    the reader was opened.  Return the # of bytes read (< n only at the end of input).
+
+static int64 las_read(_Las_Reader *r, char *dst, int64 n)
+{ int64 k, m;
+
+  k = 0;
+  if (r->npeek > 0)
+    { k = (n < r->npeek ? n : r->npeek);
+      memcpy(dst,r->peek,k);
+      memmove(r->peek,r->peek+k,r->npeek-k);
+      r->npeek -= k;
+    }
+  if (r->end < 0)
+    { m = fread(dst+k,1,n-k,r->input);
+      if (m < n-k && ferror(r->input))
+        SYSTEM_READ_ERROR
+    }
+  else
+    { m = r->end - r->off;
+      if (m > n-k)
+        m = n-k;
+      if (m < 0)
+        m = 0;
+      if (m > 0 && pread(r->fd,dst+k,m,r->off) != m)
+        SYSTEM_READ_ERROR
+      r->off += m;
+    }
+  return (k+m);
+}
+
+static void las_corrupt()
+{ fprintf(stderr,"%s: Corrupted block in blocked .las file\n",Prog_Name);
+  exit (1);
+}
+
+  //  Fill buffer b of blocked reader r with as many whole blocks as fit, returning the
+  //    # of bytes of records filled
+
+static int64 las_fill_blocks(_Las_Reader *r, int b)
+{ Las_Block *h = &(r->hdr);
+  int64      n, k;
+
+  n = 0;
+  r->last[b] = 0;
+  while (1)
+    { if ( ! r->hvalid)
+        { k = las_read(r,(char *) h,sizeof(Las_Block));
+          if (k == 0 || (k >= (int64) sizeof(uint32) && h->magic == LAS_TABLE_MAGIC))
+            { r->last[b] = 1;
+              break;
+            }
+          if (k < (int64) sizeof(Las_Block) || h->magic != LAS_BLOCK_MAGIC
+                                            || h->tbytes != r->tbytes
+                                            || h->nrec < 0 || h->csize < 0 || h->rsize < 0)
+            las_corrupt();
+          r->hvalid = 1;
+        }
+
+      if (n + h->rsize > r->bmax[b])
+        { if (n > 0)
+            break;
+          r->bmax[b] = h->rsize;
+          r->buf[b]  = (char *) Realloc(r->buf[b]-PtrSize,r->bmax[b]+PtrSize,
+                                        "Enlarging .las reader buffer");
+          if (r->buf[b] == NULL)
+            exit (1);
+          r->buf[b] += PtrSize;
+        }
+      if (h->csize > r->cmax)
+        { r->cmax = 1.2*h->csize + 1000;
+          r->code = (char *) Realloc(r->code,r->cmax,"Enlarging .las reader buffer");
+          if (r->code == NULL)
+            exit (1);
+        }
+
+      if (las_read(r,r->code,h->csize) != h->csize)
+        las_corrupt();
+      if (las_decode(r->code,h->csize,h->nrec,r->buf[b]+n,h->rsize,r->tbytes,h->tspace))
+        las_corrupt();
+      n += h->rsize;
+      r->hvalid = 0;
+    }
+  return (n);
+}
+
+static void *las_io_thread(void *arg)
+{ _Las_Reader *r;
+  int64        n;
+  int          b;
+
+  (void) arg;
+  while (1)
+    { pthread_mutex_lock(&LAS_Mutex);
+      while (LAS_Queue == NULL)
+        pthread_cond_wait(&LAS_Work,&LAS_Mutex);
+      r = LAS_Queue;
+      LAS_Queue = r->next;
+      if (LAS_Queue == NULL)
+        LAS_Tail = NULL;
+      pthread_mutex_unlock(&LAS_Mutex);
+
+      b = r->pend;
+      if (r->blocked)
+        n = las_fill_blocks(r,b);
+      else
+        { n = las_read(r,r->buf[b],r->bsize);
+          r->last[b] = (n < r->bsize || (r->end >= 0 && r->off >= r->end));
+        }
+
+      pthread_mutex_lock(&LAS_Mutex);
+      r->len[b]   = n;
+      r->state[b] = BUF_FULL;
+      r->pend     = -1;
+      pthread_cond_broadcast(&LAS_Done);
+      pthread_mutex_unlock(&LAS_Mutex);
+    }
+  return (NULL);
+}
+
+static void las_request(_Las_Reader *r, int b)   //  Called with LAS_Mutex locked
+{ r->state[b] = BUF_FILL;
+  r->pend     = b;
+  r->next     = NULL;
+  if (LAS_Tail == NULL)
+    LAS_Queue = r;
+  else
+    LAS_Tail->next = r;
+  LAS_Tail = r;
+  pthread_cond_signal(&LAS_Work);
+}
+
+Las_Reader *Open_Las_Reader(FILE *input, int64 beg, int64 end, int64 bsize, int tbytes)
+{ _Las_Reader *r;
+
+  r = (_Las_Reader *) Malloc(sizeof(_Las_Reader),"Allocating .las reader");
+  if (r == NULL)
+    EXIT(NULL);
+  r->buf[0] = (char *) Malloc(bsize+PtrSize,"Allocating .las reader buffers");
+  r->buf[1] = (char *) Malloc(bsize+PtrSize,"Allocating .las reader buffers");
+  r->spill  = (char *) Malloc(PtrSize+OvlIOSize,"Allocating .las reader buffers");
+  if (r->buf[0] == NULL || r->buf[1] == NULL || r->spill == NULL)
+    { free(r->spill);
+      free(r->buf[1]);
+      free(r->buf[0]);
+      free(r);
+      EXIT(NULL);
+    }
+  r->buf[0] += PtrSize;
+  r->buf[1] += PtrSize;
+  r->bmax[0] = r->bmax[1] = bsize;
+  r->spill  += PtrSize;
+  r->smax    = OvlIOSize;
+
+  //  See if the input is blocked from the first 4 bytes, which for a stream are kept to
+  //    be delivered first
+
+  r->blocked = 0;
+  r->npeek   = 0;
+  r->hvalid  = 0;
+  r->code    = NULL;
+  r->cmax    = 0;
+  if (end < 0)
+    r->npeek = fread(r->peek,1,sizeof(uint32),input);
+  else if (end - beg >= (int64) sizeof(uint32))
+    { if (pread(fileno(input),r->peek,sizeof(uint32),beg) != sizeof(uint32))
+        SYSTEM_READ_ERROR
+    }
+  if ((end < 0 && r->npeek == sizeof(uint32)) || (end >= 0 && end - beg >= (int64) sizeof(uint32)))
+    { uint32 magic;
+
+      memcpy(&magic,r->peek,sizeof(uint32));
+      r->blocked = (magic == LAS_BLOCK_MAGIC);
+    }
+
+  r->input   = input;
+  r->fd      = fileno(input);
+  r->off     = beg;
+  r->end     = end;
+  r->tbytes  = tbytes;
+  r->bsize   = bsize;
+  r->cur     = -1;
+  r->ptr     = NULL;
+  r->top     = NULL;
+  r->residue = 0;
+  r->pend    = -1;
+  r->state[0] = r->state[1] = BUF_EMPTY;
+  r->last[0]  = r->last[1]  = 0;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (end >= 0)
+    posix_fadvise(r->fd,beg,end-beg,POSIX_FADV_SEQUENTIAL);
+  else
+    posix_fadvise(r->fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+
+  pthread_mutex_lock(&LAS_Mutex);
+  if ( ! LAS_Pool)
+    { pthread_attr_t attr;
+      pthread_t      thread;
+      int            i;
+
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+      for (i = 0; i < LAS_IO_THREADS; i++)
+        pthread_create(&thread,&attr,las_io_thread,NULL);
+      pthread_attr_destroy(&attr);
+      LAS_Pool = 1;
+    }
+  las_request(r,0);
+  pthread_mutex_unlock(&LAS_Mutex);
+
+  return ((Las_Reader *) r);
+}
+
+  //  Release the current buffer and make the other buffer current, requesting a refill of
+  //    the released buffer if there is more to read.  Return 0 if there is no more data.
+
+static int las_advance(_Las_Reader *r)
+{ int c, o;
+
+  c = r->cur;
+  if (c >= 0 && r->last[c])
+    return (0);
+  o = (c < 0 ? 0 : 1-c);
+
+  pthread_mutex_lock(&LAS_Mutex);
+  if (c >= 0)
+    r->state[c] = BUF_EMPTY;
+  while (r->state[o] != BUF_FULL)
+    pthread_cond_wait(&LAS_Done,&LAS_Mutex);
+  if ( ! r->last[o])
+    las_request(r,1-o);
+  pthread_mutex_unlock(&LAS_Mutex);
+
+  r->cur = o;
+  r->ptr = r->buf[o];
+  r->top = r->buf[o] + r->len[o];
+  return (1);
+}
+
+Overlap *Next_Las_Record(Las_Reader *reader)
+{ _Las_Reader *r = (_Las_Reader *) reader;
+  int64        avail, span, have, need, take;
+  char        *rec;
+
+  if (r->cur < 0)
+    las_advance(r);
+
+  avail = r->top - r->ptr;
+  if (avail >= OvlIOSize)
+    { span = OvlIOSize + ((Overlap *) (r->ptr - PtrSize))->path.tlen * r->tbytes;
+      if (avail >= span)
+        { rec     = r->ptr;
+          r->ptr += span;
+          return ((Overlap *) (rec - PtrSize));
+        }
+    }
+
+  //  Record straddles buffers (or there are no more records)
+
+  have = 0;
+  need = OvlIOSize;
+  while (1)
+    { take = r->top - r->ptr;
+      if (take > need-have)
+        take = need-have;
+      if (have+take > r->smax)
+        { r->smax  = 1.2*(have+take) + 1000;
+          r->spill = (char *) Realloc(r->spill-PtrSize,r->smax+PtrSize,
+                                      "Reallocating .las reader spill buffer");
+          if (r->spill == NULL)
+            EXIT(NULL);
+          r->spill += PtrSize;
+        }
+      memcpy(r->spill+have,r->ptr,take);
+      r->ptr += take;
+      have   += take;
+      if (have == OvlIOSize && need == OvlIOSize)
+        need = OvlIOSize + ((Overlap *) (r->spill - PtrSize))->path.tlen * r->tbytes;
+      if (have == need)
+        return ((Overlap *) (r->spill - PtrSize));
+      if (r->ptr < r->top)
+        continue;
+      if ( ! las_advance(r))
+        { r->residue = have;
+          return (NULL);
+        }
+    }
+}
+
+int64 Read_Las_Bytes(Las_Reader *reader, char *data, int64 n)
+{ _Las_Reader *r = (_Las_Reader *) reader;
+  int64        have, take;
+
+  if (r->cur < 0)
+    las_advance(r);
+
+  have = 0;
+  while (1)
+    { take = r->top - r->ptr;
+      if (take > n-have)
+        take = n-have;
+      memcpy(data+have,r->ptr,take);
+      r->ptr += take;
+      have   += take;
+      if (have >= n || ! las_advance(r))
+        break;
+    }
+  return (have);
+}
+
+int64 Las_Reader_Residue(Las_Reader *reader)
+{ return (((_Las_Reader *) reader)->residue); }
+
+void Close_Las_Reader(Las_Reader *reader)
+{ _Las_Reader *r = (_Las_Reader *) reader;
+
+  pthread_mutex_lock(&LAS_Mutex);
+  while (r->pend >= 0)
+    pthread_cond_wait(&LAS_Done,&LAS_Mutex);
+  pthread_mutex_unlock(&LAS_Mutex);
+
+  free(r->code);
+  free(r->spill-PtrSize);
+  free(r->buf[1]-PtrSize);
+  free(r->buf[0]-PtrSize);
+  free(r);
+}
+
+
+/****************************************************************************************\
+*                                                                                        *
+*  BLOCKED .LAS WRITER                                                                   *
+*                                                                                        *
+\****************************************************************************************/
+
+typedef struct
+  { FILE            *output;
+    int              tspace;   //  Trace spacing
+    int              tbytes;   //    and trace element size
+    int64            off;      //  File offset of the block being built
+    int64            novl;     //  # of records written so far
+    char            *raw;      //  Records of the block being built in the raw format
+    int64            rsize;    //    their size
+    int64            rmax;     //    and the size of the buffer
+    int              nrec;     //  # of records in the block
+    char            *code;     //  Buffer for the coding of a block
+    int64            cmax;     //    and its size
+    int64            rtotal;   //  Raw size of all records so far
+    int              last;     //  A-read of the last record written
+    int              sorted;   //  Are the records so far sorted on A-read?
+    Las_Index_Entry *idx;      //  Block table
+    int64            nidx;
+    int64            maxi;
+  } _Las_Writer;
+
+static int las_flush_block(_Las_Writer *w)
+{ Las_Block h;
+  int64     need;
+
+  need = LAS_CODE_BOUND(w->rsize,w->nrec);
+  if (need > w->cmax)
+    { w->cmax = 1.2*need + 1000;
+      w->code = (char *) Realloc(w->code,w->cmax,"Enlarging .las writer");
+      if (w->code == NULL)
+        EXIT(1);
+    }
+
+  h.magic  = LAS_BLOCK_MAGIC;
+  h.nrec   = w->nrec;
+  h.csize  = las_encode(w->raw,w->nrec,w->tbytes,w->tspace,w->code);
+  h.rsize  = w->rsize;
+  h.tspace = w->tspace;
+  h.tbytes = w->tbytes;
+  if (fwrite(&h,sizeof(Las_Block),1,w->output) != 1
+        || fwrite(w->code,1,h.csize,w->output) != (size_t) h.csize)
+    { EPRINTF(EPLACE,"%s: Could not write blocked .las file\n",Prog_Name);
+      EXIT(1);
+    }
+  w->off  += sizeof(Las_Block) + h.csize;
+  w->nrec  = 0;
+  w->rsize = 0;
+  return (0);
+}
+
+Las_Writer *Open_Las_Writer(FILE *output, int tspace)
+{ _Las_Writer *w;
+
+  w = (_Las_Writer *) Malloc(sizeof(_Las_Writer),"Allocating .las writer");
+  if (w == NULL)
+    EXIT(NULL);
+  w->rmax = 1.2*LAS_BLOCK_RAW;
+  w->cmax = LAS_BLOCK_RAW;
+  w->maxi = 1000;
+  w->raw  = (char *) Malloc(w->rmax+PtrSize,"Allocating .las writer");
+  w->code = (char *) Malloc(w->cmax,"Allocating .las writer");
+  w->idx  = (Las_Index_Entry *) Malloc(sizeof(Las_Index_Entry)*w->maxi,"Allocating .las writer");
+  if (w->raw == NULL || w->code == NULL || w->idx == NULL)
+    { free(w->idx);
+      free(w->code);
+      free(w->raw);
+      free(w);
+      EXIT(NULL);
+    }
+  w->raw += PtrSize;
+
+  w->output = output;
+  w->tspace = tspace;
+  if (tspace <= TRACE_XOVR && tspace != 0)
+    w->tbytes = sizeof(uint8);
+  else
+    w->tbytes = sizeof(uint16);
+  w->off    = sizeof(int64) + sizeof(int);
+  w->novl   = 0;
+  w->nrec   = 0;
+  w->rsize  = 0;
+  w->rtotal = 0;
+  w->last   = -1;
+  w->sorted = 1;
+  w->nidx   = 0;
+  return ((Las_Writer *) w);
+}
+
+int Write_Las_Record(Las_Writer *writer, Overlap *ovl)
+{ _Las_Writer *w = (_Las_Writer *) writer;
+  int64        need, tsize;
+
+  if (w->nrec > 0 && w->rsize >= LAS_BLOCK_RAW && ! CHAIN_NEXT(ovl->flags))
+    { if (las_flush_block(w))
+        EXIT(1);
+    }
+
+  if (w->nrec == 0)
+    { if (w->nidx >= w->maxi)
+        { w->maxi = 1.2*w->nidx + 1000;
+          w->idx  = (Las_Index_Entry *) Realloc(w->idx,sizeof(Las_Index_Entry)*w->maxi,
+                                                "Enlarging .las writer");
+          if (w->idx == NULL)
+            EXIT(1);
+        }
+      w->idx[w->nidx].aread   = ovl->aread;
+      w->idx[w->nidx].pad     = (ovl->aread != w->last);
+      w->idx[w->nidx].offset  = w->off;
+      w->idx[w->nidx].ordinal = w->novl;
+      w->nidx += 1;
+    }
+
+  tsize = ovl->path.tlen * w->tbytes;
+  need  = w->rsize + OvlIOSize + tsize;
+  if (need > w->rmax)
+    { w->rmax = 1.2*need + 1000;
+      w->raw  = (char *) Realloc(w->raw-PtrSize,w->rmax+PtrSize,"Enlarging .las writer");
+      if (w->raw == NULL)
+        EXIT(1);
+      w->raw += PtrSize;
+    }
+  memcpy(w->raw+w->rsize,((char *) ovl)+PtrSize,OvlIOSize);
+  memcpy(w->raw+w->rsize+OvlIOSize,ovl->path.trace,tsize);
+
+  w->rsize  += OvlIOSize + tsize;
+  w->rtotal += OvlIOSize + tsize;
+  w->nrec   += 1;
+  w->novl   += 1;
+  if (ovl->aread < w->last)
+    w->sorted = 0;
+  w->last = ovl->aread;
+  return (0);
+}
+
+int Close_Las_Writer(Las_Writer *writer)
+{ _Las_Writer *w = (_Las_Writer *) writer;
+  Las_Table    t;
+  int          status;
+
+  status = 0;
+  if (w->nrec > 0)
+    status = las_flush_block(w);
+  if (status == 0)
+    { t.magic  = LAS_TABLE_MAGIC;
+      t.sorted = w->sorted;
+      t.nblk   = w->nidx;
+      t.rsize  = w->rtotal;
+      if (fwrite(&t,sizeof(Las_Table),1,w->output) != 1
+            || fwrite(w->idx,sizeof(Las_Index_Entry),w->nidx,w->output) != (size_t) w->nidx
+            || fwrite(&(w->off),sizeof(int64),1,w->output) != 1)
+        { EPRINTF(EPLACE,"%s: Could not write blocked .las file\n",Prog_Name);
+          status = 1;
+        }
+    }
+
+  free(w->idx);
+  free(w->code);
+  free(w->raw-PtrSize);
+  free(w);
+  if (status)
+    EXIT(1);
+  return (0);
+}
+
+
+
+/****************************************************************************************\
+*                                                                                        *
+*  PILE INDEX                                                                            *
+*                                                                                        *
+\****************************************************************************************/
+
+//  The sidecar <name>.las.idx of <name>.las consists of a header (novl, fsize, mtime, sample,
+//    nidx) followed by nidx Las_Index_Entry records in file order.  novl, fsize, and mtime are
+//    those of the .las file when the index was built, and fsize and mtime are checked when the
+//    index is opened, so a .las file rewritten since (even to the same size) is not indexed by
+//    it.  The index of an older version without mtime is stale as its sample and nidx are
+//    read as the mtime.
+
+static char *las_index_name(char *las)    //  Not Catenate as las may be its buffer
+{ char *name;
+
+  name = (char *) Malloc(strlen(las)+5,"Allocating index file name");
+  if (name != NULL)
+    sprintf(name,"%s.idx",las);
+  return (name);
+}
+
+int Las_Is_Blocked(FILE *input)
+{ uint32 magic;
+
+  if (pread(fileno(input),&magic,sizeof(uint32),sizeof(int64)+sizeof(int)) != sizeof(uint32))
+    return (0);
+  return (magic == LAS_BLOCK_MAGIC);
+}
+
+Las_Index *Read_Las_Blocks(FILE *input, int *sorted, int64 *rsize)
+{ Las_Index  *index;
+  Las_Table   t;
+  struct stat info;
+  int64       toff, novl;
+  int         fd;
+
+  fd = fileno(input);
+  if ( ! Las_Is_Blocked(input) || fstat(fd,&info) != 0)
+    return (NULL);
+  if (pread(fd,&novl,sizeof(int64),0) != sizeof(int64)
+        || pread(fd,&toff,sizeof(int64),info.st_size-sizeof(int64)) != sizeof(int64)
+        || toff < 0 || toff + (int64) sizeof(Las_Table) > info.st_size
+        || pread(fd,&t,sizeof(Las_Table),toff) != sizeof(Las_Table)
+        || t.magic != LAS_TABLE_MAGIC || t.nblk < 0
+        || toff + (int64) (sizeof(Las_Table) + sizeof(Las_Index_Entry)*t.nblk + sizeof(int64))
+             != info.st_size)
+    return (NULL);
+
+  index = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating block table");
+  if (index == NULL)
+    return (NULL);
+  index->idx = (Las_Index_Entry *) Malloc(sizeof(Las_Index_Entry)*(t.nblk+1),
+                                          "Allocating block table");
+  if (index->idx == NULL)
+    { free(index);
+      return (NULL);
+    }
+  if (pread(fd,index->idx,sizeof(Las_Index_Entry)*t.nblk,toff+sizeof(Las_Table))
+         != (ssize_t) (sizeof(Las_Index_Entry)*t.nblk))
+    { Free_Las_Index(index);
+      return (NULL);
+    }
+  index->novl   = novl;
+  index->fsize  = info.st_size;
+  index->mtime  = info.st_mtime;
+  index->sample = 0;
+  index->nidx   = t.nblk;
+  if (sorted != NULL)
+    *sorted = t.sorted;
+  if (rsize != NULL)
+    *rsize = t.rsize;
+  return (index);
+}
+
+int64 Las_Block_Size(FILE *input, Las_Index_Entry *e)
+{ Las_Block h;
+
+  if (pread(fileno(input),&h,sizeof(Las_Block),e->offset) != sizeof(Las_Block)
+        || h.magic != LAS_BLOCK_MAGIC || h.rsize < 0)
+    return (-1);
+  return (h.rsize);
+}
+
+#define LAS_INDEX_BUFFER  16000000ll
+
+int Write_Las_Index(char *las, int sample)
+{ FILE            *input, *output;
+  char            *iname;
+  Las_Reader      *reader;
+  Las_Index_Entry *idx;
+  Overlap         *w;
+  struct stat      info;
+  int64            novl, fsize, mtime, off, j;
+  int              tspace, tbytes;
+  int              nidx, maxi, next, last;
+
+  input = Fopen(las,"r");
+  if (input == NULL)
+    EXIT(1);
+  if (fstat(fileno(input),&info) != 0)
+    { EPRINTF(EPLACE,"%s: Cannot stat %s\n",Prog_Name,las);
+      fclose(input);
+      EXIT(1);
+    }
+  fsize = info.st_size;
+  mtime = info.st_mtime;
+  if (fread(&novl,sizeof(int64),1,input) != 1 || fread(&tspace,sizeof(int),1,input) != 1)
+    { EPRINTF(EPLACE,"%s: Cannot read header of %s\n",Prog_Name,las);
+      fclose(input);
+      EXIT(1);
+    }
+  if (Las_Is_Blocked(input))      //  Its block table serves as its index
+    { fclose(input);
+      return (0);
+    }
+  if (tspace <= TRACE_XOVR && tspace != 0)
+    tbytes = sizeof(uint8);
+  else
+    tbytes = sizeof(uint16);
+
+  reader = Open_Las_Reader(input,-1,-1,LAS_INDEX_BUFFER,tbytes);
+  maxi   = 1000;
+  idx    = (Las_Index_Entry *) Malloc(sizeof(Las_Index_Entry)*maxi,"Allocating pile index");
+  if (reader == NULL || idx == NULL)
+    { fclose(input);
+      EXIT(1);
+    }
+
+  //  Scan the file, adding an entry at the first record of a pile whose A-read is at least
+  //    sample greater than that of the last entry.
+
+  nidx = 0;
+  next = 0;
+  last = -1;
+  off  = sizeof(int64) + sizeof(int);
+  for (j = 0; j < novl; j++)
+    { w = Next_Las_Record(reader);
+      if (w == NULL)
+        { EPRINTF(EPLACE,"%s: %s has fewer records than its header says\n",Prog_Name,las);
+          break;
+        }
+      if (w->aread < last)
+        { EPRINTF(EPLACE,"%s: %s is not sorted, cannot index it\n",Prog_Name,las);
+          break;
+        }
+      if (w->aread != last && w->aread >= next)
+        { if (nidx >= maxi)
+            { maxi = 1.2*nidx + 1000;
+              idx  = (Las_Index_Entry *) Realloc(idx,sizeof(Las_Index_Entry)*maxi,
+                                                 "Reallocating pile index");
+              if (idx == NULL)
+                break;
+            }
+          idx[nidx].aread   = w->aread;
+          idx[nidx].pad     = 0;
+          idx[nidx].offset  = off;
+          idx[nidx].ordinal = j;
+          nidx += 1;
+          next  = w->aread + sample;
+        }
+      last = w->aread;
+      off += OvlIOSize + w->path.tlen*tbytes;
+    }
+  Close_Las_Reader(reader);
+  fclose(input);
+
+  if (j < novl)
+    { free(idx);
+      EXIT(1);
+    }
+
+  iname  = las_index_name(las);
+  output = NULL;
+  if (iname != NULL)
+    output = Fopen(iname,"w");
+  if (output == NULL)
+    { free(iname);
+      free(idx);
+      EXIT(1);
+    }
+  if (fwrite(&novl,sizeof(int64),1,output) != 1
+        || fwrite(&fsize,sizeof(int64),1,output) != 1
+        || fwrite(&mtime,sizeof(int64),1,output) != 1
+        || fwrite(&sample,sizeof(int),1,output) != 1
+        || fwrite(&nidx,sizeof(int),1,output) != 1
+        || fwrite(idx,sizeof(Las_Index_Entry),nidx,output) != (size_t) nidx
+        || fclose(output) != 0)
+    { EPRINTF(EPLACE,"%s: Could not write pile index %s\n",Prog_Name,iname);
+      free(iname);
+      free(idx);
+      EXIT(1);
+    }
+
+  free(iname);
+  free(idx);
+  return (0);
+}
+
+  //  The block table of the blocked file las as an index if it is sorted, else NULL
+
+static Las_Index *las_block_index(char *las)
+{ FILE      *input;
+  Las_Index *index;
+  int        sorted;
+  int64      i;
+
+  input = fopen(las,"r");
+  if (input == NULL)
+    return (NULL);
+  index = Read_Las_Blocks(input,&sorted,NULL);
+  fclose(input);
+  if (index == NULL)
+    return (NULL);
+  if ( ! sorted)
+    { Free_Las_Index(index);
+      return (NULL);
+    }
+  for (i = 0; i < index->nidx; i++)
+    if ( ! index->idx[i].pad)
+      index->idx[i].aread += 1;
+  return (index);
+}
+
+Las_Index *Open_Las_Index(char *las)
+{ FILE       *input;
+  char       *iname;
+  Las_Index  *index;
+  struct stat info;
+
+  if (stat(las,&info) != 0)
+    return (NULL);
+  iname = las_index_name(las);
+  if (iname == NULL)
+    return (NULL);
+  input = fopen(iname,"r");
+  free(iname);
+  if (input == NULL)
+    return (las_block_index(las));
+
+  index = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating pile index");
+  if (index == NULL)
+    { fclose(input);
+      return (NULL);
+    }
+  index->idx = NULL;
+
+  if (fread(&(index->novl),sizeof(int64),1,input) != 1
+        || fread(&(index->fsize),sizeof(int64),1,input) != 1
+        || fread(&(index->mtime),sizeof(int64),1,input) != 1
+        || fread(&(index->sample),sizeof(int),1,input) != 1
+        || fread(&(index->nidx),sizeof(int),1,input) != 1
+        || index->fsize != info.st_size || index->mtime != (int64) info.st_mtime
+        || index->nidx < 0)
+    goto stale;
+
+  index->idx = (Las_Index_Entry *) Malloc(sizeof(Las_Index_Entry)*(index->nidx+1),
+                                          "Allocating pile index");
+  if (index->idx == NULL)
+    goto stale;
+  if (fread(index->idx,sizeof(Las_Index_Entry),index->nidx,input) != (size_t) index->nidx)
+    goto stale;
+  fclose(input);
+  return (index);
+
+stale:
+  fclose(input);
+  free(index->idx);
+  free(index);
+  return (las_block_index(las));
+}
+
+Las_Index_Entry *Find_Las_Pile(Las_Index *index, int aread)
+{ Las_Index_Entry *idx = index->idx;
+  int              l, r, m;
+
+  if (index->nidx == 0 || idx[0].aread > aread)
+    return (NULL);
+  l = 0;
+  r = index->nidx;
+  while (r-l > 1)
+    { m = (l+r)/2;
+      if (idx[m].aread <= aread)
+        l = m;
+      else
+        r = m;
+    }
+  return (idx+l);
+}
+
+int64 Seek_Las_Pile(FILE *input, Las_Index *index, int aread)
+{ Las_Index_Entry *e;
+
+  e = Find_Las_Pile(index,aread);
+  if (e == NULL)
+    { if (fseeko(input,sizeof(int64)+sizeof(int),SEEK_SET) != 0)
+        return (-1);
+      return (0);
+    }
+  if (fseeko(input,e->offset,SEEK_SET) != 0)
+    return (-1);
+  return (e->ordinal);
+}
+
+void Free_Las_Index(Las_Index *index)
+{ free(index->idx);
+  free(index);
+}
+
 void Flip_Alignment(Alignment *align, int full)
 { char *aseq  = align->aseq;
   char *bseq  = align->bseq;
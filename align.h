@@ -375,6 +375,116 @@ typedef struct {
 
   int  Check_Trace_Points(Overlap *ovl, int tspace, int verbose, char *fname);
 
+  /* A Las_Reader delivers the records of a .las file from two alternating buffers, one of
+     which is filled in the background by a pool of I/O threads while the records of the other
+     are consumed.  Open_Las_Reader creates a reader for the byte range [beg,end) of 'input',
+     read with pread so that several readers can share a file, or if end < 0, for the rest of
+     'input' read sequentially from its current position (e.g. a pipe).  Each buffer has
+     'bsize' bytes and trace elements are 'tbytes' bytes.  NULL is returned if there is not
+     enough memory.
+
+     Next_Las_Record returns the next record, whose trace (not set in the trace field)
+     immediately follows it in memory, i.e. at (ovl+1).  The record is valid until the next
+     call and may be modified by the caller.  NULL is returned at the end of the input, and
+     then Las_Reader_Residue gives the number of bytes of an incomplete final record, if any.
+     Close_Las_Reader frees the reader, but does not close 'input'.  Read_Las_Bytes instead
+     delivers the next n bytes of records as they are laid out in a .las file, returning the
+     number delivered (< n only at the end of the input).  The two should not be mixed.
+
+     A reader accepts .las files in either the raw or the blocked format (see below), the
+     latter being recognized by the magic number at the start of each block, and decoded by
+     the I/O threads.  A range of a blocked file must begin at the start of a block.
+  */
+
+  typedef void Las_Reader;
+
+  Las_Reader *Open_Las_Reader(FILE *input, int64 beg, int64 end, int64 bsize, int tbytes);
+  Overlap    *Next_Las_Record(Las_Reader *reader);
+  int64       Read_Las_Bytes(Las_Reader *reader, char *data, int64 n);
+  int64       Las_Reader_Residue(Las_Reader *reader);
+  void        Close_Las_Reader(Las_Reader *reader);
+
+  /* In the blocked (v2) .las format the usual (novl,tspace) header is followed by blocks, each
+     coding a run of consecutive records so that it can be decoded independently of the
+     others:  the A- and B-read of a record are coded as differences from those of the
+     previous record of the block and the other fields directly, all as variable length
+     (zig-zagged if signed) integers, and then the traces of all the records are Rice
+     coded, the number of differences of a pair relative to the mean of its record and
+     the b-advance relative to tspace, with a parameter for each chosen per block so as
+     to minimize its size.  A block begins a new run of about
+     LAS_BLOCK_RAW bytes of records, but never in the middle of a chain.  The blocks are
+     followed by a table giving the offset, ordinal, and first A-read of each block, and
+     the last 8 bytes of the file give the offset of this table.
+
+     Open_Las_Writer starts a blocked .las file on 'output' whose header (novl,tspace) has
+     already been written by the caller.  Write_Las_Record adds 'ovl' whose trace of 'tbytes'
+     elements is pointed at by ovl->path.trace.  Close_Las_Writer writes the last block and
+     the block table and frees the writer, but does not close 'output'.  A non-zero value is
+     returned if an error occurred and INTERACTIVE is defined.
+
+     Las_Is_Blocked tells if the .las file 'input' is in the blocked format.  Read_Las_Blocks
+     returns its block table as an index (see below) whose entries are the blocks, with the
+     pad field of an entry set if its first record begins a pile, or NULL if 'input' is not
+     blocked or its table cannot be read.  If non-NULL, *sorted is set to whether the records
+     are sorted on A-read, and *rsize to the total size of the records in the raw format.
+     Las_Block_Size returns the size in the raw format of the records of the block of entry
+     'e' of such a table, or -1 if its header cannot be read.
+  */
+
+#define LAS_BLOCK_RAW  1000000
+
+  typedef void Las_Writer;
+
+  Las_Writer *Open_Las_Writer(FILE *output, int tspace);
+  int         Write_Las_Record(Las_Writer *writer, Overlap *ovl);
+  int         Close_Las_Writer(Las_Writer *writer);
+
+  /* A pile index is a sidecar file <name>.las.idx for a sorted .las file <name>.las that gives
+     the offset and ordinal of the first record of every pile whose A-read is at least 'sample'
+     greater than that of the previous entry (every pile if 'sample' is 1).
+
+     Write_Las_Index scans the .las file 'las' (a full path including the .las suffix) and
+     writes its index.  It returns non-zero (after reporting why) if 'las' is not sorted or
+     cannot be read or the index written.  Open_Las_Index reads the index of 'las', returning
+     NULL if there is none or it is stale, i.e. 'las' has changed size or modification time
+     since it was built.
+     A blocked .las file needs no sidecar, its block table serves as the index if the file
+     is sorted (an entry whose block continues a pile then has the A-read of the next pile,
+     so that no record before an entry has an A-read as large as the entry's).
+
+     Find_Las_Pile returns the last entry whose A-read is not greater than 'aread', or NULL if
+     there is none.  Seek_Las_Pile positions 'input' at that entry (or the first record if
+     there is none) and returns the number of records preceding it, or -1 if the seek failed.
+     A caller then reads forward from there, e.g. with a Las_Reader, skipping the records of
+     any earlier piles of the entry.  Free_Las_Index frees an index.
+  */
+
+  typedef struct
+    { int    aread;      /* A-read of the entry's first record          */
+      int    pad;
+      int64  offset;     /* File offset of the record                   */
+      int64  ordinal;    /* # of records preceding it                   */
+    } Las_Index_Entry;
+
+  typedef struct
+    { int64            novl;     /* # of records in the .las file        */
+      int64            fsize;    /* and its size in bytes                */
+      int64            mtime;    /* and its modification time            */
+      int              sample;   /* Sampling interval of the entries     */
+      int              nidx;     /* # of entries                         */
+      Las_Index_Entry *idx;
+    } Las_Index;
+
+  int              Las_Is_Blocked(FILE *input);
+  Las_Index       *Read_Las_Blocks(FILE *input, int *sorted, int64 *rsize);
+  int64            Las_Block_Size(FILE *input, Las_Index_Entry *e);
+
+  int              Write_Las_Index(char *las, int sample);
+  Las_Index       *Open_Las_Index(char *las);
+  Las_Index_Entry *Find_Las_Pile(Las_Index *index, int aread);
+  int64            Seek_Las_Pile(FILE *input, Las_Index *index, int aread);
+  void             Free_Las_Index(Las_Index *index);
+
   /* Gap_Improver takes an alignment trace and improves it so the alignment has fewer, larger
      gaps as if computed under an affine gap penalty.  It should be called immediately after
      Compute_Trace_(PTS|MID).  The modified trace alignment is guaranteed to have the same
@@ -0,0 +1,445 @@
+/*******************************************************************************************
+ *
+ *  Replay the alignment seeds recorded by daligner -R through the kernels of the align
+ *    module, timing each call with the processor's time stamp counter (or a nanosecond
+ *    clock where there is none).  For each kernel the number of calls, the ticks per call,
+ *    and the ticks per dynamic programming cell of the alignment involved are reported,
+ *    along with a checksum of the kernel's results so that a change to a kernel can be
+ *    checked to give the same alignments as before.
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "DB.h"
+#include "align.h"
+#include "filter.h"
+
+static char *Usage = "[-v] [-n<int(1)>] [-k<kernels(LPGM)>] <capture:file>";
+
+#define LOCAL  0   //  Local_Alignment from each seed
+#define PTS    1   //  Compute_Trace_PTS of each alignment found that is long enough
+#define GAP    2   //  Gap_Improver following Compute_Trace_PTS
+#define MID    3   //  Compute_Trace_MID
+#define ALIGN  4   //  Compute_Alignment(DIFF_TRACE) over the alignment's extent
+
+#define NKERNEL 5
+
+static char *Kernel_Name[NKERNEL] =
+  { "Local_Alignment", "Compute_Trace_PTS", "Gap_Improver",
+    "Compute_Trace_MID", "Compute_Alignment" };
+
+static char Kernel_Code[NKERNEL] = { 'L', 'P', 'G', 'M', 'A' };
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define TICK_UNIT "cycles"
+
+static inline uint64 ticks()
+{ return (__rdtsc()); }
+
+#else
+
+#define TICK_UNIT "ns"
+
+static inline uint64 ticks()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (t.tv_sec*1000000000ull + t.tv_nsec);
+}
+
+#endif
+
+static double wall_time()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (t.tv_sec + t.tv_nsec*1e-9);
+}
+
+  //  Per kernel totals of a pass over the capture file
+
+typedef struct
+  { int64  calls;
+    uint64 ticks;
+    int64  cells;   //  Sum of the estimated DP cells of the alignments
+    uint64 check;   //  Hash of the results
+  } Tally;
+
+static inline uint64 mix(uint64 h, int64 x)
+{ h ^= (uint64) x;
+  h *= 0x100000001b3ull;
+  return (h);
+}
+
+static uint64 hash_path(uint64 h, Path *path)
+{ h = mix(h,path->abpos);
+  h = mix(h,path->aepos);
+  h = mix(h,path->bbpos);
+  h = mix(h,path->bepos);
+  h = mix(h,path->diffs);
+  h = mix(h,path->tlen);
+  return (h);
+}
+
+static uint64 hash_trace(uint64 h, Path *path)
+{ int *t = (int *) path->trace;
+  int  i;
+
+  for (i = 0; i < path->tlen; i++)
+    h = mix(h,t[i]);
+  return (h);
+}
+
+  //  Estimate the # of DP cells of the alignment in path from its trace points (as found by
+  //    Local_Alignment):  the interval of each trace point is taken to be aligned in a band
+  //    of 2d+1 diagonals, d its # of differences, each as long as the mean of its lengths
+  //    in A and B
+
+static int64 path_cells(Path *path, int tspace)
+{ uint16 *t = (uint16 *) path->trace;
+  int64   cells;
+  int     ab, ae, i;
+
+  cells = 0;
+  ab    = path->abpos;
+  for (i = 1; i < path->tlen; i += 2)
+    { ae = (ab/tspace+1)*tspace;
+      if (ae > path->aepos)
+        ae = path->aepos;
+      cells += (2*t[i-1]+1) * (int64) ((ae-ab) + t[i]);
+      ab = ae;
+    }
+  return (cells/2);
+}
+
+  //  The buffers for the sequences and seeds of a segment
+
+static char         *Bases  = NULL;
+static int64         BMax   = 0;
+static int64        *Offset = NULL;
+static int          *Length = NULL;
+static int           SMax   = 0;
+static Capture_Seed *Seeds  = NULL;
+static int64         EMax   = 0;
+
+static char         *Comp   = NULL;   //  Complement of a B-sequence
+static int           CMax   = 0;
+static uint16       *Trace  = NULL;   //  Copy of the trace points found by Local_Alignment
+static int           TMax   = 0;
+
+static int read_segment(FILE *input, char *input_name, Capture_Head *head)
+{ int   i, len;
+  int64 top;
+
+  if (fread(head,sizeof(Capture_Head),1,input) != 1)
+    { if (ferror(input))
+        SYSTEM_READ_ERROR
+      return (0);
+    }
+  if (head->nseq < 0 || head->nseed < 0 || head->tspace <= 0)
+    { fprintf(stderr,"%s: %s is not a capture file from daligner -R\n",Prog_Name,input_name);
+      exit (1);
+    }
+
+  if (head->nseq > SMax)
+    { SMax   = 1.2*head->nseq + 100;
+      Offset = (int64 *) Realloc(Offset,sizeof(int64)*SMax,"Allocating sequence index");
+      Length = (int *) Realloc(Length,sizeof(int)*SMax,"Allocating sequence index");
+      if (Offset == NULL || Length == NULL)
+        exit (1);
+    }
+
+  top = 1;
+  for (i = 0; i < head->nseq; i++)
+    { FFREAD(&len,sizeof(int),1,input)
+      if (len < 0)
+        { fprintf(stderr,"%s: %s is corrupted\n",Prog_Name,input_name);
+          exit (1);
+        }
+      if (top + len + 2 > BMax)
+        { BMax  = 1.2*(top+len+2) + 1000000;
+          Bases = (char *) Realloc(Bases,BMax,"Allocating sequence buffer");
+          if (Bases == NULL)
+            exit (1);
+        }
+      FFREAD(Bases+top,1,COMPRESSED_LEN(len),input)
+      Uncompress_Read(len,Bases+top);
+      Bases[top-1] = 4;
+      Bases[top+len] = 4;
+      Offset[i] = top;
+      Length[i] = len;
+      if (len > CMax)
+        CMax = len;
+      top += len+1;
+    }
+
+  if (head->nseed > EMax)
+    { EMax  = 1.2*head->nseed + 1000;
+      Seeds = (Capture_Seed *) Realloc(Seeds,sizeof(Capture_Seed)*EMax,"Allocating seeds");
+      if (Seeds == NULL)
+        exit (1);
+    }
+  FFREAD(Seeds,sizeof(Capture_Seed),head->nseed,input)
+
+  for (i = 0; i < head->nseed; i++)
+    if (Seeds[i].aread < 0 || Seeds[i].aread >= head->nseq ||
+        Seeds[i].bread < 0 || Seeds[i].bread >= head->nseq)
+      { fprintf(stderr,"%s: %s is corrupted\n",Prog_Name,input_name);
+        exit (1);
+      }
+
+  return (1);
+}
+
+  //  Run the selected kernels over the seeds of the current segment
+
+static void replay_segment(Capture_Head *head, Work_Data *work, int *run, Tally *tally)
+{ Align_Spec *spec;
+  Alignment   _align, *align = &_align;
+  Path        _path, *path = &_path;
+  Path        save;
+  Capture_Seed *s;
+  int64       i;
+  uint64      t0, t1;
+  int         span;
+  int64       cells;
+
+  spec = New_Align_Spec(head->ave_corr,head->tspace,head->freq,head->reach);
+  if (spec == NULL)
+    exit (1);
+
+  Comp = (char *) Realloc(Comp,CMax+2,"Allocating complement buffer");
+  if (Comp == NULL)
+    exit (1);
+
+  align->path = path;
+  for (i = 0; i < head->nseed; i++)
+    { s = Seeds + i;
+
+      align->aseq  = Bases + Offset[s->aread];
+      align->alen  = Length[s->aread];
+      align->blen  = Length[s->bread];
+      align->flags = s->comp;
+      if (s->comp)
+        { memcpy(Comp+1,Bases+Offset[s->bread],align->blen);
+          Complement_Seq(Comp+1,align->blen);
+          Comp[0] = Comp[align->blen+1] = 4;
+          align->bseq = Comp+1;
+        }
+      else
+        align->bseq = Bases + Offset[s->bread];
+
+      t0 = ticks();
+      Local_Alignment(align,work,spec,s->diag,s->diag,s->anti,-1,-1);
+      t1 = ticks();
+
+      span  = (path->aepos-path->abpos) + (path->bepos-path->bbpos);
+      cells = path_cells(path,head->tspace);
+      if (run[LOCAL])
+        { tally[LOCAL].calls += 1;
+          tally[LOCAL].ticks += t1-t0;
+          tally[LOCAL].cells += cells;
+          tally[LOCAL].check  = hash_path(tally[LOCAL].check,path);
+        }
+
+      if (span < head->minover)
+        continue;
+      if (! (run[PTS] || run[GAP] || run[MID] || run[ALIGN]))
+        continue;
+
+      if (path->tlen > TMax)
+        { TMax  = 1.2*path->tlen + 1000;
+          Trace = (uint16 *) Realloc(Trace,sizeof(uint16)*TMax,"Allocating trace buffer");
+          if (Trace == NULL)
+            exit (1);
+        }
+      memcpy(Trace,path->trace,sizeof(uint16)*path->tlen);
+      save = *path;
+      save.trace = Trace;
+
+      if (run[PTS] || run[GAP])
+        { t0 = ticks();
+          Compute_Trace_PTS(align,work,head->tspace,GREEDIEST);
+          t1 = ticks();
+          if (run[PTS])
+            { tally[PTS].calls += 1;
+              tally[PTS].ticks += t1-t0;
+              tally[PTS].cells += cells;
+              tally[PTS].check  = hash_trace(hash_path(tally[PTS].check,path),path);
+            }
+          if (run[GAP])
+            { t0 = ticks();
+              Gap_Improver(align,work);
+              t1 = ticks();
+              tally[GAP].calls += 1;
+              tally[GAP].ticks += t1-t0;
+              tally[GAP].cells += cells;
+              tally[GAP].check  = hash_trace(hash_path(tally[GAP].check,path),path);
+            }
+        }
+
+      if (run[MID])
+        { *path = save;
+          t0 = ticks();
+          Compute_Trace_MID(align,work,head->tspace,GREEDIEST);
+          t1 = ticks();
+          tally[MID].calls += 1;
+          tally[MID].ticks += t1-t0;
+          tally[MID].cells += cells;
+          tally[MID].check  = hash_trace(hash_path(tally[MID].check,path),path);
+        }
+
+      if (run[ALIGN])
+        { *path = save;
+          t0 = ticks();
+          Compute_Alignment(align,work,DIFF_TRACE,head->tspace);
+          t1 = ticks();
+          tally[ALIGN].calls += 1;
+          tally[ALIGN].ticks += t1-t0;
+          tally[ALIGN].cells += cells;
+          tally[ALIGN].check  = hash_path(tally[ALIGN].check,path);
+        }
+    }
+
+  Free_Align_Spec(spec);
+}
+
+int main(int argc, char *argv[])
+{ FILE        *input;
+  Work_Data   *work;
+  Capture_Head head;
+  Tally        best[NKERNEL], tally[NKERNEL];
+  int          run[NKERNEL];
+  int64        nseq, nseed;
+  double       wall, tsec;
+  uint64       tick0;
+  int          pass, k;
+
+  int    VERBOSE;
+  int    PASSES;
+  char  *KERNELS;
+
+  //  Process options
+
+  { int    i, j;
+    int    flags[128];
+    char  *eptr;
+
+    ARG_INIT("alnbench")
+
+    PASSES  = 1;
+    KERNELS = "LPGM";
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 'n':
+            ARG_POSITIVE(PASSES,"Number of passes")
+            break;
+          case 'k':
+            KERNELS = argv[i]+2;
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+
+    if (argc != 2)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -n: Replay the file -n times and report the fastest pass\n");
+        fprintf(stderr,"      -k: Time the kernels whose letters are given:\n");
+        for (k = 0; k < NKERNEL; k++)
+          fprintf(stderr,"            %c = %s\n",Kernel_Code[k],Kernel_Name[k]);
+        fprintf(stderr,"      -v: Report progress of each pass\n");
+        exit (1);
+      }
+
+    for (k = 0; k < NKERNEL; k++)
+      run[k] = (strchr(KERNELS,Kernel_Code[k]) != NULL);
+    for (i = 0; KERNELS[i] != '\0'; i++)
+      if (strchr("LPGMA",KERNELS[i]) == NULL)
+        { fprintf(stderr,"%s: -k '%c' is not a kernel letter\n",Prog_Name,KERNELS[i]);
+          exit (1);
+        }
+  }
+
+  input = Fopen(argv[1],"r");
+  if (input == NULL)
+    exit (1);
+
+  work = New_Work_Data();
+  if (work == NULL)
+    exit (1);
+
+  nseq = nseed = 0;
+  wall  = wall_time();
+  tick0 = ticks();
+  for (pass = 0; pass < PASSES; pass++)
+    { memset(tally,0,sizeof(tally));
+      for (k = 0; k < NKERNEL; k++)
+        tally[k].check = 0xcbf29ce484222325ull;
+
+      rewind(input);
+      nseq = nseed = 0;
+      while (read_segment(input,argv[1],&head))
+        { replay_segment(&head,work,run,tally);
+          nseq  += head.nseq;
+          nseed += head.nseed;
+        }
+
+      if (VERBOSE)
+        { fprintf(stderr,"  Pass %d: %lld seeds\n",pass+1,nseed);
+          fflush(stderr);
+        }
+
+      for (k = 0; k < NKERNEL; k++)
+        if (pass == 0 || tally[k].ticks < best[k].ticks)
+          best[k] = tally[k];
+    }
+  tsec = wall_time() - wall;
+
+  printf("\n%s: %lld seeds over %lld sequences",argv[1],nseed,nseq);
+  if (tsec > 0.)
+    printf(", %.2f G%s/sec",(ticks()-tick0)/(tsec*1e9),TICK_UNIT);
+  printf("\n\n");
+  printf("  %-18s %10s %14s %12s %12s  %s\n",
+         "kernel","calls",TICK_UNIT,"per call","per cell","checksum");
+  for (k = 0; k < NKERNEL; k++)
+    if (run[k])
+      { printf("  %-18s %10lld %14llu",Kernel_Name[k],best[k].calls,best[k].ticks);
+        if (best[k].calls > 0)
+          printf(" %12.1f %12.3f",(1.*best[k].ticks)/best[k].calls,
+                                  (1.*best[k].ticks)/(best[k].cells > 0 ? best[k].cells : 1));
+        else
+          printf(" %12s %12s","-","-");
+        printf("  %016llx\n",best[k].check);
+      }
+
+  Free_Work_Data(work);
+  fclose(input);
+
+  free(Trace);
+  free(Comp);
+  free(Seeds);
+  free(Length);
+  free(Offset);
+  free(Bases);
+
+  exit (0);
+}
@@ -0,0 +1,209 @@
+#!/bin/bash
+#
+#  Benchmark the DALIGNER pipeline on simulated data sets and check its output against
+#    a stored baseline.
+#
+#  For each data set below a DB is built with simDB and then daligner, LAsort, LAmerge,
+#    LAshow -a, and LA2ONE (with ONE2LA converting back) are run over all of its blocks
+#    at fixed parameters.  The wall time of each stage is reported together with its
+#    throughput in Mbp of reads and in overlaps per second.  A checksum of the output of
+#    each stage is compared with the one recorded in the file baseline, or with -u the
+#    baseline is rewritten.  The checksums of .las files are taken over their LAshow
+#    listing (and for LA2ONE over that of the .las file ONE2LA rebuilds) so that they do
+#    not depend on the padding bytes of the records.  The exit status is 1 if any differ.
+#
+#  The checksums in baseline were recorded with -b pointing at the binaries of the tree
+#    before the benchmark was added.  The LAshow of that tree crashes on exit after it
+#    has written its listing, so it was run line buffered (stdbuf -oL) and its exit
+#    status ignored.
+#
+#  Usage: bench.sh [-u] [-b <bin:dir(..)>] [-w <work:dir(work)>] [-T<int(4)>] [<set> ...]
+
+#  Data set name and simDB options, one per line
+
+DATA_SETS="
+small   -g500000 -c20 -r.05 -R2000 -e.12 -i.50 -d.25 -m8000 -s.50 -x1000 -b5   -S1
+repeat  -g300000 -c25 -r.30 -R4000 -e.15 -i.60 -d.20 -m6000 -s.70 -x1000 -b2.5 -S2
+"
+
+#  Fixed parameters of each stage
+
+DALIGNER_OPTS="-k16 -w6 -h50 -e.75 -l1500 -s100 -M8"
+LASORT_OPTS=""
+LAMERGE_OPTS=""
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BIN=$HERE/..
+WORK=$HERE/work
+THREADS=4
+UPDATE=0
+
+while [ $# -gt 0 ]
+  do case "$1" in
+       -u)  UPDATE=1; shift ;;
+       -b)  BIN=$(cd "$2" && pwd); shift 2 ;;
+       -w)  WORK=$2; shift 2 ;;
+       -T*) THREADS=${1#-T}; shift ;;
+       -*)  echo "Usage: bench.sh [-u] [-b <bin:dir(..)>] [-w <work:dir(work)>] [-T<int(4)>] [<set> ...]" >&2
+            exit 1 ;;
+       *)   break ;;
+     esac
+  done
+
+SETS="$*"
+if [ -z "$SETS" ]
+  then SETS=$(echo "$DATA_SETS" | awk 'NF > 0 { print $1 }')
+fi
+
+for p in simDB
+  do if [ ! -x "$HERE/$p" ]
+       then echo "bench.sh: $HERE/$p has not been built (run make in $HERE)" >&2
+            exit 1
+     fi
+  done
+for p in daligner LAsort LAmerge LAshow LA2ONE ONE2LA
+  do if [ ! -x "$BIN/$p" ]
+       then echo "bench.sh: $BIN/$p has not been built" >&2
+            exit 1
+     fi
+  done
+
+export PATH=$BIN:$PATH     #  daligner calls LAsort and LAmerge
+
+BASELINE=$HERE/baseline
+NEWLINE=$WORK/baseline.new
+mkdir -p "$WORK" || exit 1
+: > "$NEWLINE"
+
+now() { date +%s%N; }
+
+#  Number of LAs in the .las files given as arguments
+
+count_las() {
+  local n=0 f c
+  for f in "$@"
+    do c=$(od -An -t d8 -N8 "$f")
+       n=$((n + c))
+    done
+  echo $n
+}
+
+#  report <set> <stage> <start> <end> <bases> <overlaps> <checksum>
+
+FAILED=0
+
+report() {
+  local secs base
+  secs=$(awk -v a="$3" -v b="$4" 'BEGIN { printf "%.3f", (b-a)/1e9 }')
+  awk -v s="$1" -v t="$2" -v w="$secs" -v m="$5" -v o="$6" 'BEGIN \
+       { if (w <= 0) w = .001
+         printf "  %-8s %-10s %9.3fs %10.3f Mbp/s", s, t, w, m/(w*1e6)
+         if (o >= 0)
+           printf " %12.0f ovl/s", o/w
+         else
+           printf " %18s", ""
+       }'
+  echo "$1 $2 $7" >> "$NEWLINE"
+  base=$(awk -v s="$1" -v t="$2" '$1 == s && $2 == t { print $3 }' "$BASELINE" 2>/dev/null)
+  if [ $UPDATE -eq 1 ]
+    then echo "  recorded"
+  elif [ -z "$base" ]
+    then echo "  no baseline"
+  elif [ "$base" = "$7" ]
+    then echo "  ok"
+  else
+    echo "  DIFFERS"
+    FAILED=1
+  fi
+}
+
+printf "  %-8s %-10s %10s %16s %18s  %s\n" set stage wall throughput overlaps check
+
+for S in $SETS
+  do OPTS=$(echo "$DATA_SETS" | awk -v s="$S" '$1 == s { $1 = ""; print }')
+     if [ -z "$OPTS" ]
+       then echo "bench.sh: no data set named $S" >&2
+            exit 1
+     fi
+
+     D=$WORK/$S
+     rm -f "$D".db "$WORK"/."$S".* "$D".*.las "$D".*.dal
+
+     #  Build the DB
+
+     T0=$(now)
+     INFO=$("$HERE"/simDB -v $OPTS "$D" 2>&1) || { echo "$INFO" >&2; exit 1; }
+     T1=$(now)
+     BASES=$(echo "$INFO" | awk '{ print $4 }' | tr -d ,)
+     N=$(awk '$1 == "blocks" { print $3 }' "$D".db)
+     SUM=$(cat "$D".db "$WORK"/."$S".idx "$WORK"/."$S".bps | md5sum | cut -d' ' -f1)
+     report $S simDB $T0 $T1 $BASES -1 $SUM
+
+     #  Compare every pair of blocks
+
+     T0=$(now)
+     for i in $(seq 1 $N)
+       do (cd "$WORK" && "$BIN"/daligner -T$THREADS $DALIGNER_OPTS $S.$i $S.@1-$i) || exit 1
+       done
+     T1=$(now)
+     OVLS=$(count_las "$D".*.*.las)
+     SUM=$(for i in $(seq 1 $N); do for j in $(seq 1 $N)
+             do "$BIN"/LAshow "$D" "$D".$i.$S.$j; done; done | md5sum | cut -d' ' -f1)
+     report $S daligner $T0 $T1 $BASES $OVLS $SUM
+
+     #  Sort the pair files and merge them into one file per block
+
+     T0=$(now)
+     for i in $(seq 1 $N)
+       do "$BIN"/LAsort $LASORT_OPTS "$D".$i.$S.@1-$N || exit 1
+       done
+     T1=$(now)
+     SUM=$(for i in $(seq 1 $N); do for j in $(seq 1 $N)
+             do "$BIN"/LAshow "$D" "$D".$i.$S.$j.S; done; done | md5sum | cut -d' ' -f1)
+     report $S LAsort $T0 $T1 $BASES $OVLS $SUM
+
+     T0=$(now)
+     for i in $(seq 1 $N)
+       do "$BIN"/LAmerge $LAMERGE_OPTS "$D".$i "$D".$i.$S.@1-$N.S || exit 1
+       done
+     T1=$(now)
+     MOVL=$(count_las $(for i in $(seq 1 $N); do echo "$D".$i.las; done))
+     SUM=$(for i in $(seq 1 $N); do "$BIN"/LAshow "$D" "$D".$i; done | md5sum | cut -d' ' -f1)
+     report $S LAmerge $T0 $T1 $BASES $MOVL $SUM
+
+     #  Display the alignments of the merged files
+
+     T0=$(now)
+     SUM=$(for i in $(seq 1 $N); do "$BIN"/LAshow -a "$D" "$D".$i || exit 1; done \
+             | md5sum | cut -d' ' -f1)
+     T1=$(now)
+     report $S "LAshow-a" $T0 $T1 $BASES $MOVL $SUM
+
+     #  Convert the merged files to 1-code and back
+
+     T0=$(now)
+     for i in $(seq 1 $N)
+       do "$BIN"/LA2ONE -ct "$D" "$D".$i > "$D".$i.dal || exit 1
+       done
+     T1=$(now)
+     SUM=$(for i in $(seq 1 $N)
+             do "$BIN"/ONE2LA "$D".$i.dal > "$D".$i.R.las || exit 1
+                "$BIN"/LAshow "$D" "$D".$i.R
+             done | md5sum | cut -d' ' -f1)
+     report $S LA2ONE $T0 $T1 $BASES $MOVL $SUM
+
+     rm -f "$D".*.las "$D".*.dal
+  done
+
+if [ $UPDATE -eq 1 ]
+  then if [ -f "$BASELINE" ]
+         then awk 'NR == FNR { new[$1] = 1; next } !($1 in new)' "$NEWLINE" "$BASELINE" \
+                > "$NEWLINE".keep
+              cat "$NEWLINE".keep "$NEWLINE" > "$BASELINE"
+              rm -f "$NEWLINE".keep
+         else cp "$NEWLINE" "$BASELINE"
+       fi
+fi
+rm -f "$NEWLINE"
+
+exit $FAILED
@@ -0,0 +1,441 @@
+/*******************************************************************************************
+ *
+ *  Build a Dazzler DB of simulated noisy long reads sampled from a random genome, for
+ *    benchmarking.  The genome is a random sequence into which diverged copies of a few
+ *    repeat units are interspersed, read lengths are log-normally distributed, and each
+ *    read carries insertion, deletion and substitution errors at the given rate.  The
+ *    output depends only on the options (and seed), so on a given platform a DB is exactly
+ *    reproducible.
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "DB.h"
+
+static char *Usage[] =
+    { "[-v] [-g<int(1000000)>] [-c<double(20.)>] [-r<double(.05)>] [-R<int(2000)>]",
+      "     [-e<double(.12)>] [-i<double(.50)>] [-d<double(.25)>]",
+      "     [-m<int(10000)>] [-s<double(.50)>] [-x<int(1000)>]",
+      "     [-b<double(200.)>] [-S<int(1)>] <name:db>"
+    };
+
+#define NFAMILY  8     //  Number of distinct repeat units
+#define REP_DIV .02    //  Divergence of each repeat copy from its unit
+
+  //  Random number generation: a xorshift64* generator seeded by splitmix64, so that the
+  //    integer stream for a given seed is the same on every platform.  The read lengths
+  //    and the Gaussian deviates are derived from it with log, exp, and cos of the math
+  //    library, so a DB built on a platform whose libm rounds differently may differ.
+
+static uint64 State;
+
+static void seed_random(uint64 seed)
+{ uint64 z;
+
+  z = seed + 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  State = z ^ (z >> 31);
+  if (State == 0)
+    State = 1;
+}
+
+static uint64 next_random()
+{ State ^= State >> 12;
+  State ^= State << 25;
+  State ^= State >> 27;
+  return (State * 0x2545f4914f6cdd1dull);
+}
+
+static double uniform()   //  In [0,1)
+{ return ((next_random() >> 11) * (1./9007199254740992.)); }
+
+static double normal()    //  Box-Muller
+{ double u;
+
+  do
+    u = uniform();
+  while (u == 0.);
+  return (sqrt(-2.*log(u)) * cos(2.*M_PI*uniform()));
+}
+
+  //  Copy seq[0..len-1] to out with errors at rate err, of which fractions ins and del are
+  //    insertions and deletions and the remainder substitutions.  Return the output length.
+
+static int mutate(char *seq, int len, char *out, double err, double ins, double del)
+{ int    i, k;
+  double u;
+
+  k = 0;
+  for (i = 0; i < len; i++)
+    { u = uniform();
+      if (u >= err)
+        out[k++] = seq[i];
+      else
+        { u /= err;
+          if (u < ins)
+            { out[k++] = next_random() & 0x3;
+              i -= 1;
+            }
+          else if (u >= ins+del)
+            out[k++] = (seq[i] + 1 + next_random()%3) & 0x3;
+        }
+    }
+  return (k);
+}
+
+static void complement(char *s, int len)
+{ char *t;
+  int   c;
+
+  t = s + (len-1);
+  while (s < t)
+    { c = *s;
+      *s++ = (char) (3-*t);
+      *t-- = (char) (3-c);
+    }
+  if (s == t)
+    *s = (char) (3-*s);
+}
+
+int main(int argc, char *argv[])
+{ char      *pwd, *root;
+  char      *genome, *unit, *rbuf;
+  DAZZ_READ *reads;
+  int       *bfirst;
+  int64      count[4];
+  int64      totlen, bsum;
+  int        nreads, rmax, nblock, bmax, maxlen;
+  FILE      *bases, *ifile, *dbfile;
+
+  int     VERBOSE;
+  int64   GLEN;
+  double  COVER;
+  double  REPEAT;
+  int     RLEN;
+  double  ERROR, INS, DEL;
+  int     MEAN;
+  double  SDEV;
+  int     MINLEN;
+  double  BLOCK;
+  int     SEED;
+
+  //  Process options
+
+  { int    i, j, k;
+    int    flags[128];
+    char  *eptr;
+    int    glen;
+
+    ARG_INIT("simDB")
+
+    glen   = 1000000;
+    COVER  = 20.;
+    REPEAT = .05;
+    RLEN   = 2000;
+    ERROR  = .12;
+    INS    = .50;
+    DEL    = .25;
+    MEAN   = 10000;
+    SDEV   = .50;
+    MINLEN = 1000;
+    BLOCK  = 200.;
+    SEED   = 1;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 'g':
+            ARG_POSITIVE(glen,"Genome length")
+            break;
+          case 'c':
+            ARG_REAL(COVER)
+            if (COVER <= 0.)
+              { fprintf(stderr,"%s: Coverage must be positive (%g)\n",Prog_Name,COVER);
+                exit (1);
+              }
+            break;
+          case 'r':
+            ARG_REAL(REPEAT)
+            if (REPEAT < 0. || REPEAT >= 1.)
+              { fprintf(stderr,"%s: Repeat fraction must be in [0,1) (%g)\n",Prog_Name,REPEAT);
+                exit (1);
+              }
+            break;
+          case 'R':
+            ARG_POSITIVE(RLEN,"Repeat unit length")
+            break;
+          case 'e':
+            ARG_REAL(ERROR)
+            if (ERROR < 0. || ERROR > .5)
+              { fprintf(stderr,"%s: Error rate must be in [0,.5] (%g)\n",Prog_Name,ERROR);
+                exit (1);
+              }
+            break;
+          case 'i':
+            ARG_REAL(INS)
+            break;
+          case 'd':
+            ARG_REAL(DEL)
+            break;
+          case 'm':
+            ARG_POSITIVE(MEAN,"Mean read length")
+            break;
+          case 's':
+            ARG_REAL(SDEV)
+            if (SDEV < 0.)
+              { fprintf(stderr,"%s: Relative deviation must be non-negative (%g)\n",
+                               Prog_Name,SDEV);
+                exit (1);
+              }
+            break;
+          case 'x':
+            ARG_POSITIVE(MINLEN,"Minimum read length")
+            break;
+          case 'b':
+            ARG_REAL(BLOCK)
+            if (BLOCK <= 0.)
+              { fprintf(stderr,"%s: Block size must be positive (%g)\n",Prog_Name,BLOCK);
+                exit (1);
+              }
+            break;
+          case 'S':
+            ARG_NON_NEGATIVE(SEED,"Random seed")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+    GLEN    = glen;
+
+    if (argc != 2)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
+        for (k = 1; k < 4; k++)
+          fprintf(stderr,"       %*s %s\n",(int) strlen(Prog_Name),"",Usage[k]);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -g: Length of the random genome\n");
+        fprintf(stderr,"      -c: Coverage of the genome by the reads\n");
+        fprintf(stderr,"      -r: Fraction of the genome made up of repeat copies\n");
+        fprintf(stderr,"      -R: Length of each repeat unit\n");
+        fprintf(stderr,"      -e: Error rate of the reads\n");
+        fprintf(stderr,"      -i: Fraction of the errors that are insertions\n");
+        fprintf(stderr,"      -d: Fraction of the errors that are deletions\n");
+        fprintf(stderr,"      -m: Mean read length\n");
+        fprintf(stderr,"      -s: Standard deviation of read length relative to the mean\n");
+        fprintf(stderr,"      -x: Minimum read length\n");
+        fprintf(stderr,"      -b: Block size in Mbp as for DBsplit -s\n");
+        fprintf(stderr,"      -S: Seed of the random number generator\n");
+        fprintf(stderr,"      -v: Report the size of the DB produced\n");
+        exit (1);
+      }
+
+    if (INS < 0. || DEL < 0. || INS+DEL > 1.)
+      { fprintf(stderr,"%s: Insertion and deletion fractions must be in [0,1] and sum",
+                       Prog_Name);
+        fprintf(stderr," to at most 1\n");
+        exit (1);
+      }
+    if (MINLEN > GLEN)
+      { fprintf(stderr,"%s: Minimum read length exceeds the genome length\n",Prog_Name);
+        exit (1);
+      }
+  }
+
+  pwd  = PathTo(argv[1]);
+  root = Root(argv[1],".db");
+
+  seed_random(SEED);
+
+  //  Build the genome: segments of length RLEN that are either unique or, with probability
+  //    REPEAT, a diverged copy of one of NFAMILY repeat units in either orientation
+
+  { int64 p;
+    int   f, n;
+
+    genome = (char *) Malloc(GLEN + 2*RLEN,"Allocating genome");
+    unit   = (char *) Malloc(NFAMILY*RLEN,"Allocating repeat units");
+    rbuf   = (char *) Malloc(2*RLEN+1,"Allocating repeat copy");
+    if (genome == NULL || unit == NULL || rbuf == NULL)
+      exit (1);
+
+    for (p = 0; p < NFAMILY*RLEN; p++)
+      unit[p] = next_random() & 0x3;
+
+    p = 0;
+    while (p < GLEN)
+      if (uniform() < REPEAT)
+        { f = next_random() % NFAMILY;
+          n = mutate(unit + f*RLEN,RLEN,rbuf,REP_DIV,.33,.33);
+          if (next_random() & 0x1)
+            complement(rbuf,n);
+          memcpy(genome+p,rbuf,n);
+          p += n;
+        }
+      else
+        { for (n = 0; n < RLEN; n++)
+            genome[p++] = next_random() & 0x3;
+        }
+
+    free(rbuf);
+    free(unit);
+  }
+
+  //  Sample reads until the coverage is reached, writing their compressed bases to the .bps
+  //    file and noting block boundaries exactly as DBsplit would
+
+  { double mu, sigma;
+    int64  need, p;
+    int    len, n;
+    char  *rseq;
+
+    bases = Fopen(Catenate(pwd,"/.",root,".bps"),"w");
+    if (bases == NULL)
+      exit (1);
+
+    sigma = sqrt(log(1. + SDEV*SDEV));
+    mu    = log((double) MEAN) - .5*sigma*sigma;
+
+    maxlen = 0;
+    rseq   = NULL;
+
+    rmax   = 1024;
+    reads  = (DAZZ_READ *) Malloc(rmax*sizeof(DAZZ_READ),"Allocating read index");
+    bmax   = 64;
+    bfirst = (int *) Malloc(bmax*sizeof(int),"Allocating block table");
+    if (reads == NULL || bfirst == NULL)
+      exit (1);
+
+    count[0] = count[1] = count[2] = count[3] = 0;
+
+    need   = (int64) (COVER*GLEN);
+    nreads = 0;
+    totlen = 0;
+    nblock = 0;
+    bsum   = 0;
+    bfirst[0] = 0;
+    while (totlen < need)
+      { do
+          len = (int) exp(mu + sigma*normal());
+        while (len < MINLEN || len > GLEN);
+        p = (int64) (uniform() * (GLEN-len+1));
+
+        if (len > maxlen)
+          { maxlen = len;
+            rseq   = (char *) Realloc(rseq,2*maxlen+4,"Allocating read buffer");
+            if (rseq == NULL)
+              exit (1);
+          }
+        n = mutate(genome+p,len,rseq,ERROR,INS,DEL);
+        if (next_random() & 0x1)
+          complement(rseq,n);
+        if (n < MINLEN)
+          continue;
+
+        if (nreads >= rmax)
+          { rmax  = 1.2*rmax + 1024;
+            reads = (DAZZ_READ *) Realloc(reads,rmax*sizeof(DAZZ_READ),"Reallocating read index");
+            if (reads == NULL)
+              exit (1);
+          }
+
+        { DAZZ_READ *r = reads + nreads;
+          int        i;
+
+          for (i = 0; i < n; i++)
+            count[(int) rseq[i]] += 1;
+
+          memset(r,0,sizeof(DAZZ_READ));   //  So the padding of the .idx records is defined
+          r->origin = nreads;
+          r->rlen   = n;
+          r->fpulse = 0;
+          r->boff   = ftello(bases);
+          r->coff   = -1;
+          r->flags  = DB_BEST;
+        }
+
+        Compress_Read(n,rseq);
+        FFWRITE(rseq,1,COMPRESSED_LEN(n),bases)
+
+        nreads += 1;
+        totlen += n;
+        bsum   += n;
+        if (bsum >= BLOCK*1000000.)
+          { if (nblock+1 >= bmax)
+              { bmax   = 1.2*bmax + 64;
+                bfirst = (int *) Realloc(bfirst,bmax*sizeof(int),"Reallocating block table");
+                if (bfirst == NULL)
+                  exit (1);
+              }
+            bfirst[++nblock] = nreads;
+            bsum = 0;
+          }
+      }
+    if (bsum > 0)
+      bfirst[++nblock] = nreads;
+
+    FCLOSE(bases)
+    free(rseq);
+    free(genome);
+  }
+
+  //  Write the .idx file and the .db stub
+
+  { DAZZ_DB db;
+    int     i;
+
+    memset(&db,0,sizeof(DAZZ_DB));
+    db.ureads  = nreads;
+    db.treads  = nreads;
+    db.cutoff  = 0;
+    db.allarr  = DB_ALL;
+    for (i = 0; i < 4; i++)
+      db.freq[i] = (float) ((1.*count[i])/totlen);
+    db.maxlen  = 0;
+    for (i = 0; i < nreads; i++)
+      if (reads[i].rlen > db.maxlen)
+        db.maxlen = reads[i].rlen;
+    db.totlen  = totlen;
+    db.nreads  = nreads;
+
+    ifile = Fopen(Catenate(pwd,"/.",root,".idx"),"w");
+    if (ifile == NULL)
+      exit (1);
+    FFWRITE(&db,sizeof(DAZZ_DB),1,ifile)
+    FFWRITE(reads,sizeof(DAZZ_READ),nreads,ifile)
+    FCLOSE(ifile)
+
+    dbfile = Fopen(Catenate(pwd,"/",root,".db"),"w");
+    if (dbfile == NULL)
+      exit (1);
+    FPRINTF(dbfile,DB_NFILE,1)
+    FPRINTF(dbfile,DB_FDATA,nreads,root,root)
+    FPRINTF(dbfile,DB_NBLOCK,nblock)
+    FPRINTF(dbfile,DB_PARAMS,(int64) (BLOCK*1000000.),0,1)
+    for (i = 0; i <= nblock; i++)
+      FPRINTF(dbfile,DB_BDATA,bfirst[i],bfirst[i])
+    FCLOSE(dbfile)
+  }
+
+  if (VERBOSE)
+    { fprintf(stderr,"  %s: %d reads, %lld bases, %d blocks\n",
+                     root,nreads,totlen,nblock);
+      fflush(stderr);
+    }
+
+  free(bfirst);
+  free(reads);
+  free(root);
+  free(pwd);
+
+  exit (0);
+}
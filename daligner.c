@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <unistd.h>
@@ -48,14 +49,15 @@
 #endif
 
 #include "DB.h"
+#include "thread.pool.h"
 #include "lsd.sort.h"
 #include "filter.h"
 
 static char *Usage[] =
-  { "[-vaABI] [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-w<int(6)>] [-t<int>]",
-    "         [-M<int>] [-e<double(.75)] [-l<int(1500)>] [-s<int(100)>] [-H<int>]",
-    "         [-T<int(4)>] [-P<dir(/tmp)>] [-m<track>]+",
-    "         <subject:db|dam> <target:db|dam> ...",
+  { "[-vaABINpz] [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-w<int(6)>] [-t<int>]",
+    "           [-M<int>] [-e<double(.75)] [-l<int(1500)>] [-s<int(100)>] [-H<int>]",
+    "           [-T<int(4)>] [-G<int>] [-P<dir(/tmp)>] [-J<file>] [-R<file>] [-m<track>]+",
+    "           <subject:db|dam> <target:db|dam> ...",
   };
 
 int     VERBOSE;   //   Globally visible to filter.c
@@ -64,7 +66,9 @@ int     HGAP_MIN;
 int     SYMMETRIC;
 int     IDENTITY;
 int     BRIDGE;
+int     BLOCKED;
 char   *SORT_PATH;
+FILE   *CAPTURE;
 
 uint64  MEM_LIMIT;
 uint64  MEM_PHYSICAL;
@@ -419,6 +423,66 @@ static int read_DB(DAZZ_DB *block, char *name, char **mask, int *mstat, int mtop
   return (isdam);
 }
 
+  //  The reads of a block are aligned by every thread, so when the pool is spread over NUMA
+  //    nodes their bases are interleaved over the nodes rather than left where they were read.
+
+static void interleave_bases(Thread_Pool *pool, DAZZ_DB *block)
+{ char *bases = ((char *) block->bases) - 1;
+
+  if (Pool_Interleave(pool,bases,block->reads[block->nreads].boff+2) && VERBOSE)
+    printf("\n  Could not interleave the bases of the block over the nodes\n");
+}
+
+  //  Telemetry (-J):  a line of JSON is written to METRICS for the index of the subject block
+  //    and for each block comparison, giving the wall and cpu seconds of each stage, the cpu
+  //    seconds of each thread of the filter, the counts of k-mers, hits, and alignments, and
+  //    the peak memory use so far.
+
+static FILE *METRICS;
+
+  //  Write ,"name":"value" escaping value as a JSON string
+
+static void json_string(char *name, char *value)
+{ unsigned char *v;
+
+  fprintf(METRICS,",\"%s\":\"",name);
+  for (v = (unsigned char *) value; *v != '\0'; v++)
+    if (*v == '"' || *v == '\\')
+      fprintf(METRICS,"\\%c",*v);
+    else if (*v < 0x20)
+      fprintf(METRICS,"\\u%04x",*v);
+    else
+      fputc(*v,METRICS);
+  fputc('"',METRICS);
+}
+
+static void json_stage(char *name, Stage_Time *stage)
+{ fprintf(METRICS,",\"%s\":{\"wall\":%.3f,\"cpu\":%.3f}",name,stage->wall,stage->cpu); }
+
+static void json_busy(char *name, double *busy, int nthreads)
+{ int i;
+
+  fprintf(METRICS,"\"%s\":[",name);
+  for (i = 0; i < nthreads; i++)
+    fprintf(METRICS,"%s%.3f",i == 0 ? "" : ",",busy[i]);
+  fprintf(METRICS,"]");
+}
+
+static void json_rss()
+{ struct rusage self, kids;
+  int64         sk, kk;
+
+  getrusage(RUSAGE_SELF,&self);
+  getrusage(RUSAGE_CHILDREN,&kids);
+  sk = self.ru_maxrss;
+  kk = kids.ru_maxrss;
+#if defined(__APPLE__)
+  sk /= 1024;                     //  In bytes rather than kilobytes
+  kk /= 1024;
+#endif
+  fprintf(METRICS,",\"peak_rss_kb\":%lld,\"child_peak_rss_kb\":%lld",sk,kk);
+}
+
 static char *CommandBuffer(char *aname, char *bname, char *spath)
 { static char *cat = NULL;
   static int   max = -1;
@@ -460,6 +524,10 @@ int main(int argc, char *argv[])
   int         isdam;
   int         MMAX, MTOP, *MSTAT;
   char      **MASK;
+  char       *JNAME;
+  char       *RNAME;
+  Thread_Pool *pool;
+  Stage_Time  tread, tsort;
 
   int    KMER_LEN;
   int    MOD_THR;
@@ -470,6 +538,8 @@ int main(int argc, char *argv[])
   int    SPACING;
   int    NTHREADS;
   int    MAP_ORDER;
+  int    PIN;
+  int    HUGE;
 
 #ifdef PROFILE
   struct rusage stime, etime;
@@ -495,6 +565,9 @@ int main(int argc, char *argv[])
     MINOVER   = 1500;    //   Globally visible to filter.c
     NTHREADS  = 4;
     SORT_PATH = "/tmp";
+    JNAME     = NULL;
+    RNAME     = NULL;
+    HUGE      = HUGE_PAGES_THP;
 
     MEM_PHYSICAL = getMemorySize();
     MEM_LIMIT    = MEM_PHYSICAL;
@@ -515,7 +588,7 @@ int main(int argc, char *argv[])
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("vaABI")
+            ARG_FLAGS("vaABINpz")
             break;
           case 'k':
             ARG_POSITIVE(KMER_LEN,"K-mer length")
@@ -557,6 +630,14 @@ int main(int argc, char *argv[])
               MEM_LIMIT = limit * 0x40000000ll;
               break;
             }
+          case 'G':
+            ARG_NON_NEGATIVE(HUGE,"Huge page size (in MB)")
+            if (Set_Huge_Pages(HUGE))
+              { fprintf(stderr,"%s: -G option: huge page size must be 2 or 1024 (MB), or 0\n",
+                               Prog_Name);
+                exit (1);
+              }
+            break;
           case 'm':
             if (MTOP >= MMAX)
               { MMAX  = 1.2*MTOP + 10;
@@ -576,6 +657,12 @@ int main(int argc, char *argv[])
               }
             closedir(dirp);
             break;
+          case 'J':
+            JNAME = argv[i]+2;
+            break;
+          case 'R':
+            RNAME = argv[i]+2;
+            break;
           case 'T':
             ARG_POSITIVE(NTHREADS,"Number of threads")
             break;
@@ -588,10 +675,18 @@ int main(int argc, char *argv[])
     argc = j;
 
     VERBOSE   = flags['v'];   //  Globally declared in filter.h
+    Report_Huge_Pages(VERBOSE);
     SYMMETRIC = 1-flags['A'];
     IDENTITY  = flags['I'];
     BRIDGE    = flags['B'];
     MAP_ORDER = flags['a'];
+    BLOCKED   = flags['z'];
+    if (flags['N'])
+      PIN = POOL_PIN_NODE;
+    else if (flags['p'])
+      PIN = POOL_PIN_CPU;
+    else
+      PIN = POOL_FREE;
 
     if (argc <= 2)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -614,21 +709,48 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -H: HGAP option: align only target reads of length >= -H.\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -T: Use -T threads.\n");
+        fprintf(stderr,"      -p: Pin each of the -T threads to a cpu.\n");
+        fprintf(stderr,"      -N: Spread the -T threads over the NUMA nodes and place the");
+        fprintf(stderr," data per node.\n");
+        fprintf(stderr,"      -G: Back the large vectors with explicit -G MB pages (2 or 1024),");
+        fprintf(stderr," 0 => no huge pages.\n");
+        fprintf(stderr,"          default => transparent huge pages.\n");
         fprintf(stderr,"      -P: Do block level sorts and merges in directory -P.\n");
         fprintf(stderr,"      -m: Soft mask the blocks with the specified mask.\n");
+        fprintf(stderr,"      -J: Write the times and counts of each stage as JSON to <file>.\n");
+        fprintf(stderr,"      -R: Record the alignment seeds and their reads to <file>");
+        fprintf(stderr," for alnbench.\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
         fprintf(stderr,"      -a: sort .las by A-read,A-position pairs for map usecase\n");
         fprintf(stderr,"          off => sort .las by A,B-read pairs for overlap piles\n");
         fprintf(stderr,"      -A: Compare subjet to target, but not vice versa.\n");
         fprintf(stderr,"      -I: Compare reads to themselves\n");
+        fprintf(stderr,"      -z: Write .las files in the blocked, compressed format\n");
         exit (1);
       }
   }
 
+  METRICS = NULL;
+  if (JNAME != NULL)
+    { METRICS = Fopen(JNAME,"w");
+      if (METRICS == NULL)
+        exit (1);
+    }
+
+  CAPTURE = NULL;
+  if (RNAME != NULL)
+    { CAPTURE = Fopen(RNAME,"w");
+      if (CAPTURE == NULL)
+        exit (1);
+    }
+
   MINOVER *= 2;
-  Set_Filter_Params(KMER_LEN,MOD_THR,BIN_SHIFT,MAX_REPS,HIT_MIN,NTHREADS);
-  Set_LSD_Params(NTHREADS,VERBOSE);
+  if (VERBOSE && PIN == POOL_PIN_NODE)
+    Start_Node_Counters();
+  pool = New_Thread_Pool(NTHREADS,PIN);
+  Set_Filter_Params(KMER_LEN,MOD_THR,BIN_SHIFT,MAX_REPS,HIT_MIN,pool);
+  Set_LSD_Params(pool,VERBOSE);
 
   // Create directory in SORT_PATH for file operations
 
@@ -648,7 +770,10 @@ int main(int argc, char *argv[])
   // Read in the reads in A
 
   afile = argv[1];
+  Start_Stage(&tread);
   isdam = read_DB(ablock,afile,MASK,MSTAT,MTOP,KMER_LEN);
+  interleave_bases(pool,ablock);
+  End_Stage(&tread);
   if (isdam)
     aroot = Root(afile,".dam");
   else
@@ -659,13 +784,27 @@ int main(int argc, char *argv[])
 
   if (VERBOSE)
     printf("\nBuilding index for %s\n",aroot);
+  Start_Stage(&tsort);
   aindex = Sort_Kmers(ablock,&alen);
+  End_Stage(&tsort);
+
+  if (METRICS != NULL)
+    { fprintf(METRICS,"{\"threads\":%d",NTHREADS);
+      json_string("subject",aroot);
+      json_stage("read_db",&tread);
+      json_stage("sort_kmers",&tsort);
+      fprintf(METRICS,",\"kmers\":%d",alen);
+      json_rss();
+      fprintf(METRICS,"}\n");
+      fflush(METRICS);
+    }
 
   // Compare against reads in B in both orientations
 
   { int           i, j;
     Block_Looper *parse;
     char         *command;
+    Stage_Time    tlas, tlsort, tlmerge, zero = { 0., 0. };
 
     for (i = 2; i < argc; i++)
       { parse = Parse_Block_DB_Arg(argv[i]);
@@ -676,17 +815,25 @@ int main(int argc, char *argv[])
 
             if (strcmp(broot,aroot) != 0 || strcmp(bpath,apath) != 0)
               { bfile = Strdup(Catenate(bpath,"/",broot,""),"Allocating path");
+                Start_Stage(&tread);
                 read_DB(bblock,bfile,MASK,MSTAT,MTOP,KMER_LEN);
+                interleave_bases(pool,bblock);
+                End_Stage(&tread);
                 free(bfile);
 
                 if (VERBOSE)
                   printf("\nBuilding index for %s\n",broot);
+                Start_Stage(&tsort);
                 bindex = Sort_Kmers(bblock,&blen);
+                End_Stage(&tsort);
                 Match_Filter(aroot,ablock,broot,bblock,aindex,alen,bindex,blen,asettings);
                 Close_DB(bblock);
               }
             else
-              Match_Filter(aroot,ablock,aroot,ablock,aindex,alen,aindex,alen,asettings);
+              { tread = tsort = zero;
+                blen  = alen;
+                Match_Filter(aroot,ablock,aroot,ablock,aindex,alen,aindex,alen,asettings);
+              }
 
 #define SYSTEM_CHECK(command)						\
  if (VERBOSE)								\
@@ -697,28 +844,72 @@ int main(int argc, char *argv[])
      Clean_Exit(1);							\
    }
 
+#define SYSTEM_TIME(command,sum)					\
+ { Start_Stage(&tlas);							\
+   SYSTEM_CHECK(command)						\
+   End_Stage(&tlas);							\
+   sum.wall += tlas.wall;						\
+   sum.cpu  += tlas.cpu;						\
+ }
+
             command = CommandBuffer(aroot,broot,SORT_PATH);
+            tlsort  = tlmerge = zero;
 
-            sprintf(command,"LAsort %s %s %s/%s.%s.N%c",VERBOSE?"-v":"",
-                            MAP_ORDER?"-a":"",SORT_PATH,aroot,broot,BLOCK_SYMBOL);
-            SYSTEM_CHECK(command)
+            sprintf(command,"LAsort %s %s -T%d %s/%s.%s.N%c",VERBOSE?"-v":"",
+                            MAP_ORDER?"-a":"",NTHREADS,SORT_PATH,aroot,broot,BLOCK_SYMBOL);
+            SYSTEM_TIME(command,tlsort)
 
-            sprintf(command,"LAmerge %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
-                            MAP_ORDER?"-a":"",aroot,broot,SORT_PATH,aroot,broot,BLOCK_SYMBOL);
-            SYSTEM_CHECK(command)
+            sprintf(command,"LAmerge %s %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
+                            MAP_ORDER?"-a":"",BLOCKED?"-z":"",aroot,broot,SORT_PATH,aroot,broot,
+                            BLOCK_SYMBOL);
+            SYSTEM_TIME(command,tlmerge)
 
             if (strcmp(broot,aroot) != 0 || strcmp(bpath,apath) != 0)
               { if (SYMMETRIC)
-                  { sprintf(command,"LAsort %s %s %s/%s.%s.N%c",VERBOSE?"-v":"",
-                                 MAP_ORDER?"-a":"",SORT_PATH,broot,aroot,BLOCK_SYMBOL);
-                    SYSTEM_CHECK(command)
-
-                    sprintf(command,"LAmerge %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
-                                 MAP_ORDER?"-a":"",broot,aroot,SORT_PATH,broot,aroot,BLOCK_SYMBOL);
-                    SYSTEM_CHECK(command)
+                  { sprintf(command,"LAsort %s %s -T%d %s/%s.%s.N%c",VERBOSE?"-v":"",
+                                 MAP_ORDER?"-a":"",NTHREADS,SORT_PATH,broot,aroot,BLOCK_SYMBOL);
+                    SYSTEM_TIME(command,tlsort)
+
+                    sprintf(command,"LAmerge %s %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
+                                 MAP_ORDER?"-a":"",BLOCKED?"-z":"",broot,aroot,SORT_PATH,broot,
+                                 aroot,BLOCK_SYMBOL);
+                    SYSTEM_TIME(command,tlmerge)
                   }
               }
 
+            if (METRICS != NULL)
+              { Filter_Stats *s = &FILTER_STATS;
+
+                fprintf(METRICS,"{\"threads\":%d",NTHREADS);
+                json_string("subject",aroot);
+                json_string("target",broot);
+                json_stage("read_db",&tread);
+                json_stage("sort_kmers",&tsort);
+                json_stage("count",&(s->count));
+                json_stage("merge",&(s->merge));
+                json_stage("pair_sort",&(s->pair_sort));
+                json_stage("report",&(s->report));
+                json_stage("las_sort",&tlsort);
+                json_stage("las_merge",&tlmerge);
+                fprintf(METRICS,",\"busy\":{");
+                json_busy("count",s->busy,NTHREADS);
+                fprintf(METRICS,",");
+                json_busy("merge",s->busy+NTHREADS,NTHREADS);
+                fprintf(METRICS,",");
+                json_busy("report",s->busy+2*NTHREADS,NTHREADS);
+                fprintf(METRICS,"}");
+                fprintf(METRICS,",\"subject_kmers\":%d,\"target_kmers\":%d,\"hits\":%lld",
+                                alen,blen,s->hits);
+                fprintf(METRICS,",\"mem_limit_gb\":%.1f,\"hit_limit\":%d,\"effective_t\":%d",
+                                (1.*MEM_LIMIT)/0x40000000ll,s->hit_limit,
+                                (int) sqrt(1.*s->hit_limit));
+                fprintf(METRICS,",\"local_alignments\":%lld,\"overlaps\":%lld",
+                                s->aligns,s->overlaps);
+                json_rss();
+                fprintf(METRICS,"}\n");
+                fflush(METRICS);
+              }
+
             free(bpath);
             free(broot);
           }
@@ -731,11 +922,27 @@ int main(int argc, char *argv[])
         printf("%s: Warning: Track %s given but never used.\n", Prog_Name,MASK[j]);
   }
 
-  free(aindex);
+  Huge_Free(aindex);
   Close_DB(ablock);
   free(apath);
   free(aroot);
 
+  if (METRICS != NULL)
+    fclose(METRICS);
+  if (CAPTURE != NULL)
+    fclose(CAPTURE);
+
+  if (VERBOSE)
+    { Print_Huge_Pages(stdout);
+      Print_Pool_Stats(stdout,pool);
+      fflush(stdout);
+    }
+  Free_Thread_Pool(pool);
+  if (VERBOSE && PIN == POOL_PIN_NODE)
+    { Print_Node_Counters(stdout);
+      fflush(stdout);
+    }
+
 #ifdef PROFILE
   { int64 secs, mics;
 
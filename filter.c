@@ -21,9 +21,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
-#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "DB.h"
+#include "thread.pool.h"
 #include "lsd.sort.h"
 #include "filter.h"
 #include "align.h"
@@ -64,8 +67,6 @@
 
   //  Algorithm constants & global data types
 
-#define THREAD       pthread_t
-
 #define MAX_CODE_16  0xffffu
 #define MAX_CODE_32  0xffffffffu
 #define MAX_CODE_64  0xffffffffffffffffllu
@@ -95,6 +96,49 @@ typedef struct
     int diag;
   } SeedPair;
 
+/*******************************************************************************************
+ *
+ *  STAGE TIMING & STATISTICS
+ *
+ ********************************************************************************************/
+
+Filter_Stats FILTER_STATS;
+
+static void stage_now(Stage_Time *now)
+{ struct timespec wall;
+  struct rusage   self, kids;
+
+  clock_gettime(CLOCK_MONOTONIC,&wall);
+  getrusage(RUSAGE_SELF,&self);
+  getrusage(RUSAGE_CHILDREN,&kids);
+  now->wall = wall.tv_sec + wall.tv_nsec/1.e9;
+  now->cpu  = (self.ru_utime.tv_sec + kids.ru_utime.tv_sec
+                 + self.ru_stime.tv_sec + kids.ru_stime.tv_sec)
+            + (self.ru_utime.tv_usec + kids.ru_utime.tv_usec
+                 + self.ru_stime.tv_usec + kids.ru_stime.tv_usec)/1.e6;
+}
+
+void Start_Stage(Stage_Time *stage)
+{ stage_now(stage); }
+
+void End_Stage(Stage_Time *stage)
+{ Stage_Time now;
+
+  stage_now(&now);
+  stage->wall = now.wall - stage->wall;
+  stage->cpu  = now.cpu  - stage->cpu;
+}
+
+  //  Cpu seconds used by the calling thread so far
+
+static double thread_cpu()
+{ struct timespec cpu;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&cpu);
+  return (cpu.tv_sec + cpu.tv_nsec/1.e9);
+}
+
+
 /*******************************************************************************************
  *
  *  PARAMETER SETUP
@@ -122,9 +166,11 @@ static int Binshift;
 static int Suppress;
 static int TooFrequent;       //  (Suppress != 0) ? Suppress : INT32_MAX
 
-static int NTHREADS;          //  # of threads to use
+static Thread_Pool *POOL;     //  Threads to use
+static int NTHREADS;          //  # of threads in POOL
 
-void Set_Filter_Params(int kmer, int mod, int binshift, int suppress, int hitmin, int nthread)
+void Set_Filter_Params(int kmer, int mod, int binshift, int suppress, int hitmin,
+                       Thread_Pool *pool)
 { if (kmer > 32)
     { fprintf(stderr,"%s: Kmer length must be <= 32\n",Prog_Name);
       exit (1);
@@ -158,10 +204,56 @@ void Set_Filter_Params(int kmer, int mod, int binshift, int suppress, int hitmin
   else
     TooFrequent = Suppress;
 
-  NTHREADS = nthread;
+  POOL     = pool;
+  NTHREADS = Pool_Size(pool);
+
+  FILTER_STATS.busy = (double *) Malloc(sizeof(double)*3*NTHREADS,"Allocating filter statistics");
+  if (FILTER_STATS.busy == NULL)
+    exit (1);
 }
 
 
+/*******************************************************************************************
+ *
+ *  FIRST TOUCH:  When the pool is spread over several NUMA nodes, the pages of a freshly
+ *    allocated vector are touched by the pool in NTHREADS contiguous parts so that each part
+ *    is placed on the node of the worker that will later fill and read it.
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { char  *beg;
+    int64  len;
+  } Touch_Arg;
+
+static void *touch_thread(void *arg)
+{ Touch_Arg *data = (Touch_Arg *) arg;
+  int64      page, i;
+
+  page = sysconf(_SC_PAGESIZE);
+  for (i = 0; i < data->len; i += page)
+    data->beg[i] = 0;
+  return (NULL);
+}
+
+static void first_touch(void *vec, int64 len)
+{ Touch_Arg parmx[NTHREADS];
+  int64     beg, end;
+  int       i;
+
+  if (Pool_Nodes(POOL) <= 1)
+    return;
+
+  beg = 0;
+  for (i = 0; i < NTHREADS; i++)
+    { end = (len * (i+1)) / NTHREADS;
+      parmx[i].beg = ((char *) vec) + beg;
+      parmx[i].len = end - beg;
+      beg = end;
+    }
+  Pool_For(POOL,"touch",touch_thread,parmx,sizeof(Touch_Arg),NTHREADS);
+}
+
 /*******************************************************************************************
  *
  *  INDEX BUILD
@@ -528,8 +620,7 @@ static void *compress_thread(void *arg)
 }
 
 void *Sort_Kmers(DAZZ_DB *block, int *len)
-{ THREAD    threads[NTHREADS];
-  Tuple_Arg parmt[NTHREADS];
+{ Tuple_Arg parmt[NTHREADS];
 
   KmerPos  *src, *trg, *rez;
   int       kmers, nreads;
@@ -562,10 +653,7 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
       parmt[i].beg = parmt[i-1].end = (((int64) nreads) * i) / NTHREADS;
     parmt[NTHREADS-1].end = nreads;
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,mask_thread,parmt+i);
-    for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
+    Pool_For(POOL,"mask",mask_thread,parmt,sizeof(Tuple_Arg),NTHREADS);
 
     x = 0;
     for (i = 0; i < NTHREADS; i++)
@@ -582,15 +670,17 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
   //  Allocate k-mer sorting arrays now that # of kmers is known
 
   if (( (Kshift-1)/8 + (TooFrequent < INT32_MAX) ) & 0x1)
-    { src = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
-      trg = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
+    { src = (KmerPos *) Huge_Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
+      trg = (KmerPos *) Huge_Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
     }
   else
-    { trg = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
-      src = (KmerPos *) Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
+    { trg = (KmerPos *) Huge_Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
+      src = (KmerPos *) Huge_Malloc(sizeof(KmerPos)*(kmers+2),"Allocating Sort_Kmers vectors");
     }
   if (src == NULL || trg == NULL)
     Clean_Exit(1);
+  first_touch(src,sizeof(KmerPos)*(kmers+2));
+  first_touch(trg,sizeof(KmerPos)*(kmers+2));
 
 #ifdef PROFILE
   printf("K %d\n",kmers);
@@ -605,15 +695,9 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
 
   //  Build the k-mer list
 
-  { int i;
-
-    FR_src = src;
+  FR_src = src;
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,tuple_thread,parmt+i);
-    for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
-  }
+  Pool_For(POOL,"tuple",tuple_thread,parmt,sizeof(Tuple_Arg),NTHREADS);
 
   //  Sort the k-mer list
 
@@ -662,11 +746,7 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
           FR_trg = rez = src;
         }
 
-      for (i = 0; i < NTHREADS; i++)
-        pthread_create(threads+i,NULL,compsize_thread,parmt+i);
-
-      for (i = 0; i < NTHREADS; i++)
-        pthread_join(threads[i],NULL);
+      Pool_For(POOL,"compsize",compsize_thread,parmt,sizeof(Tuple_Arg),NTHREADS);
 
       x = 0;
       for (i = 0; i < NTHREADS; i++)
@@ -676,20 +756,16 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
         }
       kmers = x;
 
-      for (i = 0; i < NTHREADS; i++)
-        pthread_create(threads+i,NULL,compress_thread,parmt+i);
-
-      for (i = 0; i < NTHREADS; i++)
-        pthread_join(threads[i],NULL);
+      Pool_For(POOL,"compress",compress_thread,parmt,sizeof(Tuple_Arg),NTHREADS);
     }
 
   rez[kmers].code   = MAX_CODE_64;
   rez[kmers+1].code = 0;
     
   if (src != rez)
-    free(src);
+    Huge_Free(src);
   else
-    free(trg);
+    Huge_Free(trg);
 
 #ifdef TEST_KSORT
   { int i;
@@ -740,7 +816,7 @@ void *Sort_Kmers(DAZZ_DB *block, int *len)
     }
 
   if (kmers <= 0)
-    { free(rez);
+    { Huge_Free(rez);
       goto no_mers;
     }
 
@@ -799,6 +875,7 @@ typedef struct
     int    bbeg, bend;
     int64  nhits;
     int    limit;
+    double busy;
     int64  hitgram[MAXGRAM];
   } Merge_Arg;
 
@@ -814,6 +891,8 @@ static void *count_thread(void *arg)
   int    ia, ja;
   uint64 ca, da;
 
+  data->busy = thread_cpu();
+
   ia = data->abeg;
   ca = asort[ia].code;
   if (MG_self)
@@ -905,6 +984,7 @@ static void *count_thread(void *arg)
     }
 
   data->nhits = nhits;
+  data->busy  = thread_cpu() - data->busy;
 
   return (NULL);
 }
@@ -927,6 +1007,8 @@ static void *merge_thread(void *arg)
   uint64 ca, da;
   int    nread = MG_ablock->nreads;
 
+  data->busy = thread_cpu();
+
   ia = data->abeg;
   ca = asort[ia].code;
   if (MG_self)
@@ -1108,6 +1190,8 @@ static void *merge_thread(void *arg)
         }
     }
 
+  data->busy = thread_cpu() - data->busy;
+
   return (NULL);
 }
 
@@ -1849,6 +1933,10 @@ typedef struct
     FILE       *ofile2;
     int64       nfilt;
     int64       nlas;
+    double      busy;
+    Capture_Seed *seeds;  //  Seeds of the calls to Local_Alignment if CAPTURE is set
+    int64       nseed;
+    int64       mseed;
 #ifdef PROFILE
     int         profyes[MAXHIT+1];
     int         profno[MAXHIT+1];
@@ -1860,6 +1948,27 @@ typedef struct
     uint64 p2;
   } Double;
 
+  //  Note the seed of a call to Local_Alignment in the capture buffer of a report thread,
+  //    the read indices are relative to their blocks until the segment is written.
+
+static void capture_seed(Report_Arg *data, int ar, int br, int bc, int diag, int anti)
+{ Capture_Seed *s;
+
+  if (data->nseed >= data->mseed)
+    { data->mseed = 1.2*data->nseed + 10000;
+      data->seeds = (Capture_Seed *) Realloc(data->seeds,sizeof(Capture_Seed)*data->mseed,
+                                             "Reallocating capture buffer");
+      if (data->seeds == NULL)
+        Clean_Exit(1);
+    }
+  s = data->seeds + data->nseed++;
+  s->aread = ar;
+  s->bread = br;
+  s->comp  = bc;
+  s->diag  = diag;
+  s->anti  = anti;
+}
+
 static void *report_thread(void *arg)
 { Report_Arg  *data   = (Report_Arg *) arg;
   SeedPair    *hits   = MR_hits;
@@ -1899,6 +2008,7 @@ static void *report_thread(void *arg)
 
   Trace_Buffer _tbuf, *tbuf = &_tbuf;
   int          small, tbytes;
+  Las_Writer  *writer1, *writer2;
 
   Double *hitc;
   int     minhit;
@@ -1914,6 +2024,8 @@ static void *report_thread(void *arg)
   //  In ovl and align roles of A and B are reversed, as the B sequence must be the
   //    complemented sequence !!
 
+  data->busy = thread_cpu();
+
   align->path = apath;
   bcomp = New_Read_Buffer(MR_bblock);
 
@@ -1943,6 +2055,17 @@ static void *report_thread(void *arg)
       fwrite(&MR_tspace,sizeof(int),1,ofile2);
     }
 
+  //  With -z the records are written in the blocked format by a writer for each file
+
+  writer1 = writer2 = NULL;
+  if (BLOCKED)
+    { writer1 = writer2 = Open_Las_Writer(ofile1,MR_tspace);
+      if (MR_two)
+        writer2 = Open_Las_Writer(ofile2,MR_tspace);
+      if (writer1 == NULL || writer2 == NULL)
+        Clean_Exit(1);
+    }
+
 #ifdef PROFILE
   { int i;
     for (i = 0; i <= MAXHIT; i++)
@@ -2070,6 +2193,9 @@ static void *report_thread(void *arg)
 #endif
 
 #ifdef DO_ALIGNMENT
+                    if (CAPTURE != NULL)
+                      capture_seed(data,ar,br,bc,apos-bpos,apos+bpos);
+
                     bpath = Local_Alignment(align,work,MR_spec,apos-bpos,apos-bpos,apos+bpos,-1,-1);
 
                     { int low, hgh, ae;
@@ -2202,7 +2328,8 @@ static void *report_thread(void *arg)
                    ovla->path.trace = tbuf->trace + (uint64) (ovla->path.trace);
                    if (small)
                      Compress_TraceTo8(ovla,1);
-                   if (Write_Overlap(ofile1,ovla,tbytes))
+                   if (writer1 != NULL ? Write_Las_Record(writer1,ovla)
+                                         : Write_Overlap(ofile1,ovla,tbytes))
                      { fprintf(stderr,"%s: Cannot write to %s too small?\n",SORT_PATH,Prog_Name);
                        Clean_Exit(1);
                      }
@@ -2215,7 +2342,8 @@ static void *report_thread(void *arg)
                    ovlb->path.trace = tbuf->trace + (uint64) (ovlb->path.trace);
                    if (small)
                      Compress_TraceTo8(ovlb,1);
-                   if (Write_Overlap(ofile2,ovlb,tbytes))
+                   if (writer2 != NULL ? Write_Las_Record(writer2,ovlb)
+                                         : Write_Overlap(ofile2,ovlb,tbytes))
                      { fprintf(stderr,"%s: Cannot write to %s, too small?\n",SORT_PATH,Prog_Name);
                        Clean_Exit(1);
                      }
@@ -2235,6 +2363,12 @@ static void *report_thread(void *arg)
   data->nfilt = nfilt;
   data->nlas  = nlas;
 
+  if (writer1 != NULL)
+    { Close_Las_Writer(writer1);
+      if (MR_two)
+        Close_Las_Writer(writer2);
+    }
+
   if (MR_two)
     { rewind(ofile2);
       fwrite(&bhits,sizeof(int64),1,ofile2);
@@ -2247,6 +2381,8 @@ static void *report_thread(void *arg)
   fwrite(&ahits,sizeof(int64),1,ofile1);
   fclose(ofile1);
 
+  data->busy = thread_cpu() - data->busy;
+
   return (NULL);
 }
 
@@ -2273,10 +2409,121 @@ static char *NameBuffer(char *aname, char *bname)
   return (cat);
 }
 
+  //  Write to CAPTURE the segment for the comparison of ablock and bblock:  the reads referred
+  //    to by the seeds of the report threads, each once and in order of first reference, and
+  //    then the seeds with their read indices made relative to this list.
+
+static void capture_segment(Report_Arg *parmr, DAZZ_DB *ablock, DAZZ_DB *bblock,
+                            Align_Spec *aspec)
+{ Capture_Head  head;
+  Capture_Seed *s;
+  int          *aidx, *bidx;
+  char         *seq;
+  int           nseq, i, t;
+  int64         j, nseed;
+
+  aidx = (int *) Malloc(sizeof(int)*ablock->nreads,"Allocating capture index");
+  if (ablock == bblock)
+    bidx = aidx;
+  else
+    bidx = (int *) Malloc(sizeof(int)*bblock->nreads,"Allocating capture index");
+  seq = New_Read_Buffer(ablock->maxlen > bblock->maxlen ? ablock : bblock);
+  if (aidx == NULL || bidx == NULL || seq == NULL)
+    Clean_Exit(1);
+
+  for (i = 0; i < ablock->nreads; i++)
+    aidx[i] = -1;
+  for (i = 0; i < bblock->nreads; i++)
+    bidx[i] = -1;
+
+  nseq  = 0;
+  nseed = 0;
+  for (t = 0; t < NTHREADS; t++)
+    { s = parmr[t].seeds;
+      for (j = 0; j < parmr[t].nseed; j++)
+        { if (aidx[s[j].aread] < 0)
+            aidx[s[j].aread] = nseq++;
+          if (bidx[s[j].bread] < 0)
+            bidx[s[j].bread] = nseq++;
+        }
+      nseed += parmr[t].nseed;
+    }
+
+  head.nseq     = nseq;
+  head.reach    = Overlap_If_Possible(aspec);
+  head.tspace   = Trace_Spacing(aspec);
+  head.minover  = MINOVER;
+  head.ave_corr = Average_Correlation(aspec);
+  for (i = 0; i < 4; i++)
+    head.freq[i] = Base_Frequencies(aspec)[i];
+  head.nseed    = nseed;
+  if (fwrite(&head,sizeof(Capture_Head),1,CAPTURE) != 1)
+    goto write_error;
+
+  //  Invert the index maps to output the reads in index order, a b-read i as -(i+1)
+
+  { int *ord, k, len;
+    DAZZ_DB *db;
+
+    ord = (int *) Malloc(sizeof(int)*(nseq+1),"Allocating capture order");
+    if (ord == NULL)
+      Clean_Exit(1);
+    for (i = 0; i < ablock->nreads; i++)
+      if (aidx[i] >= 0)
+        ord[aidx[i]] = i;
+    if (bidx != aidx)
+      for (i = 0; i < bblock->nreads; i++)
+        if (bidx[i] >= 0)
+          ord[bidx[i]] = -(i+1);
+
+    for (k = 0; k < nseq; k++)
+      { if (ord[k] >= 0)
+          { db = ablock;
+            i  = ord[k];
+          }
+        else
+          { db = bblock;
+            i  = -(ord[k]+1);
+          }
+        len = db->reads[i].rlen;
+        memcpy(seq,((char *) db->bases) + db->reads[i].boff,len);
+        Compress_Read(len,seq);
+        if (fwrite(&len,sizeof(int),1,CAPTURE) != 1)
+          goto write_error;
+        if (fwrite(seq,1,COMPRESSED_LEN(len),CAPTURE) != (size_t) COMPRESSED_LEN(len))
+          goto write_error;
+      }
+
+    free(ord);
+  }
+
+  for (t = 0; t < NTHREADS; t++)
+    { s = parmr[t].seeds;
+      for (j = 0; j < parmr[t].nseed; j++)
+        { s[j].aread = aidx[s[j].aread];
+          s[j].bread = bidx[s[j].bread];
+        }
+      if (fwrite(s,sizeof(Capture_Seed),parmr[t].nseed,CAPTURE) != (size_t) parmr[t].nseed)
+        goto write_error;
+      free(s);
+    }
+
+  fflush(CAPTURE);
+
+  free(seq-1);
+  if (bidx != aidx)
+    free(bidx);
+  free(aidx);
+  return;
+
+write_error:
+  fprintf(stderr,"%s: Cannot write to capture file, disk full?\n",Prog_Name);
+  Clean_Exit(1);
+}
+
 void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
                   void *vasort, int alen, void *vbsort, int blen, Align_Spec *aspec)
-{ THREAD     threads[NTHREADS];
-  Merge_Arg  parmm[NTHREADS];
+{ Merge_Arg  parmm[NTHREADS];
   Report_Arg parmr[NTHREADS];
   char      *fname;
 
@@ -2298,6 +2545,16 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
   nfilt = nlas = nhits = 0;
 
+  { Stage_Time zero = { 0., 0. };
+    int        i;
+
+    FILTER_STATS.count     = FILTER_STATS.merge  = zero;
+    FILTER_STATS.pair_sort = FILTER_STATS.report = zero;
+    FILTER_STATS.hit_limit = 0;
+    for (i = 0; i < 3*NTHREADS; i++)
+      FILTER_STATS.busy[i] = 0.;
+  }
+
   if (VERBOSE)
     printf("\nComparing %s to %s\n",aname,bname);
 
@@ -2332,11 +2589,13 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
       for (j = 0; j < MAXGRAM; j++)
         parmm[i].hitgram[j] = 0;
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,count_thread,parmm+i);
+    Start_Stage(&FILTER_STATS.count);
 
+    Pool_For(POOL,"count",count_thread,parmm,sizeof(Merge_Arg),NTHREADS);
+
+    End_Stage(&FILTER_STATS.count);
     for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
+      FILTER_STATS.busy[i] = parmm[i].busy;
 
     if (VERBOSE)
       printf("\n");
@@ -2400,6 +2659,7 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
               parmm[i].nhits += j * parmm[i].hitgram[j];
             parmm[i].limit = limit;
           }
+        FILTER_STATS.hit_limit = limit;
       }
     else
       for (i = 0; i < NTHREADS; i++)
@@ -2425,18 +2685,21 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
       goto zerowork;
 
     if (asort == bsort)
-      hhit = work1 = (SeedPair *) Malloc(sizeof(SeedPair)*(nhits+1),
-                                         "Allocating daligner hit vectors");
+      hhit = work1 = (SeedPair *) Huge_Malloc(sizeof(SeedPair)*(nhits+1),
+                                              "Allocating daligner hit vectors");
     else
       { if (nhits*sizeof(SeedPair) >= blen*sizeof(KmerPos))
-          bsort = (KmerPos *) Realloc(bsort,sizeof(SeedPair)*(nhits+1),
-                                       "Reallocating daligner sort vectors");
+          bsort = (KmerPos *) Huge_Realloc(bsort,sizeof(SeedPair)*(nhits+1),
+                                            "Reallocating daligner sort vectors");
         hhit = work1 = (SeedPair *) bsort;
       }
-    khit = work2 = (SeedPair *) Malloc(sizeof(SeedPair)*(nhits+1),
-                                        "Allocating daligner hit vectors");
+    khit = work2 = (SeedPair *) Huge_Malloc(sizeof(SeedPair)*(nhits+1),
+                                             "Allocating daligner hit vectors");
     if (hhit == NULL || khit == NULL || bsort == NULL)
       Clean_Exit(1);
+    if (asort == bsort)
+      first_touch(work1,sizeof(SeedPair)*(nhits+1));
+    first_touch(work2,sizeof(SeedPair)*(nhits+1));
 
     MG_blist = bsort;
     MG_hits  = khit;
@@ -2445,11 +2708,13 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
       parmm[i].nhits = parmm[i-1].nhits;
     parmm[0].nhits = 0;
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,merge_thread,parmm+i);
+    Start_Stage(&FILTER_STATS.merge);
+
+    Pool_For(POOL,"merge",merge_thread,parmm,sizeof(Merge_Arg),NTHREADS);
 
+    End_Stage(&FILTER_STATS.merge);
     for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
+      FILTER_STATS.busy[NTHREADS+i] = parmm[i].busy;
 
 #ifdef TEST_PAIRS
     printf("\nSETUP SORT:\n");
@@ -2504,7 +2769,9 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 #endif
     pairsort[j+i] = -1;
 
+    Start_Stage(&FILTER_STATS.pair_sort);
     khit = (SeedPair *) LSD_Sort(nhits,khit,hhit,16,16,pairsort);
+    End_Stage(&FILTER_STATS.pair_sort);
 
     khit[nhits].aread = 0x7fffffff;
     khit[nhits].bread = 0x7fffffff;
@@ -2562,6 +2829,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
         parmr[i].lastp = parmr[i].score + max_diag;
         parmr[i].lasta = parmr[i].lastp + max_diag;
         parmr[i].work  = New_Work_Data();
+        parmr[i].seeds = NULL;
+        parmr[i].nseed = parmr[i].mseed = 0;
 
         sprintf(fname,"%s/%s.%s.N%d.las",SORT_PATH,aname,bname,i+1);
         parmr[i].ofile1 = Fopen(fname,"w");
@@ -2578,6 +2847,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
           }
       }
 
+    Start_Stage(&FILTER_STATS.report);
+
 #ifdef NOTHREAD
 
     for (i = 0; i < NTHREADS; i++)
@@ -2585,21 +2856,23 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
 #else
 
-    for (i = 0; i < NTHREADS; i++)
-      pthread_create(threads+i,NULL,report_thread,parmr+i);
-
-    for (i = 0; i < NTHREADS; i++)
-      pthread_join(threads[i],NULL);
+    Pool_For(POOL,"report",report_thread,parmr,sizeof(Report_Arg),NTHREADS);
 
 #endif
 
+    End_Stage(&FILTER_STATS.report);
+
     for (i = 0; i < NTHREADS; i++)
       { nfilt += parmr[i].nfilt;
         nlas  += parmr[i].nlas;
+        FILTER_STATS.busy[2*NTHREADS+i] = parmr[i].busy;
         Free_Work_Data(parmr[i].work);
       }
     free(space);
 
+    if (CAPTURE != NULL)
+      capture_segment(parmr,ablock,bblock,aspec);
+
 #ifdef PROFILE
     { int64 nyes, nno;
 
@@ -2627,8 +2900,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 #endif
   }
 
-  free(work2);
-  free(work1);
+  Huge_Free(work2);
+  Huge_Free(work1);
   goto epilogue;
 
 zerowork:
@@ -2656,6 +2929,10 @@ zerowork:
 
 epilogue:
 
+  FILTER_STATS.hits     = nhits;
+  FILTER_STATS.aligns   = nfilt;
+  FILTER_STATS.overlaps = nlas;
+
   if (VERBOSE)
     { int width;
 
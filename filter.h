@@ -13,6 +13,7 @@
 
 #include "DB.h"
 #include "align.h"
+#include "thread.pool.h"
 
 #undef PROFILE
 
@@ -22,18 +23,72 @@ extern int    HGAP_MIN;     //  HGap minimum (-H)
 extern int    SYMMETRIC;    //  output both A vs B and B vs A? ( ! -A)
 extern int    IDENTITY;     //  compare reads against themselves?  (-I)
 extern int    BRIDGE;       //  bridge consecutive, chainable alignments  (-B)
+extern int    BLOCKED;      //  write .las files in the blocked, compressed format  (-z)
 extern char  *SORT_PATH;    //  where to place temporary files (-P)
+extern FILE  *CAPTURE;      //  record the seeds of all alignments here (-R)
 
 extern uint64 MEM_LIMIT;    //  memory limit (-M)
 extern uint64 MEM_PHYSICAL;
 
-void Set_Filter_Params(int kmer, int mod, int binshift, int suppress, int hitmin, int nthreads); 
+void Set_Filter_Params(int kmer, int mod, int binshift, int suppress, int hitmin,
+                       Thread_Pool *pool);
 
 void *Sort_Kmers(DAZZ_DB *block, int *len);
 
 void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
                   void *atable, int alen, void *btable, int blen, Align_Spec *asettings);
 
+  //  Elapsed wall and cpu (user + system, including that of finished child processes) seconds
+  //    of a stage of the computation:  Start_Stage notes the current times, and End_Stage
+  //    then sets the stage to the times elapsed since.
+
+typedef struct
+  { double wall;
+    double cpu;
+  } Stage_Time;
+
+void Start_Stage(Stage_Time *stage);
+void End_Stage(Stage_Time *stage);
+
+  //  Statistics of the last call to Match_Filter (for daligner -J)
+
+typedef struct
+  { Stage_Time count;       //  Counting k-mer hits (count_thread)
+    Stage_Time merge;       //  Producing the k-mer hits (merge_thread)
+    Stage_Time pair_sort;   //  Sorting the hits by read pair
+    Stage_Time report;      //  Finding and writing alignments (report_thread)
+    double    *busy;        //  [0,3*nthreads) = cpu seconds of each count, merge, & report thread
+    int64      hits;        //  # of k-mer hits
+    int        hit_limit;   //  Hits beyond this per k-mer are ignored to stay within -M
+    int64      aligns;      //  # of calls to Local_Alignment
+    int64      overlaps;    //  # of confirmed overlaps output
+  } Filter_Stats;
+
+extern Filter_Stats FILTER_STATS;
+
+  //  Capture file (daligner -R, read by bench/alnbench):  for each call to Match_Filter a
+  //    Capture_Head, then nseq sequences each given as an int length followed by its bases
+  //    compressed as by Compress_Read, and then nseed Capture_Seeds, each the arguments of
+  //    a call to Local_Alignment made by report_thread in the order they were made.
+
+typedef struct
+  { int    nseq;       //  # of sequences that follow
+    int    reach;      //  Parameters of the Align_Spec
+    int    tspace;
+    int    minover;    //  -l, alignments at least this long are kept
+    double ave_corr;
+    float  freq[4];
+    int64  nseed;      //  # of seeds that follow the sequences
+  } Capture_Head;
+
+typedef struct
+  { int aread;         //  Index of the A-sequence in the sequences of the segment
+    int bread;         //  Index of the B-sequence, complemented if comp is set
+    int comp;
+    int diag;          //  Seed diagonal and anti-diagonal
+    int anti;
+  } Capture_Seed;
+
 void Clean_Exit(int val);
 
 #endif
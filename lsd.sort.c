@@ -16,9 +16,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
-#include <pthread.h>
 
 #include "DB.h"
+#include "thread.pool.h"
 #include "lsd.sort.h"
 
 typedef unsigned char uint8;
@@ -29,11 +29,13 @@ typedef long long     int64;
 static int    RSIZE;    //  Span between records
 static int    DSIZE;    //  Size of record
 
-static int    NTHREADS;       //  # of threads to use
+static Thread_Pool *POOL;     //  Threads to use
+static int    NTHREADS;       //  # of threads in POOL
 static int    VERBOSE;        //  Print each byte as it is sorted
 
-void Set_LSD_Params(int nthread, int verbose)
-{ NTHREADS = nthread;
+void Set_LSD_Params(Thread_Pool *pool, int verbose)
+{ POOL     = pool;
+  NTHREADS = Pool_Size(pool);
   VERBOSE  = verbose;
 }
 
@@ -121,8 +123,7 @@ static void *lexbeg_thread(void *arg)
 //    Return a pointer to the array containing the final result.
 
 void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *bytes)
-{ pthread_t threads[NTHREADS];
-  Lex_Arg   parmx[NTHREADS];   //  Thread control record for sorting
+{ Lex_Arg   parmx[NTHREADS];   //  Thread control record for sorting
 
   uint8   *xch;
   int64    x, y, asize;
@@ -168,12 +169,7 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
       //    otherwise accumulate from sptr counts of last sweep
 
       if (b == 0)
-        { for (i = 1; i < NTHREADS; i++)
-            pthread_create(threads+i,NULL,lexbeg_thread,parmx+i);
-          lexbeg_thread(parmx);
-          for (i = 1; i < NTHREADS; i++)
-            pthread_join(threads[i],NULL);
-        }
+        Pool_For(POOL,"lsd_count",lexbeg_thread,parmx,sizeof(Lex_Arg),NTHREADS);
       else
         { int64 *pxt, *pxs;
 
@@ -223,11 +219,7 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
 
       //  Threaded pass
 
-      for (i = 1; i < NTHREADS; i++)
-        pthread_create(threads+i,NULL,lex_thread,parmx+i);
-      lex_thread(parmx);
-      for (i = 1; i < NTHREADS; i++)
-        pthread_join(threads[i],NULL);
+      Pool_For(POOL,"lsd_pass",lex_thread,parmx,sizeof(Lex_Arg),NTHREADS);
 
       xch     = LEX_src;
       LEX_src = LEX_trg;
@@ -1,7 +1,9 @@
 #ifndef LSD_SORT
 #define LSD_SORT
 
-void Set_LSD_Params(int nthread, int verbose);
+#include "thread.pool.h"
+
+void Set_LSD_Params(Thread_Pool *pool, int verbose);
 
 void *LSD_Sort(long long len, void *src, void *trg, int rsize, int dsize, int *bytes);
 
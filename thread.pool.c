@@ -0,0 +1,524 @@
+/*******************************************************************************************
+ *
+ *  A pool of worker threads serving a queue of tasks, where each task is accounted to a
+ *    named stage so that the utilization of the pool in each stage can be reported.  On
+ *    Linux the workers can be pinned to cpus or spread over the NUMA nodes of the machine,
+ *    memory can be interleaved over those nodes, and the local and remote memory accesses
+ *    of the program can be counted with perf events.
+ *
+ ********************************************************************************************/
+
+#ifdef __linux__
+#define _GNU_SOURCE      //  For pthread_setaffinity_np and syscall
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "DB.h"
+#include "thread.pool.h"
+
+typedef struct
+  { char   *name;
+    int64   calls;   //  # of calls to Pool_For
+    int64   tasks;   //  # of tasks run
+    double  wall;    //  Wall seconds in Pool_For
+    double  busy;    //  Cpu seconds of the tasks
+  } Stage;
+
+typedef struct
+  { void *(*task)(void *);
+    void   *arg;
+    int     stage;
+    int     worker;    //  Only this worker may run the task (any if -1)
+  } Task;
+
+#define MAX_NODE 64    //  Nodes beyond this are ignored
+
+typedef struct
+  { int        id;     //  OS number of the node
+#ifdef __linux__
+    cpu_set_t  cpus;   //  Its cpus
+#endif
+  } Node;
+
+typedef struct
+  { int             nthreads;
+    int             pin;
+    pthread_t      *threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work;      //  Signalled when a task is queued or the pool is shut down
+    pthread_cond_t  done;      //  Signalled when the last pending task is done
+    Task           *queue;     //  Queue of qlen tasks in submission order
+    int             qmax;
+    int             qlen;
+    int             pending;   //  # of tasks queued or running
+    int             shutdown;
+
+    Stage          *stages;
+    int             nstage;
+    int             smax;
+
+    int             nnode;     //  # of NUMA nodes the workers are spread over (POOL_PIN_NODE)
+    Node           *nodes;
+    int            *wnode;     //  wnode[i] = index in nodes of worker i's node
+  } _Thread_Pool;
+
+typedef struct
+  { _Thread_Pool *pool;
+    int           index;
+  } Worker_Arg;
+
+static double wall_time()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (t.tv_sec + t.tv_nsec*1e-9);
+}
+
+static double thread_cpu()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&t);
+  return (t.tv_sec + t.tv_nsec*1e-9);
+}
+
+#ifdef __linux__
+
+  //  Parse a sysfs cpu or node list such as "0-3,8,10-11" and add each member to set
+
+static void parse_list(char *list, cpu_set_t *set)
+{ char *p;
+  int   lo, hi;
+
+  p = list;
+  while (*p != '\0' && *p != '\n')
+    { lo = hi = (int) strtol(p,&p,10);
+      if (*p == '-')
+        hi = (int) strtol(p+1,&p,10);
+      for ( ; lo <= hi; lo++)
+        CPU_SET(lo,set);
+      if (*p == ',')
+        p += 1;
+      else if (*p != '\0' && *p != '\n')
+        break;
+    }
+}
+
+static int read_list(char *path, cpu_set_t *set)
+{ FILE *f;
+  char  buf[4096];
+
+  CPU_ZERO(set);
+  f = fopen(path,"r");
+  if (f == NULL)
+    return (1);
+  if (fgets(buf,4096,f) == NULL)
+    { fclose(f);
+      return (1);
+    }
+  fclose(f);
+  parse_list(buf,set);
+  return (0);
+}
+
+#endif
+
+  //  Find the online NUMA nodes and their cpus.  If the topology cannot be read then the
+  //    machine is treated as a single node.
+
+static void find_nodes(_Thread_Pool *pool)
+{ pool->nodes = (Node *) Malloc(sizeof(Node)*MAX_NODE,"Allocating thread pool");
+  if (pool->nodes == NULL)
+    exit (1);
+  pool->nnode = 0;
+
+#ifdef __linux__
+  { cpu_set_t online;
+    char      path[100];
+    int       n;
+
+    if (read_list("/sys/devices/system/node/online",&online) == 0)
+      for (n = 0; n < CPU_SETSIZE && pool->nnode < MAX_NODE; n++)
+        if (CPU_ISSET(n,&online))
+          { sprintf(path,"/sys/devices/system/node/node%d/cpulist",n);
+            if (read_list(path,&pool->nodes[pool->nnode].cpus) != 0)
+              continue;
+            if (CPU_COUNT(&pool->nodes[pool->nnode].cpus) == 0)   //  Memory only node
+              continue;
+            pool->nodes[pool->nnode].id = n;
+            pool->nnode += 1;
+          }
+    if (pool->nnode == 0)
+      { pool->nodes[0].id = 0;
+        sched_getaffinity(0,sizeof(cpu_set_t),&pool->nodes[0].cpus);
+        pool->nnode = 1;
+      }
+  }
+#else
+  pool->nodes[0].id = 0;
+  pool->nnode = 1;
+#endif
+}
+
+  //  Index in the queue of the first task worker me may run, -1 if none (the pool must be locked)
+
+static int next_task(_Thread_Pool *pool, int me)
+{ int k;
+
+  for (k = 0; k < pool->qlen; k++)
+    if (pool->queue[k].worker < 0 || pool->queue[k].worker == me)
+      return (k);
+  return (-1);
+}
+
+static void *worker(void *arg)
+{ Worker_Arg   *data = (Worker_Arg *) arg;
+  _Thread_Pool *pool = data->pool;
+  int           me   = data->index;
+  Task          t;
+  double        cpu;
+  int           k;
+
+#ifdef __linux__
+  if (pool->pin == POOL_PIN_CPU)
+    { cpu_set_t set;
+      long      ncpu;
+
+      ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      if (ncpu < 1)
+        ncpu = 1;
+      CPU_ZERO(&set);
+      CPU_SET(me % ncpu,&set);
+      pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&set);
+    }
+  else if (pool->pin == POOL_PIN_NODE)
+    pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&pool->nodes[pool->wnode[me]].cpus);
+#endif
+  free(data);
+
+  pthread_mutex_lock(&pool->lock);
+  while (1)
+    { while ((k = next_task(pool,me)) < 0 && ! pool->shutdown)
+        pthread_cond_wait(&pool->work,&pool->lock);
+      if (k < 0)
+        break;
+
+      t = pool->queue[k];
+      pool->qlen -= 1;
+      memmove(pool->queue+k,pool->queue+(k+1),sizeof(Task)*(pool->qlen-k));
+      pthread_mutex_unlock(&pool->lock);
+
+      cpu = thread_cpu();
+      t.task(t.arg);
+      cpu = thread_cpu() - cpu;
+
+      pthread_mutex_lock(&pool->lock);
+      pool->stages[t.stage].tasks += 1;
+      pool->stages[t.stage].busy  += cpu;
+      pool->pending -= 1;
+      if (pool->pending == 0)
+        pthread_cond_broadcast(&pool->done);
+    }
+  pthread_mutex_unlock(&pool->lock);
+
+  return (NULL);
+}
+
+Thread_Pool *New_Thread_Pool(int nthreads, int pin)
+{ _Thread_Pool *pool;
+  Worker_Arg   *arg;
+  int           i;
+
+  pool = (_Thread_Pool *) Malloc(sizeof(_Thread_Pool),"Allocating thread pool");
+  if (pool == NULL)
+    exit (1);
+  pool->nthreads = nthreads;
+  pool->pin      = pin;
+  pool->threads  = (pthread_t *) Malloc(sizeof(pthread_t)*nthreads,"Allocating thread pool");
+  pool->qmax     = 4*nthreads;
+  pool->queue    = (Task *) Malloc(sizeof(Task)*pool->qmax,"Allocating thread pool");
+  pool->smax     = 16;
+  pool->stages   = (Stage *) Malloc(sizeof(Stage)*pool->smax,"Allocating thread pool");
+  pool->wnode    = (int *) Malloc(sizeof(int)*nthreads,"Allocating thread pool");
+  if (pool->threads == NULL || pool->queue == NULL || pool->stages == NULL || pool->wnode == NULL)
+    exit (1);
+  pool->qlen     = 0;
+  pool->pending  = 0;
+  pool->shutdown = 0;
+  pool->nstage   = 0;
+
+  //  Spread the workers over the nodes in contiguous groups of (nearly) equal size
+
+  find_nodes(pool);
+  for (i = 0; i < nthreads; i++)
+    pool->wnode[i] = (int) ((((int64) i) * pool->nnode) / nthreads);
+
+  pthread_mutex_init(&pool->lock,NULL);
+  pthread_cond_init(&pool->work,NULL);
+  pthread_cond_init(&pool->done,NULL);
+
+  for (i = 0; i < nthreads; i++)
+    { arg = (Worker_Arg *) Malloc(sizeof(Worker_Arg),"Allocating thread pool");
+      if (arg == NULL)
+        exit (1);
+      arg->pool  = pool;
+      arg->index = i;
+      if (pthread_create(pool->threads+i,NULL,worker,arg) != 0)
+        { fprintf(stderr,"%s: Cannot create thread %d of the thread pool\n",Prog_Name,i+1);
+          exit (1);
+        }
+    }
+
+  return ((Thread_Pool *) pool);
+}
+
+void Free_Thread_Pool(Thread_Pool *vpool)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+  int           i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->nthreads; i++)
+    pthread_join(pool->threads[i],NULL);
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+
+  free(pool->wnode);
+  free(pool->nodes);
+  free(pool->stages);
+  free(pool->queue);
+  free(pool->threads);
+  free(pool);
+}
+
+int Pool_Size(Thread_Pool *pool)
+{ return (((_Thread_Pool *) pool)->nthreads); }
+
+int Pool_Nodes(Thread_Pool *vpool)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+
+  if (pool->pin != POOL_PIN_NODE)
+    return (0);
+  return (pool->nnode);
+}
+
+  //  Index of the stage called name, adding it if new (the pool must be locked)
+
+static int find_stage(_Thread_Pool *pool, char *name)
+{ int s;
+
+  for (s = 0; s < pool->nstage; s++)
+    if (pool->stages[s].name == name || strcmp(pool->stages[s].name,name) == 0)
+      return (s);
+
+  if (pool->nstage >= pool->smax)
+    { pool->smax   = 2*pool->smax;
+      pool->stages = (Stage *) Realloc(pool->stages,sizeof(Stage)*pool->smax,
+                                       "Reallocating thread pool");
+      if (pool->stages == NULL)
+        exit (1);
+    }
+  pool->stages[s].name  = name;
+  pool->stages[s].calls = 0;
+  pool->stages[s].tasks = 0;
+  pool->stages[s].wall  = 0.;
+  pool->stages[s].busy  = 0.;
+  pool->nstage += 1;
+  return (s);
+}
+
+  //  Queue a task for worker (any if -1) (the pool must be locked)
+
+static void enqueue(_Thread_Pool *pool, int stage, void *(*task)(void *), void *arg, int worker)
+{ Task *t;
+
+  if (pool->qlen >= pool->qmax)
+    { pool->qmax  = 2*pool->qmax;
+      pool->queue = (Task *) Realloc(pool->queue,sizeof(Task)*pool->qmax,
+                                     "Reallocating thread pool queue");
+      if (pool->queue == NULL)
+        exit (1);
+    }
+
+  t = pool->queue + pool->qlen;
+  t->task   = task;
+  t->arg    = arg;
+  t->stage  = stage;
+  t->worker = worker;
+  pool->qlen    += 1;
+  pool->pending += 1;
+}
+
+void Pool_Submit(Thread_Pool *vpool, char *stage, void *(*task)(void *), void *arg)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+
+  pthread_mutex_lock(&pool->lock);
+  enqueue(pool,find_stage(pool,stage),task,arg,-1);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void Pool_Wait(Thread_Pool *vpool)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0)
+    pthread_cond_wait(&pool->done,&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void Pool_For(Thread_Pool *vpool, char *stage, void *(*task)(void *), void *arg, int size, int n)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+  double        wall;
+  int           i, s;
+
+  wall = wall_time();
+
+  pthread_mutex_lock(&pool->lock);
+  s = find_stage(pool,stage);
+  for (i = 0; i < n; i++)
+    enqueue(pool,s,task,((char *) arg) + ((int64) i)*size,
+            pool->pin == POOL_PIN_NODE ? i % pool->nthreads : -1);
+  pthread_cond_broadcast(&pool->work);
+  while (pool->pending > 0)
+    pthread_cond_wait(&pool->done,&pool->lock);
+  pool->stages[s].calls += 1;
+  pool->stages[s].wall  += wall_time() - wall;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int Pool_Interleave(Thread_Pool *vpool, void *addr, int64 len)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+
+  if (pool->pin != POOL_PIN_NODE || pool->nnode <= 1 || len <= 0)
+    return (0);
+
+#if defined(__linux__) && defined(SYS_mbind)
+  { unsigned long mask[(MAX_NODE+1)/(8*sizeof(unsigned long))+1];
+    uint64        page, beg, end;
+    int           n, bits;
+
+    bits = 8*sizeof(unsigned long);
+    memset(mask,0,sizeof(mask));
+    for (n = 0; n < pool->nnode; n++)
+      mask[pool->nodes[n].id / bits] |= (1ul << (pool->nodes[n].id % bits));
+
+    page = (uint64) sysconf(_SC_PAGESIZE);
+    beg  = ((uint64) addr) & ~(page-1);
+    end  = (((uint64) addr) + len + (page-1)) & ~(page-1);
+    if (syscall(SYS_mbind,beg,end-beg,MPOL_INTERLEAVE,mask,
+                (unsigned long) (sizeof(mask)*8),MPOL_MF_MOVE) != 0)
+      return (1);
+    return (0);
+  }
+#else
+  return (1);
+#endif
+}
+
+void Print_Pool_Stats(FILE *out, Thread_Pool *vpool)
+{ _Thread_Pool *pool = (_Thread_Pool *) vpool;
+  Stage        *s;
+  int           i;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->pin == POOL_PIN_NODE)
+    fprintf(out,"\n  Thread pool of %d over %d node%s:\n",pool->nthreads,pool->nnode,
+                pool->nnode == 1 ? "" : "s");
+  else
+    fprintf(out,"\n  Thread pool of %d:\n",pool->nthreads);
+  fprintf(out,"    %-12s %8s %8s %10s %10s %6s\n","stage","calls","tasks","wall","cpu","util");
+  for (i = 0; i < pool->nstage; i++)
+    { s = pool->stages + i;
+      fprintf(out,"    %-12s %8lld %8lld %9.3fs %9.3fs",s->name,s->calls,s->tasks,s->wall,s->busy);
+      if (s->wall > 0.)
+        fprintf(out," %5.1f%%\n",(100.*s->busy)/(s->wall*pool->nthreads));
+      else
+        fprintf(out," %6s\n","-");
+    }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+  //  Node load counters:  file descriptors of the perf events counting the loads that hit
+  //    memory on the local and on a remote node, -1 if not open
+
+static int Node_Local  = -1;
+static int Node_Remote = -1;
+
+#ifdef __linux__
+
+static int open_node_event(int result)
+{ struct perf_event_attr attr;
+
+  memset(&attr,0,sizeof(attr));
+  attr.type           = PERF_TYPE_HW_CACHE;
+  attr.size           = sizeof(attr);
+  attr.config         = PERF_COUNT_HW_CACHE_NODE
+                      | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                      | (result << 16);
+  attr.inherit        = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  return ((int) syscall(SYS_perf_event_open,&attr,0,-1,-1,0));
+}
+
+#endif
+
+void Start_Node_Counters()
+{
+#ifdef __linux__
+  Node_Local  = open_node_event(PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+  Node_Remote = open_node_event(PERF_COUNT_HW_CACHE_RESULT_MISS);
+  if (Node_Local < 0 || Node_Remote < 0)
+    { if (Node_Local >= 0)
+        close(Node_Local);
+      if (Node_Remote >= 0)
+        close(Node_Remote);
+      Node_Local = Node_Remote = -1;
+    }
+#endif
+}
+
+void Print_Node_Counters(FILE *out)
+{ int64 local, remote;
+
+  if (Node_Local < 0)
+    { fprintf(out,"\n  Node loads: not available\n");
+      return;
+    }
+  if (read(Node_Local,&local,sizeof(int64)) != sizeof(int64) ||
+      read(Node_Remote,&remote,sizeof(int64)) != sizeof(int64))
+    fprintf(out,"\n  Node loads: not available\n");
+  else
+    { fprintf(out,"\n  Node loads: ");
+      Print_Number(local,0,out);
+      fprintf(out," local, ");
+      Print_Number(remote,0,out);
+      fprintf(out," remote");
+      if (local + remote > 0)
+        fprintf(out," (%.1f%% remote)",(100.*remote)/(local+remote));
+      fprintf(out,"\n");
+    }
+  close(Node_Local);
+  close(Node_Remote);
+  Node_Local = Node_Remote = -1;
+}
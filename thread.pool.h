@@ -0,0 +1,74 @@
+/*******************************************************************************************
+ *
+ *  A pool of worker threads that is created once and then used for every threaded stage
+ *    of a program, rather than creating and joining threads for each stage.
+ *
+ ********************************************************************************************/
+
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <stdio.h>
+
+#include "DB.h"
+
+typedef void Thread_Pool;
+
+  //  Placement of the workers by New_Thread_Pool
+
+#define POOL_FREE      0   //  Wherever the OS schedules them
+#define POOL_PIN_CPU   1   //  Worker i is bound to cpu i modulo the number of cpus
+#define POOL_PIN_NODE  2   //  Workers are spread in contiguous groups over the NUMA nodes
+                           //    and each is bound to the cpus of its node
+
+  //  Create a pool of nthreads workers placed according to pin where the OS supports it.
+  //    Failures are fatal.
+
+Thread_Pool *New_Thread_Pool(int nthreads, int pin);
+
+void Free_Thread_Pool(Thread_Pool *pool);
+
+int  Pool_Size(Thread_Pool *pool);
+
+  //  The number of NUMA nodes the workers are spread over if the pool was created with
+  //    POOL_PIN_NODE, 0 otherwise.
+
+int  Pool_Nodes(Thread_Pool *pool);
+
+  //  Parallel for:  call task(arg + i*size) for i in [0,n) on the workers and return when
+  //    all the calls are done.  The wall time of the call and the cpu time of the tasks are
+  //    accounted to the named stage (name must be a string that persists).  Any tasks
+  //    submitted earlier are also waited for.  With POOL_PIN_NODE task i is always run by
+  //    worker i modulo the pool size, so memory first touched by task i of one call is on
+  //    the node of the worker that runs task i of the next.
+
+void Pool_For(Thread_Pool *pool, char *stage, void *(*task)(void *), void *arg, int size, int n);
+
+  //  Task submission:  queue task(arg) for the next free worker and return at once.  Pool_Wait
+  //    returns when every task submitted so far is done.  The cpu time of a task is accounted
+  //    to the named stage.
+
+void Pool_Submit(Thread_Pool *pool, char *stage, void *(*task)(void *), void *arg);
+
+void Pool_Wait(Thread_Pool *pool);
+
+  //  Print for each stage the number of calls and tasks, the wall and cpu seconds, and the
+  //    utilization of the pool, i.e. cpu / (wall * # of workers), while in the stage.
+
+void Print_Pool_Stats(FILE *out, Thread_Pool *pool);
+
+  //  With POOL_PIN_NODE and more than one node, interleave the pages of [addr,addr+len) over
+  //    the nodes of the pool, moving those already touched.  Returns 1 if the OS refused, 0
+  //    otherwise (including when there is nothing to do).
+
+int  Pool_Interleave(Thread_Pool *pool, void *addr, int64 len);
+
+  //  Count the loads of the process served by memory on the local and on a remote NUMA node
+  //    with the kernel's perf events.  Start before creating any threads to be counted, and
+  //    print after they have been joined.  If the events are not available then that is
+  //    all that is printed.
+
+void Start_Node_Counters();
+void Print_Node_Counters(FILE *out);
+
+#endif // THREAD_POOL